@@ -75,6 +75,56 @@ endif
 endif
 
 
+ifeq ("$(TARGET_OS)","linux")
+ifneq ("$(TARGET_OS_FLAVOUR)", "android")
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libmedia-buffers-memory-memfd
+LOCAL_CATEGORY_PATH := libs
+LOCAL_DESCRIPTION := Media buffers memfd memory implementation
+LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/implem/memfd/include
+LOCAL_CFLAGS := -DMBUF_API_EXPORTS -fvisibility=hidden -std=gnu11 -D_GNU_SOURCE
+LOCAL_SRC_FILES := \
+	implem/memfd/src/mbuf_mem_memfd.c
+LOCAL_LIBRARIES := \
+	libmedia-buffers-memory \
+	libmedia-buffers-memory-internal \
+	libulog \
+
+include $(BUILD_LIBRARY)
+
+endif
+endif
+
+
+ifeq ("$(TARGET_OS)","linux")
+ifneq ("$(TARGET_OS_FLAVOUR)", "android")
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libmedia-buffers-shm-frame-queue
+LOCAL_CATEGORY_PATH := libs
+LOCAL_DESCRIPTION := Media buffers inter-process frame queue over SHM
+LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/implem/shm/include
+LOCAL_CFLAGS := -DMBUF_API_EXPORTS -fvisibility=hidden -std=gnu11 -D_GNU_SOURCE
+LOCAL_SRC_FILES := \
+	implem/shm/src/mbuf_shm_frame_queue.c
+LOCAL_LIBRARIES := \
+	libaudio-defs \
+	libmedia-buffers \
+	libmedia-buffers-memory \
+	libmedia-buffers-memory-shm \
+	libulog \
+	libvideo-defs \
+	libvideo-metadata
+
+include $(BUILD_LIBRARY)
+
+endif
+endif
+
+
 include $(CLEAR_VARS)
 
 LOCAL_MODULE := libmedia-buffers
@@ -85,6 +135,7 @@ LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/include
 # This header list is currently used to generate a python binding
 LOCAL_EXPORT_CUSTOM_VARIABLES := LIBMEDIABUFFERS_HEADERS=$\
 	$(LOCAL_PATH)/include/media-buffers/mbuf_ancillary_data.h:$\
+	$(LOCAL_PATH)/include/media-buffers/mbuf_frame_queue.h:$\
 	$(LOCAL_PATH)/include/media-buffers/mbuf_audio_frame.h:$\
 	$(LOCAL_PATH)/include/media-buffers/mbuf_coded_video_frame.h:$\
 	$(LOCAL_PATH)/include/media-buffers/mbuf_raw_video_frame.h;
@@ -133,6 +184,26 @@ LOCAL_SRC_FILES := \
 	tests/mbuf_test.c \
 	tests/mbuf_wrap_test.c
 
+ifeq ($(TARGET_OS),$(filter %$(TARGET_OS),linux darwin))
+ifneq ("$(TARGET_OS_FLAVOUR)", "android")
+LOCAL_CFLAGS += -DMBUF_TEST_SHM
+LOCAL_SRC_FILES += tests/mbuf_shm_test.c
+LOCAL_LIBRARIES += libmedia-buffers-memory-shm
+endif
+endif
+
+ifeq ("$(TARGET_OS)","linux")
+ifneq ("$(TARGET_OS_FLAVOUR)", "android")
+LOCAL_CFLAGS += -DMBUF_TEST_MEMFD -DMBUF_TEST_SHM_FRAME_QUEUE
+LOCAL_SRC_FILES += \
+	tests/mbuf_memfd_test.c \
+	tests/mbuf_shm_frame_queue_test.c
+LOCAL_LIBRARIES += \
+	libmedia-buffers-memory-memfd \
+	libmedia-buffers-shm-frame-queue
+endif
+endif
+
 include $(BUILD_EXECUTABLE)
 
 endif
@@ -28,6 +28,7 @@
 #define _MBUF_MEM_GENERIC_H_
 
 #include <media-buffers/mbuf_mem.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -38,8 +39,26 @@ extern MBUF_API const uint64_t mbuf_mem_generic_cookie;
 
 extern MBUF_API const uint64_t mbuf_mem_generic_wrap_cookie;
 
+extern MBUF_API const uint64_t mbuf_mem_generic_slab_cookie;
+
 extern MBUF_API struct mbuf_mem_implem *mbuf_mem_generic_impl;
 
+
+/**
+ * Slab memory implementation attributes
+ */
+struct mbuf_generic_slab_attr {
+	/* Size of each memory */
+	size_t mem_size;
+	/* Maximum number of memories */
+	size_t mem_count;
+	/* Alignment of each memory, must be a power of two (0 for the default
+	 * alignment, which is the cache line size) */
+	size_t align;
+	/* Use huge pages for the slab if available */
+	bool huge_pages;
+};
+
 /**
  * Release function prototype for mbuf_mem_generic_wrap().
  *
@@ -54,6 +73,62 @@ typedef void (*mbuf_mem_generic_wrap_release_t)(void *data,
 						void *userdata);
 
 
+/**
+ * Get an aligned mbuf_mem_implem structure.
+ *
+ * The memories of this implementation are allocated with the given alignment,
+ * and followed by pad bytes (set to zero) which are not part of the memory
+ * capacity. The padding allows reading past the end of a buffer, e.g. for SIMD
+ * processing of the last bytes.
+ *
+ * The returned implem must be released by calling
+ * mbuf_mem_generic_release_implem() after all memories have been released.
+ *
+ * @param align: Alignment of the memories, must be a power of two.
+ * @param pad: Size of the padding after each memory, can be 0.
+ * @return The memory implementation structure, or NULL on error.
+ */
+MBUF_API struct mbuf_mem_implem *
+mbuf_mem_generic_get_aligned_implem(size_t align, size_t pad);
+
+
+/**
+ * Get a slab mbuf_mem_implem structure for the given attributes.
+ *
+ * All the memories of this implementation are carved from a single anonymous
+ * mapping reserved by this call, instead of being allocated one by one. When
+ * huge_pages is set, the mapping uses explicit huge pages (MAP_HUGETLB) if some
+ * are available, and falls back to transparent huge pages otherwise.
+ *
+ * The implementation can provide at most attrs->mem_count memories of at most
+ * attrs->mem_size bytes; it is intended to be given to mbuf_pool_new() with
+ * the same mem_size and a mem_count lower or equal to attrs->mem_count.
+ *
+ * The returned implem must be released by calling
+ * mbuf_mem_generic_release_implem() after all memories have been released.
+ *
+ * @param attrs: Slab attributes (see mbuf_generic_slab_attr doc)
+ * @return The memory implementation structure, or NULL on error.
+ */
+MBUF_API struct mbuf_mem_implem *
+mbuf_mem_generic_get_slab_implem(const struct mbuf_generic_slab_attr *attrs);
+
+
+/**
+ * Release a mbuf_mem_implem structure.
+ *
+ * The implem must no longer be used after this call.
+ *
+ * @warning This call only works on implementations returned by
+ * mbuf_mem_generic_get_aligned_implem(), mbuf_mem_generic_get_slab_implem(),
+ * or a NULL pointer. Calling this function
+ * with another implementation will cause undefined behavior.
+ *
+ * @param implem: The implem to release.
+ */
+MBUF_API void mbuf_mem_generic_release_implem(struct mbuf_mem_implem *implem);
+
+
 /**
  * Create a new mbuf_mem from an internally malloc'd buffer.
  *
@@ -67,6 +142,25 @@ typedef void (*mbuf_mem_generic_wrap_release_t)(void *data,
  */
 MBUF_API int mbuf_mem_generic_new(size_t capacity, struct mbuf_mem **ret_obj);
 
+/**
+ * Create a new mbuf_mem from an internally allocated aligned buffer.
+ *
+ * The returned memory does not belong to any pool, it is created by this call,
+ * and destroyed when released.
+ *
+ * @param capacity: The required capacity of the memory object.
+ * @param align: Alignment of the memory, must be a power of two.
+ * @param pad: Size of the zeroed padding after the memory, can be 0.
+ * @param ret_obj: [out] Pointer to the memory.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_mem_generic_new_aligned(size_t capacity,
+					  size_t align,
+					  size_t pad,
+					  struct mbuf_mem **ret_obj);
+
+
 /**
  * Wrap an existing buffer into a mbuf_mem object.
  *
@@ -27,9 +27,14 @@
 #include <media-buffers/mbuf_mem_generic.h>
 
 #include "mbuf_mem_internal.h"
+#include "mbuf_mem_slots.h"
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #define ULOG_TAG mbuf_mem_generic
 #include <ulog.h>
@@ -71,6 +76,305 @@ static struct mbuf_mem_implem impl = {
 struct mbuf_mem_implem *mbuf_mem_generic_impl = &impl;
 
 
+/* Generic "aligned" implementation, based on posix_memalign/free */
+
+
+/* Aligned implementation implem specific */
+struct impl_aligned_specific {
+	size_t align;
+	size_t pad;
+};
+
+
+static int aligned_alloc_buffer(size_t size,
+				size_t align,
+				size_t pad,
+				void **ret_data)
+{
+	int ret;
+	void *data;
+
+	if (size > SIZE_MAX - pad)
+		return -EOVERFLOW;
+
+	/* posix_memalign requires a multiple of sizeof(void *) */
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+
+	ret = posix_memalign(&data, align, size + pad);
+	if (ret != 0)
+		return -ret;
+
+	/* Clear the padding so that reads past the end of the buffer (e.g.
+	 * SIMD overreads) are deterministic */
+	if (pad != 0)
+		memset((uint8_t *)data + size, 0, pad);
+
+	*ret_data = data;
+	return 0;
+}
+
+
+static int gen_aligned_alloc(struct mbuf_mem *mem, void *specific)
+{
+	struct impl_aligned_specific *impl_specific = specific;
+	int ret;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!impl_specific, EINVAL);
+
+	ret = aligned_alloc_buffer(mem->size,
+				   impl_specific->align,
+				   impl_specific->pad,
+				   &mem->data);
+	if (ret != 0)
+		return ret;
+	mem->cookie = mbuf_mem_generic_cookie;
+	return 0;
+}
+
+
+struct mbuf_mem_implem *mbuf_mem_generic_get_aligned_implem(size_t align,
+							     size_t pad)
+{
+	struct impl_aligned_specific *impl_specific = NULL;
+	struct mbuf_mem_implem *implem = NULL;
+
+	ULOG_ERRNO_RETURN_VAL_IF(align == 0, EINVAL, NULL);
+	ULOG_ERRNO_RETURN_VAL_IF((align & (align - 1)) != 0, EINVAL, NULL);
+
+	impl_specific = calloc(1, sizeof(*impl_specific));
+	if (!impl_specific) {
+		ULOG_ERRNO("calloc", ENOMEM);
+		return NULL;
+	}
+	impl_specific->align = align;
+	impl_specific->pad = pad;
+
+	implem = calloc(1, sizeof(*implem));
+	if (!implem) {
+		ULOG_ERRNO("calloc", ENOMEM);
+		free(impl_specific);
+		return NULL;
+	}
+	implem->alloc = gen_aligned_alloc;
+	implem->free = gen_free;
+	implem->specific = impl_specific;
+
+	return implem;
+}
+
+
+/* Generic "slab" implementation, all memories are carved from a single
+ * anonymous mapping */
+
+
+/* Cookie is 'genslab ' in ascii coding */
+const uint64_t mbuf_mem_generic_slab_cookie = UINT64_C(0x67656e736c616220);
+
+
+/* Default alignment of the slab memories (cache line size) */
+#define SLAB_DEFAULT_ALIGN 64
+
+
+/* Huge page size used to round the mapping size */
+#define SLAB_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+
+/* Slab implementation implem specific */
+struct impl_slab_specific {
+	void *base_addr;
+	size_t map_size;
+	size_t mem_size;
+	size_t mem_count;
+	size_t stride;
+	struct mbuf_mem_slots slots;
+};
+
+
+static int slab_alloc(struct mbuf_mem *mem, void *specific)
+{
+	struct impl_slab_specific *impl_specific = specific;
+	size_t index;
+	int ret;
+
+	ULOG_ERRNO_RETURN_ERR_IF(mem->data, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!impl_specific, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(mem->size > impl_specific->mem_size, EINVAL);
+
+	ret = mbuf_mem_slots_take(&impl_specific->slots, &index);
+	if (ret != 0)
+		return ret;
+
+	mem->data = (uint8_t *)impl_specific->base_addr +
+		    index * impl_specific->stride;
+	mem->cookie = mbuf_mem_generic_slab_cookie;
+
+	return 0;
+}
+
+
+static void slab_free(struct mbuf_mem *mem, void *specific)
+{
+	struct impl_slab_specific *impl_specific = specific;
+	size_t index;
+
+	ULOG_ERRNO_RETURN_IF(mem->cookie != mbuf_mem_generic_slab_cookie,
+			     EINVAL);
+	ULOG_ERRNO_RETURN_IF(!impl_specific, EINVAL);
+
+	index = ((uint8_t *)mem->data - (uint8_t *)impl_specific->base_addr) /
+		impl_specific->stride;
+
+	mbuf_mem_slots_release(&impl_specific->slots, index);
+
+	mem->data = NULL;
+}
+
+
+static void *slab_map(size_t size, bool huge_pages, size_t *ret_size)
+{
+	void *addr;
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	if (page_size <= 0)
+		page_size = 4096;
+
+	if (huge_pages) {
+		size_t huge_size = (size + SLAB_HUGE_PAGE_SIZE - 1) &
+				   ~((size_t)SLAB_HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+		/* Try explicit huge pages first, this fails if no huge pages
+		 * are reserved on the system */
+		addr = mmap(NULL,
+			    huge_size,
+			    PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+			    -1,
+			    0);
+		if (addr != MAP_FAILED) {
+			*ret_size = huge_size;
+			return addr;
+		}
+#endif /* MAP_HUGETLB */
+		size = huge_size;
+	} else {
+		size = (size + page_size - 1) & ~((size_t)page_size - 1);
+	}
+
+	addr = mmap(NULL,
+		    size,
+		    PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS,
+		    -1,
+		    0);
+	if (addr == MAP_FAILED) {
+		ULOG_ERRNO("mmap", errno);
+		return NULL;
+	}
+
+#ifdef MADV_HUGEPAGE
+	/* Fallback to transparent huge pages, if available */
+	if (huge_pages && madvise(addr, size, MADV_HUGEPAGE) < 0)
+		ULOGD("madvise(MADV_HUGEPAGE): err=%d(%s)",
+		      errno,
+		      strerror(errno));
+#endif /* MADV_HUGEPAGE */
+
+	*ret_size = size;
+	return addr;
+}
+
+
+struct mbuf_mem_implem *
+mbuf_mem_generic_get_slab_implem(const struct mbuf_generic_slab_attr *attrs)
+{
+	struct impl_slab_specific *impl_specific = NULL;
+	struct mbuf_mem_implem *implem = NULL;
+	size_t align;
+
+	ULOG_ERRNO_RETURN_VAL_IF(!attrs, EINVAL, NULL);
+	ULOG_ERRNO_RETURN_VAL_IF(attrs->mem_size == 0, EINVAL, NULL);
+	ULOG_ERRNO_RETURN_VAL_IF(attrs->mem_count == 0, EINVAL, NULL);
+	align = attrs->align != 0 ? attrs->align : SLAB_DEFAULT_ALIGN;
+	ULOG_ERRNO_RETURN_VAL_IF((align & (align - 1)) != 0, EINVAL, NULL);
+
+	impl_specific = calloc(1, sizeof(*impl_specific));
+	if (!impl_specific) {
+		ULOG_ERRNO("calloc", ENOMEM);
+		goto error;
+	}
+	impl_specific->mem_size = attrs->mem_size;
+	impl_specific->mem_count = attrs->mem_count;
+	impl_specific->stride = (attrs->mem_size + align - 1) & ~(align - 1);
+	if (impl_specific->stride > SIZE_MAX / attrs->mem_count) {
+		ULOG_ERRNO("slab size", EOVERFLOW);
+		goto error;
+	}
+
+	if (mbuf_mem_slots_init(&impl_specific->slots,
+				impl_specific->mem_count) < 0) {
+		ULOG_ERRNO("mbuf_mem_slots_init", ENOMEM);
+		goto error;
+	}
+
+	impl_specific->base_addr =
+		slab_map(impl_specific->stride * impl_specific->mem_count,
+			 attrs->huge_pages,
+			 &impl_specific->map_size);
+	if (!impl_specific->base_addr)
+		goto error;
+
+	implem = calloc(1, sizeof(*implem));
+	if (!implem) {
+		ULOG_ERRNO("calloc", ENOMEM);
+		goto error;
+	}
+	implem->alloc = slab_alloc;
+	implem->free = slab_free;
+	implem->specific = impl_specific;
+
+	return implem;
+
+error:
+	if (impl_specific) {
+		if (impl_specific->base_addr)
+			munmap(impl_specific->base_addr,
+			       impl_specific->map_size);
+		mbuf_mem_slots_deinit(&impl_specific->slots);
+	}
+	free(impl_specific);
+	return NULL;
+}
+
+
+void mbuf_mem_generic_release_implem(struct mbuf_mem_implem *implem)
+{
+	if (!implem)
+		return;
+
+	struct impl_slab_specific *impl_specific = implem->specific;
+
+	/* Aligned implem */
+	if (implem->alloc != slab_alloc)
+		goto out;
+
+	if (impl_specific != NULL) {
+		size_t used = mbuf_mem_slots_used(&impl_specific->slots);
+		if (used != 0)
+			ULOGW("releasing slab implem with %zu memories in use",
+			      used);
+		if (munmap(impl_specific->base_addr, impl_specific->map_size) <
+		    0)
+			ULOG_ERRNO("munmap", errno);
+		mbuf_mem_slots_deinit(&impl_specific->slots);
+	}
+
+out:
+	free(implem->specific);
+	free(implem);
+}
+
+
 /* Generic "wrapper" implementation, based on existing pointer and a release
  * callback */
 
@@ -126,6 +430,34 @@ int mbuf_mem_generic_new(size_t capacity, struct mbuf_mem **ret_obj)
 }
 
 
+int mbuf_mem_generic_new_aligned(size_t capacity,
+				 size_t align,
+				 size_t pad,
+				 struct mbuf_mem **ret_obj)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!ret_obj, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(capacity == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(align == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((align & (align - 1)) != 0, EINVAL);
+
+	int ret;
+	void *buffer;
+
+	ret = aligned_alloc_buffer(capacity, align, pad, &buffer);
+	if (ret != 0)
+		return ret;
+
+	ret = mbuf_mem_generic_wrap(buffer,
+				    capacity,
+				    mbuf_mem_generic_releaser_free,
+				    NULL,
+				    ret_obj);
+	if (ret != 0)
+		free(buffer);
+	return ret;
+}
+
+
 int mbuf_mem_generic_wrap(void *data,
 			  size_t len,
 			  mbuf_mem_generic_wrap_release_t release,
@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) 2026 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MBUF_MEM_MEMFD_H_
+#define _MBUF_MEM_MEMFD_H_
+
+#include <media-buffers/mbuf_mem.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+extern MBUF_API const uint64_t mbuf_mem_memfd_cookie;
+
+
+/**
+ * Memory implementation attributes
+ */
+struct mbuf_memfd_attr {
+	/* Name of the memfd (only used for debugging purposes, does not need
+	 * to be unique), can be NULL */
+	const char *name;
+	/* Size of each memory */
+	size_t mem_size;
+	/* Maximum number of memories */
+	size_t mem_count;
+};
+
+
+/**
+ * Get a mbuf_mem_implem structure for the given attributes.
+ *
+ * All the memories of this implementation are allocated in a single anonymous
+ * file created with memfd_create(). The file is sealed against resizing, and
+ * is automatically destroyed when the implem is released and all processes
+ * which received its file descriptor have closed it. Each memory starts on a
+ * page boundary in the file, so it can be mapped independently.
+ *
+ * The returned implem must be released by calling
+ * mbuf_mem_memfd_release_implem() after all memories have been released.
+ *
+ * @note The attrs argument is copied internally and does not need to stay valid
+ * until mbuf_mem_memfd_release_implem() is called.
+ *
+ * @param attrs: memfd heap attributes (see mbuf_memfd_attr doc)
+ * @return The memory implementation structure, or NULL on error.
+ */
+MBUF_API struct mbuf_mem_implem *
+mbuf_mem_memfd_get_implem(const struct mbuf_memfd_attr *attrs);
+
+
+/**
+ * Release a mbuf_mem_implem structure.
+ *
+ * The implem must no longer be used after this call.
+ *
+ * @warning This call only works on implementations returned by
+ * mbuf_mem_memfd_get_implem(), or a NULL pointer. Calling this function with
+ * another implementation will cause undefined behavior.
+ *
+ * @param implem: The implem to release.
+ */
+MBUF_API void mbuf_mem_memfd_release_implem(struct mbuf_mem_implem *implem);
+
+
+/**
+ * Get the file descriptor and offset of a mbuf_mem object.
+ *
+ * The file descriptor is owned by the implementation, and must not be closed by
+ * the caller. It can be sent to another process (e.g. with SCM_RIGHTS over a
+ * unix socket), which can then map the memory with mbuf_mem_memfd_map().
+ *
+ * @note this function checks the memory is effectively allocated with this
+ * implementation.
+ *
+ * @param mem: The memory to use.
+ * @param fd: [out] The file descriptor of the memory.
+ * @param offset: [out] The offset of the memory in the file, optional.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int
+mbuf_mem_memfd_get_fd(struct mbuf_mem *mem, int *fd, size_t *offset);
+
+
+/**
+ * Get the file descriptor and offset from a mbuf_mem_info object.
+ *
+ * @note this function checks the memory is effectively allocated with this
+ * implementation.
+ *
+ * @param info: The memory info to use.
+ * @param fd: [out] The file descriptor of the memory.
+ * @param offset: [out] The offset of the memory in the file, optional.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_mem_memfd_get_fd_from_info(struct mbuf_mem_info *info,
+					     int *fd,
+					     size_t *offset);
+
+
+/**
+ * Map a memory from a file descriptor.
+ *
+ * This function is intended to be used by a process which received the file
+ * descriptor of a memory from another process. The returned memory does not
+ * belong to any pool, and is unmapped when released. The file descriptor is
+ * not kept by the memory, and can be closed by the caller after this call.
+ *
+ * @param fd: The file descriptor to map.
+ * @param offset: The offset of the memory in the file, must be a multiple of
+ *                the page size.
+ * @param size: The size of the memory.
+ * @param writable: true to map the memory read-write, false to map it
+ *                  read-only.
+ * @param ret_obj: [out] Pointer to the memory.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_mem_memfd_map(int fd,
+				size_t offset,
+				size_t size,
+				bool writable,
+				struct mbuf_mem **ret_obj);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* _MBUF_MEM_MEMFD_H_ */
@@ -0,0 +1,357 @@
+/**
+ * Copyright (c) 2026 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <media-buffers/mbuf_mem_memfd.h>
+
+#include "mbuf_mem_internal.h"
+#include "mbuf_mem_slots.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+#define ULOG_TAG mbuf_mem_memfd
+#include <ulog.h>
+ULOG_DECLARE_TAG(ULOG_TAG);
+
+
+/* memfd implementation memory specific */
+struct mem_memfd_specific {
+	/* File descriptor of the memory (-1 for mapped memories) */
+	int fd;
+	/* Offset of the memory in the file */
+	size_t offset;
+	/* Size of the mapping (only for mapped memories) */
+	size_t map_size;
+};
+
+
+/* memfd implementation implem specific */
+struct impl_memfd_specific {
+	int fd;
+	void *base_addr;
+	size_t map_size;
+	size_t mem_size;
+	size_t mem_count;
+	/* Distance between two memories in the file (page aligned) */
+	size_t stride;
+	struct mbuf_mem_slots slots;
+};
+
+
+/* Cookie is 'memfd' in ascii coding */
+const uint64_t mbuf_mem_memfd_cookie = UINT64_C(0x6d656d6664);
+
+
+/* Cookie is 'memfdmap' in ascii coding */
+static const uint64_t mbuf_mem_memfd_map_cookie =
+	UINT64_C(0x6d656d66646d6170);
+
+
+static size_t mbuf_memfd_page_align(size_t size)
+{
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+	return (size + page_size - 1) & ~(page_size - 1);
+}
+
+
+static void mbuf_memfd_destroy(struct impl_memfd_specific *impl_specific)
+{
+	int err;
+
+	if (!impl_specific)
+		return;
+
+	if (impl_specific->base_addr != MAP_FAILED) {
+		err = munmap(impl_specific->base_addr, impl_specific->map_size);
+		if (err == -1)
+			ULOG_ERRNO("munmap", errno);
+	}
+	if (impl_specific->fd >= 0)
+		close(impl_specific->fd);
+	mbuf_mem_slots_deinit(&impl_specific->slots);
+	free(impl_specific);
+}
+
+
+static int mbuf_mem_memfd_alloc(struct mbuf_mem *mem, void *specific)
+{
+	struct impl_memfd_specific *impl_specific = specific;
+	struct mem_memfd_specific *memfd_mem = NULL;
+	size_t index;
+	int ret;
+
+	ULOG_ERRNO_RETURN_ERR_IF(mem->specific, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(mem->data, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!impl_specific, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(mem->size > impl_specific->mem_size, EINVAL);
+
+	memfd_mem = calloc(1, sizeof(*memfd_mem));
+	if (!memfd_mem)
+		return -ENOMEM;
+
+	ret = mbuf_mem_slots_take(&impl_specific->slots, &index);
+	if (ret != 0) {
+		free(memfd_mem);
+		return ret;
+	}
+
+	memfd_mem->fd = impl_specific->fd;
+	memfd_mem->offset = index * impl_specific->stride;
+
+	mem->data = (uint8_t *)impl_specific->base_addr + memfd_mem->offset;
+	mem->size = impl_specific->mem_size;
+	mem->cookie = mbuf_mem_memfd_cookie;
+	mem->specific = memfd_mem;
+
+	return 0;
+}
+
+
+static void mbuf_mem_memfd_free(struct mbuf_mem *mem, void *specific)
+{
+	struct mem_memfd_specific *memfd_mem = mem->specific;
+	struct impl_memfd_specific *impl_specific = specific;
+
+	ULOG_ERRNO_RETURN_IF(mem->cookie != mbuf_mem_memfd_cookie, EINVAL);
+	ULOG_ERRNO_RETURN_IF(!memfd_mem, EINVAL);
+	ULOG_ERRNO_RETURN_IF(!impl_specific, EINVAL);
+
+	/* Mark slot as unused */
+	mbuf_mem_slots_release(&impl_specific->slots,
+			       memfd_mem->offset / impl_specific->stride);
+
+	mem->specific = NULL;
+	mem->data = NULL;
+
+	free(memfd_mem);
+}
+
+
+struct mbuf_mem_implem *
+mbuf_mem_memfd_get_implem(const struct mbuf_memfd_attr *attrs)
+{
+	int ret;
+	struct impl_memfd_specific *impl_specific = NULL;
+	struct mbuf_mem_implem *impl = NULL;
+
+	ULOG_ERRNO_RETURN_VAL_IF(!attrs, EINVAL, NULL);
+	ULOG_ERRNO_RETURN_VAL_IF(
+		attrs->mem_size * attrs->mem_count == 0, EINVAL, NULL);
+
+	impl_specific = calloc(1, sizeof(*impl_specific));
+	if (!impl_specific) {
+		ULOG_ERRNO("calloc", ENOMEM);
+		return NULL;
+	}
+	impl_specific->fd = -1;
+	impl_specific->base_addr = MAP_FAILED;
+	impl_specific->mem_size = attrs->mem_size;
+	impl_specific->mem_count = attrs->mem_count;
+	impl_specific->stride = mbuf_memfd_page_align(attrs->mem_size);
+	impl_specific->map_size =
+		impl_specific->stride * impl_specific->mem_count;
+
+	if (mbuf_mem_slots_init(&impl_specific->slots,
+				impl_specific->mem_count) < 0) {
+		ULOG_ERRNO("mbuf_mem_slots_init", ENOMEM);
+		goto error;
+	}
+
+	impl_specific->fd =
+		memfd_create(attrs->name ? attrs->name : "mbuf_memfd",
+			     MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (impl_specific->fd < 0) {
+		ULOG_ERRNO("memfd_create", errno);
+		goto error;
+	}
+
+	ret = ftruncate(impl_specific->fd, impl_specific->map_size);
+	if (ret < 0) {
+		ULOG_ERRNO("ftruncate", errno);
+		goto error;
+	}
+
+	/* Prevent the receivers of the fd from resizing the file */
+	ret = fcntl(impl_specific->fd,
+		    F_ADD_SEALS,
+		    F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+	if (ret < 0) {
+		ULOG_ERRNO("fcntl(F_ADD_SEALS)", errno);
+		goto error;
+	}
+
+	impl_specific->base_addr = mmap(NULL,
+					impl_specific->map_size,
+					PROT_READ | PROT_WRITE,
+					MAP_SHARED,
+					impl_specific->fd,
+					0);
+	if (impl_specific->base_addr == MAP_FAILED) {
+		ULOG_ERRNO("mmap", errno);
+		goto error;
+	}
+
+	impl = calloc(1, sizeof(*impl));
+	if (!impl) {
+		ULOG_ERRNO("calloc", ENOMEM);
+		goto error;
+	}
+	impl->alloc = mbuf_mem_memfd_alloc;
+	impl->free = mbuf_mem_memfd_free;
+	impl->specific = impl_specific;
+
+	return impl;
+
+error:
+	mbuf_memfd_destroy(impl_specific);
+	return NULL;
+}
+
+
+void mbuf_mem_memfd_release_implem(struct mbuf_mem_implem *implem)
+{
+	if (!implem)
+		return;
+
+	mbuf_memfd_destroy(implem->specific);
+	free(implem);
+}
+
+
+int mbuf_mem_memfd_get_fd(struct mbuf_mem *mem, int *fd, size_t *offset)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!mem, EINVAL);
+
+	struct mbuf_mem_info info = {
+		.cookie = mem->cookie,
+		.specific = mem->specific,
+	};
+
+	return mbuf_mem_memfd_get_fd_from_info(&info, fd, offset);
+}
+
+
+int mbuf_mem_memfd_get_fd_from_info(struct mbuf_mem_info *info,
+				    int *fd,
+				    size_t *offset)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!info, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!info->specific, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(info->cookie != mbuf_mem_memfd_cookie, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!fd, EINVAL);
+
+	struct mem_memfd_specific *memfd_mem = info->specific;
+
+	*fd = memfd_mem->fd;
+	if (offset)
+		*offset = memfd_mem->offset;
+
+	return 0;
+}
+
+
+static void mbuf_mem_memfd_unmap(struct mbuf_mem *mem, void *specific)
+{
+	struct mem_memfd_specific *memfd_mem = mem->specific;
+	int err;
+
+	ULOG_ERRNO_RETURN_IF(mem->cookie != mbuf_mem_memfd_map_cookie, EINVAL);
+	ULOG_ERRNO_RETURN_IF(!memfd_mem, EINVAL);
+
+	err = munmap(mem->data, memfd_mem->map_size);
+	if (err == -1)
+		ULOG_ERRNO("munmap", errno);
+
+	mem->specific = NULL;
+	mem->data = NULL;
+
+	free(memfd_mem);
+}
+
+
+static struct mbuf_mem_implem map_impl = {
+	.free = mbuf_mem_memfd_unmap,
+};
+
+
+int mbuf_mem_memfd_map(int fd,
+		       size_t offset,
+		       size_t size,
+		       bool writable,
+		       struct mbuf_mem **ret_obj)
+{
+	int ret;
+	struct mem_memfd_specific *memfd_mem;
+	struct mbuf_mem *mem;
+	void *data;
+
+	ULOG_ERRNO_RETURN_ERR_IF(fd < 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(size == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(offset != mbuf_memfd_page_align(offset),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!ret_obj, EINVAL);
+
+	mem = calloc(1, sizeof(*mem));
+	if (!mem)
+		return -ENOMEM;
+	memfd_mem = calloc(1, sizeof(*memfd_mem));
+	if (!memfd_mem) {
+		free(mem);
+		return -ENOMEM;
+	}
+	memfd_mem->fd = -1;
+	memfd_mem->offset = offset;
+	memfd_mem->map_size = mbuf_memfd_page_align(size);
+
+	data = mmap(NULL,
+		    memfd_mem->map_size,
+		    writable ? PROT_READ | PROT_WRITE : PROT_READ,
+		    MAP_SHARED,
+		    fd,
+		    offset);
+	if (data == MAP_FAILED) {
+		ret = -errno;
+		ULOG_ERRNO("mmap", -ret);
+		free(memfd_mem);
+		free(mem);
+		return ret;
+	}
+
+	atomic_init(&mem->refcount, 1);
+	mem->cookie = mbuf_mem_memfd_map_cookie;
+	mem->implem = &map_impl;
+	mem->specific = memfd_mem;
+	mem->data = data;
+	mem->size = size;
+
+	*ret_obj = mem;
+	return 0;
+}
@@ -28,6 +28,7 @@
 #define _MBUF_MEM_SHM_H_
 
 #include <media-buffers/mbuf_mem.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +38,10 @@ extern "C" {
 extern MBUF_API const uint64_t mbuf_mem_shm_cookie;
 
 
+/* Forward declarations */
+struct mbuf_shm_consumer;
+
+
 /**
  * Memory implementation attributes
  */
@@ -50,6 +55,19 @@ struct mbuf_shm_attr {
 };
 
 
+/**
+ * Memory implementation slot occupancy statistics
+ */
+struct mbuf_shm_stats {
+	/* Number of slots in the shared memory */
+	size_t mem_count;
+	/* Number of slots currently in use */
+	size_t used_count;
+	/* Maximum number of slots used at the same time */
+	size_t peak_used_count;
+};
+
+
 /**
  * Get a mbuf_mem_implem structure for the given attributes.
  *
@@ -80,6 +98,21 @@ mbuf_mem_shm_get_implem(const struct mbuf_shm_attr *attrs);
 MBUF_API void mbuf_mem_shm_release_implem(struct mbuf_mem_implem *implem);
 
 
+/**
+ * Get the slot occupancy statistics of a SHM implementation.
+ *
+ * @warning This call only works on implementations returned by
+ * mbuf_mem_shm_get_implem().
+ *
+ * @param implem: The implem to use.
+ * @param stats: [out] The implem statistics.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_mem_shm_get_stats(struct mbuf_mem_implem *implem,
+				    struct mbuf_shm_stats *stats);
+
+
 /**
  * Get the SHM handle / index from a mbuf_mem object.
  *
@@ -106,6 +139,99 @@ MBUF_API int mbuf_mem_shm_get_index(struct mbuf_mem *mem);
 MBUF_API int mbuf_mem_shm_get_index_from_info(struct mbuf_mem_info *info);
 
 
+/**
+ * Share a SHM memory with a consumer process.
+ *
+ * This function adds a share of the memory in the shared control block of the
+ * SHM. This share is handed over to the consumer process, which will adopt it
+ * by calling mbuf_mem_shm_consumer_get_mem() with the memory index, and release
+ * it by unreferencing the returned memory. Each share can only be adopted once.
+ * As long as a memory is shared, it will not be returned by mbuf_pool_get() in
+ * the producer process, even if the producer no longer holds any reference on
+ * it.
+ *
+ * This function must be called once per consumer, while still holding a
+ * reference on the memory, before sending its index to the consumer.
+ *
+ * @param mem: The memory to share.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_mem_shm_share(struct mbuf_mem *mem);
+
+
+/**
+ * Release the shares held by consumers which no longer exist.
+ *
+ * The shares adopted by consumer processes which exited (or crashed) without
+ * releasing their memories are released. If no consumer is attached anymore,
+ * the shares which were not adopted yet are released too. This function should
+ * be called by the producer when it detects the loss of a consumer.
+ *
+ * @warning This call only works on implementations returned by
+ * mbuf_mem_shm_get_implem().
+ *
+ * @param implem: The implem to use.
+ *
+ * @return the number of released shares, negative errno on error.
+ */
+MBUF_API int mbuf_mem_shm_reclaim(struct mbuf_mem_implem *implem);
+
+
+/**
+ * Attach to an existing SHM as a consumer.
+ *
+ * The SHM must have been created by another process (the producer) with
+ * mbuf_mem_shm_get_implem(), using the same attributes. At most 8 consumers can
+ * be attached to a SHM at the same time.
+ *
+ * @param attrs: SHM heap attributes (same as the producer attributes).
+ * @param writable: true to map the memories read-write, false to map them
+ *                  read-only. In read-only mode, writing into the memories
+ *                  will cause a crash.
+ * @param ret_obj: [out] Pointer to the consumer.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_mem_shm_consumer_attach(const struct mbuf_shm_attr *attrs,
+					  bool writable,
+					  struct mbuf_shm_consumer **ret_obj);
+
+
+/**
+ * Detach from a SHM.
+ *
+ * All the memories obtained from the consumer must have been released before
+ * calling this function.
+ *
+ * @param consumer: The consumer to detach.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_mem_shm_consumer_detach(struct mbuf_shm_consumer *consumer);
+
+
+/**
+ * Get a memory of the SHM from its index.
+ *
+ * The returned memory adopts one share given by the producer with
+ * mbuf_mem_shm_share(). It does not belong to any pool, and when it is
+ * released, the share is released, allowing the producer to reuse the memory
+ * once all its shares are released. If the memory has no share left to adopt,
+ * this function fails with -ENOENT.
+ *
+ * @param consumer: The consumer to use.
+ * @param index: The index (SHM handle) of the memory, as returned by
+ *               mbuf_mem_shm_get_index() in the producer process.
+ * @param ret_obj: [out] Pointer to the memory.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_mem_shm_consumer_get_mem(struct mbuf_shm_consumer *consumer,
+					   int index,
+					   struct mbuf_mem **ret_obj);
+
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,277 @@
+/**
+ * Copyright (c) 2026 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MBUF_SHM_FRAME_QUEUE_H_
+#define _MBUF_SHM_FRAME_QUEUE_H_
+
+#include <media-buffers/mbuf_audio_frame.h>
+#include <media-buffers/mbuf_coded_video_frame.h>
+#include <media-buffers/mbuf_mem_shm.h>
+#include <media-buffers/mbuf_raw_video_frame.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/* Forward declarations */
+struct mbuf_shm_frame_queue;
+
+
+/**
+ * Type of the frames in a SHM frame queue
+ */
+enum mbuf_shm_frame_type {
+	/* Unknown frame type */
+	MBUF_SHM_FRAME_TYPE_UNKNOWN = 0,
+	/* Raw video frame */
+	MBUF_SHM_FRAME_TYPE_RAW_VIDEO,
+	/* Coded video frame */
+	MBUF_SHM_FRAME_TYPE_CODED_VIDEO,
+	/* Audio frame */
+	MBUF_SHM_FRAME_TYPE_AUDIO,
+};
+
+
+/**
+ * SHM frame queue attributes
+ */
+struct mbuf_shm_frame_queue_attr {
+	/* Address of the queue shared memory */
+	const char *addr;
+	/* Number of frames slots in the queue */
+	size_t slot_count;
+	/* Maximum number of memory chunks (planes, NALUs or buffer) per
+	 * frame, 0 for the default value (16) */
+	size_t max_chunk_count;
+	/* Maximum size of the serialized frame metadata, 0 for the default
+	 * value (1024 bytes) */
+	size_t max_meta_size;
+};
+
+
+/**
+ * Create a SHM frame queue (producer side).
+ *
+ * The SHM frame queue allows passing frames to another process without copying
+ * their content: the queue is a ring of fixed-size slots in a shared memory,
+ * holding the frame info, the references (SHM index, offset and length) of the
+ * frame memory chunks, and the serialized frame metadata. All the memories of
+ * the frames pushed in the queue must belong to a SHM memory implementation
+ * (see mbuf_mem_shm_get_implem()).
+ *
+ * The queue has a single producer and a single consumer.
+ *
+ * @note Ancillary data are not transmitted through the queue.
+ *
+ * @param attrs: Queue attributes (see mbuf_shm_frame_queue_attr doc).
+ * @param ret_obj: [out] Pointer to the queue.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int
+mbuf_shm_frame_queue_new(const struct mbuf_shm_frame_queue_attr *attrs,
+			 struct mbuf_shm_frame_queue **ret_obj);
+
+
+/**
+ * Attach to an existing SHM frame queue (consumer side).
+ *
+ * The event file descriptor is the one returned by
+ * mbuf_shm_frame_queue_get_fd() in the producer process, received e.g. through
+ * a unix socket (SCM_RIGHTS). It is duplicated internally, and can be closed by
+ * the caller after this call.
+ *
+ * @param attrs: Queue attributes (same as the producer attributes).
+ * @param consumer: The SHM consumer of the heap holding the frames memories.
+ *                  It must stay attached until the queue is destroyed.
+ * @param fd: The event file descriptor of the queue.
+ * @param ret_obj: [out] Pointer to the queue.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int
+mbuf_shm_frame_queue_attach(const struct mbuf_shm_frame_queue_attr *attrs,
+			    struct mbuf_shm_consumer *consumer,
+			    int fd,
+			    struct mbuf_shm_frame_queue **ret_obj);
+
+
+/**
+ * Get the event file descriptor of the queue.
+ *
+ * On the consumer side, the file descriptor becomes readable when the queue is
+ * not empty. It is cleared by the pop functions when the queue becomes empty.
+ * The file descriptor is owned by the queue and must not be closed by the
+ * caller.
+ *
+ * @param queue: The queue.
+ *
+ * @return the file descriptor on success, negative errno on error.
+ */
+MBUF_API int mbuf_shm_frame_queue_get_fd(struct mbuf_shm_frame_queue *queue);
+
+
+/**
+ * Push a raw video frame into the queue (producer side).
+ *
+ * The frame must be finalized. The queue does not keep a reference on the
+ * frame; instead, each memory chunk of the frame is shared with the consumer
+ * process (see mbuf_mem_shm_share()), so that the memories are not reused until
+ * the consumer releases the frame. The frame info, memory chunks and metadata
+ * are sent; the frame ancillary data are not.
+ *
+ * @param queue: The queue.
+ * @param frame: The frame to push.
+ *
+ * @return 0 on success, -EAGAIN if the queue is full, negative errno on error.
+ */
+MBUF_API int
+mbuf_shm_frame_queue_push_raw_video(struct mbuf_shm_frame_queue *queue,
+				    struct mbuf_raw_video_frame *frame);
+
+
+/**
+ * Push a coded video frame into the queue (producer side).
+ *
+ * See mbuf_shm_frame_queue_push_raw_video().
+ *
+ * @param queue: The queue.
+ * @param frame: The frame to push.
+ *
+ * @return 0 on success, -EAGAIN if the queue is full, negative errno on error.
+ */
+MBUF_API int
+mbuf_shm_frame_queue_push_coded_video(struct mbuf_shm_frame_queue *queue,
+				      struct mbuf_coded_video_frame *frame);
+
+
+/**
+ * Push an audio frame into the queue (producer side).
+ *
+ * See mbuf_shm_frame_queue_push_raw_video().
+ *
+ * @param queue: The queue.
+ * @param frame: The frame to push.
+ *
+ * @return 0 on success, -EAGAIN if the queue is full, negative errno on error.
+ */
+MBUF_API int mbuf_shm_frame_queue_push_audio(struct mbuf_shm_frame_queue *queue,
+					     struct mbuf_audio_frame *frame);
+
+
+/**
+ * Get the type of the next frame in the queue (consumer side).
+ *
+ * @param queue: The queue.
+ * @param type: [out] The type of the next frame.
+ *
+ * @return 0 on success, -EAGAIN if the queue is empty, negative errno on error.
+ */
+MBUF_API int mbuf_shm_frame_queue_peek_type(struct mbuf_shm_frame_queue *queue,
+					    enum mbuf_shm_frame_type *type);
+
+
+/**
+ * Pop a raw video frame from the queue (consumer side).
+ *
+ * The returned frame is finalized, and its memories are mapped from the SHM
+ * through the consumer given to mbuf_shm_frame_queue_attach(). The caller must
+ * call mbuf_raw_video_frame_unref() on the frame when no longer needed.
+ *
+ * @param queue: The queue.
+ * @param frame: [out] The frame.
+ *
+ * @return 0 on success, -EAGAIN if the queue is empty, -EPROTO if the next
+ * frame is not a raw video frame, negative errno on error.
+ */
+MBUF_API int
+mbuf_shm_frame_queue_pop_raw_video(struct mbuf_shm_frame_queue *queue,
+				   struct mbuf_raw_video_frame **frame);
+
+
+/**
+ * Pop a coded video frame from the queue (consumer side).
+ *
+ * See mbuf_shm_frame_queue_pop_raw_video().
+ *
+ * @param queue: The queue.
+ * @param frame: [out] The frame.
+ *
+ * @return 0 on success, -EAGAIN if the queue is empty, -EPROTO if the next
+ * frame is not a coded video frame, negative errno on error.
+ */
+MBUF_API int
+mbuf_shm_frame_queue_pop_coded_video(struct mbuf_shm_frame_queue *queue,
+				     struct mbuf_coded_video_frame **frame);
+
+
+/**
+ * Pop an audio frame from the queue (consumer side).
+ *
+ * See mbuf_shm_frame_queue_pop_raw_video().
+ *
+ * @param queue: The queue.
+ * @param frame: [out] The frame.
+ *
+ * @return 0 on success, -EAGAIN if the queue is empty, -EPROTO if the next
+ * frame is not an audio frame, negative errno on error.
+ */
+MBUF_API int mbuf_shm_frame_queue_pop_audio(struct mbuf_shm_frame_queue *queue,
+					    struct mbuf_audio_frame **frame);
+
+
+/**
+ * Get the number of frames in the queue.
+ *
+ * @param queue: The queue.
+ *
+ * @return the number of frames on success, negative errno on error.
+ */
+MBUF_API int
+mbuf_shm_frame_queue_get_count(struct mbuf_shm_frame_queue *queue);
+
+
+/**
+ * Destroy a SHM frame queue.
+ *
+ * On the consumer side, the frames still in the queue are dropped, and their
+ * memories given back to the producer. On the producer side, the queue shared
+ * memory is unlinked.
+ *
+ * @param queue: The queue.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_shm_frame_queue_destroy(struct mbuf_shm_frame_queue *queue);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* _MBUF_SHM_FRAME_QUEUE_H_ */
@@ -27,9 +27,12 @@
 #include <media-buffers/mbuf_mem_shm.h>
 
 #include "mbuf_mem_internal.h"
+#include "mbuf_mem_shm_internal.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
@@ -43,10 +46,19 @@
 ULOG_DECLARE_TAG(ULOG_TAG);
 
 
-/* SHM implementation memory specific */
-struct mem_shm_specific {
-	/* Index (handle) of the memory in the shared memory */
-	int index;
+/* SHM consumer */
+struct mbuf_shm_consumer {
+	int fd;
+	void *base_addr;
+	size_t data_size;
+	struct shm_control *control;
+	size_t control_size;
+	size_t mem_size;
+	size_t mem_count;
+	/* Entry of the consumer in the control block */
+	int id;
+	/* Number of memories currently obtained from the consumer */
+	atomic_size_t mem_used;
 };
 
 
@@ -55,9 +67,18 @@ struct impl_shm_specific {
 	char *addr;
 	int fd;
 	void *base_addr;
+	size_t map_size;
+	struct shm_control *control;
 	size_t mem_size;
 	size_t mem_count;
-	bool *slots;
+	/* Bitmap of used slots (bits beyond mem_count are always set) */
+	atomic_uint_least64_t *slots;
+	size_t slot_words;
+	/* Index of the bitmap word to start the next search from */
+	atomic_size_t slot_hint;
+	/* Statistics */
+	atomic_size_t used_count;
+	atomic_size_t peak_used_count;
 };
 
 
@@ -68,6 +89,20 @@ const uint64_t mbuf_mem_shm_cookie = UINT64_C(0x73686D);
 static void mbuf_shm_close(const char *addr, void *data, size_t size);
 
 
+static void mbuf_shm_get_sizes(size_t mem_size,
+			       size_t mem_count,
+			       size_t *ret_data_size,
+			       size_t *ret_control_size)
+{
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+	*ret_data_size =
+		(mem_size * mem_count + page_size - 1) & ~(page_size - 1);
+	*ret_control_size = sizeof(struct shm_control) +
+			    mem_count * sizeof(struct shm_mem_refs);
+}
+
+
 static int
 mbuf_shm_open(const char *addr, size_t size, int *ret_fd, void **ret_base_addr)
 {
@@ -87,7 +122,7 @@ mbuf_shm_open(const char *addr, size_t size, int *ret_fd, void **ret_base_addr)
 		goto error;
 	}
 
-	base_addr = mmap(NULL, size, PROT_WRITE, MAP_SHARED, fd, 0);
+	base_addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 	if (base_addr == MAP_FAILED) {
 		ret = -errno;
 		ULOG_ERRNO("mmap", -ret);
@@ -121,6 +156,73 @@ static void mbuf_shm_close(const char *addr, void *data, size_t size)
 }
 
 
+static size_t mbuf_mem_shm_take_slot(struct impl_shm_specific *impl_specific)
+{
+	size_t hint = atomic_load(&impl_specific->slot_hint);
+	size_t used, peak;
+
+	for (size_t i = 0; i < impl_specific->slot_words; i++) {
+		size_t word = (hint + i) % impl_specific->slot_words;
+		atomic_uint_least64_t *slots = &impl_specific->slots[word];
+		uint64_t value = atomic_load(slots);
+		while (~value != 0) {
+			int bit = __builtin_ctzll(~value);
+			if (!atomic_compare_exchange_weak(
+				    slots, &value, value | (UINT64_C(1) << bit)))
+				continue;
+			atomic_store(&impl_specific->slot_hint, word);
+			used = atomic_fetch_add(&impl_specific->used_count, 1) +
+			       1;
+			peak = atomic_load(&impl_specific->peak_used_count);
+			while (peak < used &&
+			       !atomic_compare_exchange_weak(
+				       &impl_specific->peak_used_count,
+				       &peak,
+				       used))
+				;
+			return word * 64 + bit;
+		}
+	}
+
+	return SIZE_MAX;
+}
+
+
+static void mbuf_mem_shm_release_slot(struct impl_shm_specific *impl_specific,
+				      size_t index)
+{
+	atomic_fetch_and(&impl_specific->slots[index / 64],
+			 ~(UINT64_C(1) << (index % 64)));
+	atomic_fetch_sub(&impl_specific->used_count, 1);
+	atomic_store(&impl_specific->slot_hint, index / 64);
+}
+
+
+static int mbuf_mem_shm_pool_get(struct mbuf_mem *mem, void *specific)
+{
+	struct impl_shm_specific *impl_specific = specific;
+	struct mem_shm_specific *shm_mem = mem->specific;
+	struct shm_mem_refs *refs;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!shm_mem, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!impl_specific, EINVAL);
+
+	refs = &impl_specific->control->refs[shm_mem->index];
+
+	/* The memory is still shared with a consumer; the pending shares must
+	 * be checked first, as consumers increment their adopted count before
+	 * decrementing the pending count */
+	if (atomic_load(&refs->pending) != 0)
+		return -EBUSY;
+	for (int i = 0; i < MBUF_SHM_MAX_CONSUMERS; i++) {
+		if (atomic_load(&refs->adopted[i]) != 0)
+			return -EBUSY;
+	}
+
+	return 0;
+}
+
+
 static int mbuf_mem_shm_alloc(struct mbuf_mem *mem, void *specific)
 {
 	struct impl_shm_specific *impl_specific = specific;
@@ -132,26 +234,22 @@ static int mbuf_mem_shm_alloc(struct mbuf_mem *mem, void *specific)
 	ULOG_ERRNO_RETURN_ERR_IF(!impl_specific, EINVAL);
 
 	/* Find a slot */
-	for (size_t i = 0; i < impl_specific->mem_count; i++) {
-		if (impl_specific->slots[i] == false) {
-			index = i;
-			break;
-		}
-	}
+	index = mbuf_mem_shm_take_slot(impl_specific);
 	/* All slots used */
 	if (index == SIZE_MAX)
 		return -ENOMEM;
 
 	shm_mem = calloc(1, sizeof(*shm_mem));
-	if (!shm_mem)
+	if (!shm_mem) {
+		mbuf_mem_shm_release_slot(impl_specific, index);
 		return -ENOMEM;
+	}
 	shm_mem->index = index;
+	shm_mem->control = impl_specific->control;
+	shm_mem->data = (uint8_t *)impl_specific->base_addr +
+			(index * impl_specific->mem_size);
 
-	/* Mark slot as used */
-	impl_specific->slots[index] = true;
-
-	mem->data = (uint8_t *)impl_specific->base_addr +
-		    (shm_mem->index * impl_specific->mem_size);
+	mem->data = shm_mem->data;
 	mem->size = impl_specific->mem_size;
 	mem->cookie = mbuf_mem_shm_cookie;
 	mem->specific = shm_mem;
@@ -170,7 +268,7 @@ static void mbuf_mem_shm_free(struct mbuf_mem *mem, void *specific)
 	ULOG_ERRNO_RETURN_IF(!impl_specific, EINVAL);
 
 	/* Mark slot as unused */
-	impl_specific->slots[shm_mem->index] = false;
+	mbuf_mem_shm_release_slot(impl_specific, shm_mem->index);
 
 	mem->specific = NULL;
 	mem->data = NULL;
@@ -185,21 +283,39 @@ mbuf_mem_shm_get_implem(const struct mbuf_shm_attr *attrs)
 	int ret;
 	struct impl_shm_specific *impl_specific = NULL;
 	struct mbuf_mem_implem *impl = NULL;
+	struct shm_control *control;
 	void *data = NULL;
 	int fd = -1;
+	size_t data_size = 0, control_size = 0;
 
 	ULOG_ERRNO_RETURN_VAL_IF(!attrs, EINVAL, NULL);
 	ULOG_ERRNO_RETURN_VAL_IF(!attrs->addr, EINVAL, NULL);
 	ULOG_ERRNO_RETURN_VAL_IF(
 		attrs->mem_size * attrs->mem_count == 0, EINVAL, NULL);
 
-	ret = mbuf_shm_open(
-		attrs->addr, attrs->mem_size * attrs->mem_count, &fd, &data);
+	mbuf_shm_get_sizes(
+		attrs->mem_size, attrs->mem_count, &data_size, &control_size);
+
+	ret = mbuf_shm_open(attrs->addr, data_size + control_size, &fd, &data);
 	if (ret < 0) {
 		ULOG_ERRNO("mbuf_shm_open", -ret);
 		goto error;
 	}
 
+	/* Initialize the control block */
+	control = (struct shm_control *)((uint8_t *)data + data_size);
+	for (int i = 0; i < MBUF_SHM_MAX_CONSUMERS; i++)
+		atomic_init(&control->consumers[i], 0);
+	for (size_t i = 0; i < attrs->mem_count; i++) {
+		atomic_init(&control->refs[i].pending, 0);
+		for (int j = 0; j < MBUF_SHM_MAX_CONSUMERS; j++)
+			atomic_init(&control->refs[i].adopted[j], 0);
+	}
+	control->mem_size = attrs->mem_size;
+	control->mem_count = attrs->mem_count;
+	atomic_thread_fence(memory_order_release);
+	control->magic = MBUF_SHM_CONTROL_MAGIC;
+
 	impl_specific = calloc(1, sizeof(*impl_specific));
 	if (!impl_specific) {
 		ULOG_ERRNO("malloc", ENOMEM);
@@ -208,15 +324,25 @@ mbuf_mem_shm_get_implem(const struct mbuf_shm_attr *attrs)
 	impl_specific->fd = fd;
 	impl_specific->addr = strdup(attrs->addr);
 	impl_specific->base_addr = data;
+	impl_specific->map_size = data_size + control_size;
+	impl_specific->control = control;
 	impl_specific->mem_size = attrs->mem_size;
 	impl_specific->mem_count = attrs->mem_count;
 
-	impl_specific->slots =
-		calloc(impl_specific->mem_count, sizeof(*impl_specific->slots));
+	impl_specific->slot_words = (impl_specific->mem_count + 63) / 64;
+	impl_specific->slots = calloc(impl_specific->slot_words,
+				      sizeof(*impl_specific->slots));
 	if (!impl_specific->slots) {
 		ULOG_ERRNO("calloc", ENOMEM);
 		goto error;
 	}
+	/* Mark the slots beyond mem_count as used */
+	if (impl_specific->mem_count % 64 != 0) {
+		atomic_store(
+			&impl_specific->slots[impl_specific->slot_words - 1],
+			~((UINT64_C(1) << (impl_specific->mem_count % 64)) -
+			  1));
+	}
 
 	impl = calloc(1, sizeof(*impl));
 	if (!impl) {
@@ -224,13 +350,14 @@ mbuf_mem_shm_get_implem(const struct mbuf_shm_attr *attrs)
 		goto error;
 	}
 	impl->alloc = mbuf_mem_shm_alloc;
+	impl->pool_get = mbuf_mem_shm_pool_get;
 	impl->free = mbuf_mem_shm_free;
 	impl->specific = impl_specific;
 
 	return impl;
 
 error:
-	mbuf_shm_close(attrs->addr, data, attrs->mem_size * attrs->mem_count);
+	mbuf_shm_close(attrs->addr, data, data_size + control_size);
 	if (impl_specific)
 		free(impl_specific->slots);
 	free(impl_specific);
@@ -249,8 +376,7 @@ void mbuf_mem_shm_release_implem(struct mbuf_mem_implem *implem)
 	if (impl_specific != NULL) {
 		mbuf_shm_close(impl_specific->addr,
 			       impl_specific->base_addr,
-			       impl_specific->mem_size *
-				       impl_specific->mem_count);
+			       impl_specific->map_size);
 		free(impl_specific->addr);
 		free(impl_specific->slots);
 	}
@@ -259,6 +385,24 @@ void mbuf_mem_shm_release_implem(struct mbuf_mem_implem *implem)
 }
 
 
+int mbuf_mem_shm_get_stats(struct mbuf_mem_implem *implem,
+			   struct mbuf_shm_stats *stats)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!implem, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!implem->specific, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(implem->alloc != mbuf_mem_shm_alloc, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!stats, EINVAL);
+
+	struct impl_shm_specific *impl_specific = implem->specific;
+
+	stats->mem_count = impl_specific->mem_count;
+	stats->used_count = atomic_load(&impl_specific->used_count);
+	stats->peak_used_count = atomic_load(&impl_specific->peak_used_count);
+
+	return 0;
+}
+
+
 int mbuf_mem_shm_get_index(struct mbuf_mem *mem)
 {
 	ULOG_ERRNO_RETURN_ERR_IF(!mem, EINVAL);
@@ -277,3 +421,280 @@ int mbuf_mem_shm_get_index_from_info(struct mbuf_mem_info *info)
 
 	return ((struct mem_shm_specific *)info->specific)->index;
 }
+
+
+int mbuf_mem_shm_share(struct mbuf_mem *mem)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!mem, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!mem->specific, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(mem->cookie != mbuf_mem_shm_cookie, EINVAL);
+
+	struct mem_shm_specific *shm_mem = mem->specific;
+
+	shm_control_share(shm_mem->control, shm_mem->index);
+
+	return 0;
+}
+
+
+int mbuf_mem_shm_reclaim(struct mbuf_mem_implem *implem)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!implem, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!implem->specific, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(implem->alloc != mbuf_mem_shm_alloc, EINVAL);
+
+	struct impl_shm_specific *impl_specific = implem->specific;
+	struct shm_control *control = impl_specific->control;
+	int count = 0;
+	bool attached = false;
+
+	for (int i = 0; i < MBUF_SHM_MAX_CONSUMERS; i++) {
+		pid_t pid = atomic_load(&control->consumers[i]);
+		if (pid == 0)
+			continue;
+		if (kill(pid, 0) == 0 || errno != ESRCH) {
+			attached = true;
+			continue;
+		}
+		/* The consumer process no longer exists: release its
+		 * references, then its entry */
+		ULOGW("releasing the SHM memories of dead consumer %d",
+		      (int)pid);
+		for (size_t j = 0; j < impl_specific->mem_count; j++) {
+			count += atomic_exchange(
+				&control->refs[j].adopted[i], 0);
+		}
+		atomic_store(&control->consumers[i], 0);
+	}
+
+	/* Without any consumer, nobody can adopt the pending shares */
+	if (!attached) {
+		for (size_t j = 0; j < impl_specific->mem_count; j++)
+			count += atomic_exchange(&control->refs[j].pending, 0);
+	}
+
+	return count;
+}
+
+
+static void mbuf_mem_shm_consumer_free(struct mbuf_mem *mem, void *specific)
+{
+	struct mem_shm_specific *shm_mem = mem->specific;
+
+	ULOG_ERRNO_RETURN_IF(mem->cookie != mbuf_mem_shm_cookie, EINVAL);
+	ULOG_ERRNO_RETURN_IF(!shm_mem, EINVAL);
+
+	struct mbuf_shm_consumer *consumer = shm_mem->consumer;
+
+	/* Release the reference given by the producer */
+	if (!shm_counter_dec(&shm_mem->control->refs[shm_mem->index]
+				      .adopted[consumer->id]))
+		ULOGE("memory %d was not adopted by the consumer",
+		      shm_mem->index);
+	atomic_fetch_sub(&consumer->mem_used, 1);
+
+	mem->specific = NULL;
+	mem->data = NULL;
+
+	free(shm_mem);
+}
+
+
+static struct mbuf_mem_implem consumer_impl = {
+	.free = mbuf_mem_shm_consumer_free,
+};
+
+
+int mbuf_mem_shm_consumer_attach(const struct mbuf_shm_attr *attrs,
+				 bool writable,
+				 struct mbuf_shm_consumer **ret_obj)
+{
+	int ret;
+	struct mbuf_shm_consumer *consumer;
+	struct stat st;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!attrs, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!attrs->addr, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(attrs->mem_size * attrs->mem_count == 0,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!ret_obj, EINVAL);
+
+	consumer = calloc(1, sizeof(*consumer));
+	if (!consumer)
+		return -ENOMEM;
+	consumer->fd = -1;
+	consumer->id = -1;
+	consumer->base_addr = MAP_FAILED;
+	consumer->control = MAP_FAILED;
+	consumer->mem_size = attrs->mem_size;
+	consumer->mem_count = attrs->mem_count;
+	atomic_init(&consumer->mem_used, 0);
+	mbuf_shm_get_sizes(attrs->mem_size,
+			   attrs->mem_count,
+			   &consumer->data_size,
+			   &consumer->control_size);
+
+	/* The control block is always written, so the SHM is always opened
+	 * read-write */
+	consumer->fd = shm_open(attrs->addr, O_RDWR, 0);
+	if (consumer->fd < 0) {
+		ret = -errno;
+		ULOG_ERRNO("shm_open", -ret);
+		goto error;
+	}
+
+	ret = fstat(consumer->fd, &st);
+	if (ret < 0) {
+		ret = -errno;
+		ULOG_ERRNO("fstat", -ret);
+		goto error;
+	}
+	if ((size_t)st.st_size <
+	    consumer->data_size + consumer->control_size) {
+		ret = -EPROTO;
+		ULOGE("SHM '%s' is too small (%zu bytes, %zu expected)",
+		      attrs->addr,
+		      (size_t)st.st_size,
+		      consumer->data_size + consumer->control_size);
+		goto error;
+	}
+
+	consumer->base_addr =
+		mmap(NULL,
+		     consumer->data_size,
+		     writable ? PROT_READ | PROT_WRITE : PROT_READ,
+		     MAP_SHARED,
+		     consumer->fd,
+		     0);
+	if (consumer->base_addr == MAP_FAILED) {
+		ret = -errno;
+		ULOG_ERRNO("mmap", -ret);
+		goto error;
+	}
+
+	consumer->control = mmap(NULL,
+				 consumer->control_size,
+				 PROT_READ | PROT_WRITE,
+				 MAP_SHARED,
+				 consumer->fd,
+				 consumer->data_size);
+	if (consumer->control == MAP_FAILED) {
+		ret = -errno;
+		ULOG_ERRNO("mmap", -ret);
+		goto error;
+	}
+
+	if (consumer->control->magic != MBUF_SHM_CONTROL_MAGIC ||
+	    consumer->control->mem_size != attrs->mem_size ||
+	    consumer->control->mem_count != attrs->mem_count) {
+		ret = -EPROTO;
+		ULOGE("SHM '%s' attributes mismatch", attrs->addr);
+		goto error;
+	}
+	atomic_thread_fence(memory_order_acquire);
+
+	/* Register the consumer in the control block */
+	for (int i = 0; i < MBUF_SHM_MAX_CONSUMERS; i++) {
+		int pid = 0;
+		if (atomic_compare_exchange_strong(
+			    &consumer->control->consumers[i], &pid, getpid())) {
+			consumer->id = i;
+			break;
+		}
+	}
+	if (consumer->id < 0) {
+		ret = -EUSERS;
+		ULOGE("SHM '%s' has too many consumers (max %d)",
+		      attrs->addr,
+		      MBUF_SHM_MAX_CONSUMERS);
+		goto error;
+	}
+
+	*ret_obj = consumer;
+	return 0;
+
+error:
+	mbuf_mem_shm_consumer_detach(consumer);
+	return ret;
+}
+
+
+int mbuf_mem_shm_consumer_detach(struct mbuf_shm_consumer *consumer)
+{
+	int err;
+
+	if (!consumer)
+		return 0;
+
+	ULOG_ERRNO_RETURN_ERR_IF(atomic_load(&consumer->mem_used) != 0, EBUSY);
+
+	if (consumer->id >= 0)
+		atomic_store(&consumer->control->consumers[consumer->id], 0);
+	if (consumer->control != MAP_FAILED) {
+		err = munmap(consumer->control, consumer->control_size);
+		if (err == -1)
+			ULOG_ERRNO("munmap", errno);
+	}
+	if (consumer->base_addr != MAP_FAILED) {
+		err = munmap(consumer->base_addr, consumer->data_size);
+		if (err == -1)
+			ULOG_ERRNO("munmap", errno);
+	}
+	if (consumer->fd >= 0)
+		close(consumer->fd);
+	free(consumer);
+
+	return 0;
+}
+
+
+int mbuf_mem_shm_consumer_get_mem(struct mbuf_shm_consumer *consumer,
+				  int index,
+				  struct mbuf_mem **ret_obj)
+{
+	struct mem_shm_specific *shm_mem;
+	struct mbuf_mem *mem;
+	struct shm_mem_refs *refs;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!consumer, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(index < 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((size_t)index >= consumer->mem_count, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!ret_obj, EINVAL);
+
+	mem = calloc(1, sizeof(*mem));
+	if (!mem)
+		return -ENOMEM;
+	shm_mem = calloc(1, sizeof(*shm_mem));
+	if (!shm_mem) {
+		free(mem);
+		return -ENOMEM;
+	}
+
+	/* Adopt one share of the producer; the adopted count is incremented
+	 * first so that the memory is always seen as busy by the producer */
+	refs = &consumer->control->refs[index];
+	atomic_fetch_add(&refs->adopted[consumer->id], 1);
+	if (!shm_counter_dec(&refs->pending)) {
+		atomic_fetch_sub(&refs->adopted[consumer->id], 1);
+		free(shm_mem);
+		free(mem);
+		ULOGE("memory %d is not shared by the producer", index);
+		return -ENOENT;
+	}
+	shm_mem->index = index;
+	shm_mem->data = (uint8_t *)consumer->base_addr +
+			(size_t)index * consumer->mem_size;
+	shm_mem->control = consumer->control;
+	shm_mem->consumer = consumer;
+
+	atomic_init(&mem->refcount, 1);
+	mem->cookie = mbuf_mem_shm_cookie;
+	mem->implem = &consumer_impl;
+	mem->specific = shm_mem;
+	mem->data = shm_mem->data;
+	mem->size = consumer->mem_size;
+	atomic_fetch_add(&consumer->mem_used, 1);
+
+	*ret_obj = mem;
+	return 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2026 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MBUF_MEM_SHM_INTERNAL_H_
+#define _MBUF_MEM_SHM_INTERNAL_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* Magic of the SHM control block, 'mbufshm' in ascii coding */
+#define MBUF_SHM_CONTROL_MAGIC UINT64_C(0x6d62756673686d)
+
+
+/* Maximum number of consumers attached to a SHM at the same time */
+#define MBUF_SHM_MAX_CONSUMERS 8
+
+
+/* References of a memory shared with the consumers */
+struct shm_mem_refs {
+	/* Number of shares not adopted yet by a consumer */
+	atomic_uint pending;
+	/* Number of shares adopted by each consumer */
+	atomic_uint adopted[MBUF_SHM_MAX_CONSUMERS];
+};
+
+
+/* SHM control block, located after the memories in the shared memory (at the
+ * first page boundary) */
+struct shm_control {
+	uint64_t magic;
+	uint64_t mem_size;
+	uint64_t mem_count;
+	/* PID of the attached consumers, 0 for free entries */
+	atomic_int consumers[MBUF_SHM_MAX_CONSUMERS];
+	/* References held by the consumers, for each memory */
+	struct shm_mem_refs refs[];
+};
+
+
+/* Add a share of a memory, to be adopted by one consumer */
+static inline void shm_control_share(struct shm_control *control, int index)
+{
+	atomic_fetch_add(&control->refs[index].pending, 1);
+}
+
+
+/* Decrement a counter, unless it is already 0; returns false in that case */
+static inline bool shm_counter_dec(atomic_uint *counter)
+{
+	unsigned int value = atomic_load(counter);
+
+	do {
+		if (value == 0)
+			return false;
+	} while (!atomic_compare_exchange_weak(counter, &value, value - 1));
+
+	return true;
+}
+
+
+/* Forward declarations */
+struct mbuf_shm_consumer;
+
+
+/* SHM implementation memory specific */
+struct mem_shm_specific {
+	/* Index (handle) of the memory in the shared memory */
+	int index;
+	/* Address of the memory in the process */
+	void *data;
+	/* Control block of the shared memory */
+	struct shm_control *control;
+	/* Consumer of the memory, NULL for memories of a SHM implementation */
+	struct mbuf_shm_consumer *consumer;
+};
+
+
+#endif /* _MBUF_MEM_SHM_INTERNAL_H_ */
@@ -0,0 +1,934 @@
+/**
+ * Copyright (c) 2026 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <media-buffers/mbuf_shm_frame_queue.h>
+
+#include "mbuf_mem_shm_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <video-metadata/vmeta.h>
+
+#define ULOG_TAG mbuf_shm_frame_queue
+#include <ulog.h>
+ULOG_DECLARE_TAG(ULOG_TAG);
+
+
+/* Magic of the queue shared memory, 'mbufqueu' in ascii coding */
+#define MBUF_SHM_FRAME_QUEUE_MAGIC UINT64_C(0x6d62756671756575)
+
+
+#define DEFAULT_MAX_CHUNK_COUNT 16
+#define DEFAULT_MAX_META_SIZE 1024
+#define META_MIME_TYPE_MAX_LEN 64
+#define CACHE_LINE_SIZE 64
+
+
+/* Queue shared memory header, followed by the slots */
+struct shm_queue_header {
+	uint64_t magic;
+	uint64_t slot_count;
+	uint64_t slot_size;
+	uint64_t max_chunk_count;
+	uint64_t max_meta_size;
+	/* Number of frames pushed, written by the producer only */
+	atomic_uint_least64_t write_count __attribute__((aligned(64)));
+	/* Number of frames popped, written by the consumer only */
+	atomic_uint_least64_t read_count __attribute__((aligned(64)));
+};
+
+
+/* Reference of a frame memory chunk */
+struct shm_queue_chunk {
+	/* Index (handle) of the memory in the SHM heap */
+	uint32_t index;
+	uint64_t offset;
+	uint64_t len;
+	/* NALU descriptor (coded video frames only) */
+	struct vdef_nalu nalu;
+};
+
+
+/* Queue slot, followed by max_chunk_count chunks, then by the serialized
+ * metadata */
+struct shm_queue_slot {
+	uint32_t type;
+	uint32_t chunk_count;
+	union {
+		struct vdef_raw_frame raw;
+		struct vdef_coded_frame coded;
+		struct adef_frame audio;
+	} info;
+	char meta_mime_type[META_MIME_TYPE_MAX_LEN];
+	uint64_t meta_size;
+	struct shm_queue_chunk chunks[];
+};
+
+
+struct mbuf_shm_frame_queue {
+	/* Address of the queue shared memory (producer only) */
+	char *addr;
+	/* SHM consumer (consumer only) */
+	struct mbuf_shm_consumer *consumer;
+	int evt_fd;
+	void *base_addr;
+	size_t map_size;
+	struct shm_queue_header *header;
+	size_t slot_count;
+	size_t slot_size;
+	size_t max_chunk_count;
+	size_t max_meta_size;
+	/* Control block of the SHM heap of the pushed frames (producer only) */
+	struct shm_control *control;
+};
+
+
+static int queue_init(struct mbuf_shm_frame_queue *queue,
+		      const struct mbuf_shm_frame_queue_attr *attrs)
+{
+	size_t chunks_size;
+
+	queue->evt_fd = -1;
+	queue->base_addr = MAP_FAILED;
+	queue->slot_count = attrs->slot_count;
+	queue->max_chunk_count = attrs->max_chunk_count != 0
+					 ? attrs->max_chunk_count
+					 : DEFAULT_MAX_CHUNK_COUNT;
+	queue->max_meta_size = attrs->max_meta_size != 0
+				       ? attrs->max_meta_size
+				       : DEFAULT_MAX_META_SIZE;
+
+	chunks_size = queue->max_chunk_count * sizeof(struct shm_queue_chunk);
+	queue->slot_size = sizeof(struct shm_queue_slot) + chunks_size +
+			   queue->max_meta_size;
+	queue->slot_size = (queue->slot_size + CACHE_LINE_SIZE - 1) &
+			   ~((size_t)CACHE_LINE_SIZE - 1);
+	if (queue->slot_size > (SIZE_MAX - sizeof(struct shm_queue_header)) /
+				       queue->slot_count)
+		return -EOVERFLOW;
+	queue->map_size = sizeof(struct shm_queue_header) +
+			  queue->slot_size * queue->slot_count;
+
+	return 0;
+}
+
+
+static struct shm_queue_slot *queue_get_slot(struct mbuf_shm_frame_queue *queue,
+					     uint64_t count)
+{
+	return (struct shm_queue_slot *)((uint8_t *)queue->base_addr +
+					 sizeof(*queue->header) +
+					 (count % queue->slot_count) *
+						 queue->slot_size);
+}
+
+
+static uint8_t *queue_get_slot_meta(struct mbuf_shm_frame_queue *queue,
+				    struct shm_queue_slot *slot)
+{
+	return (uint8_t *)&slot->chunks[queue->max_chunk_count];
+}
+
+
+int mbuf_shm_frame_queue_new(const struct mbuf_shm_frame_queue_attr *attrs,
+			     struct mbuf_shm_frame_queue **ret_obj)
+{
+	int ret;
+	int fd = -1;
+	struct mbuf_shm_frame_queue *queue;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!attrs, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!attrs->addr, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(attrs->slot_count == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!ret_obj, EINVAL);
+
+	queue = calloc(1, sizeof(*queue));
+	if (!queue)
+		return -ENOMEM;
+	ret = queue_init(queue, attrs);
+	if (ret != 0)
+		goto error;
+
+	queue->evt_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (queue->evt_fd < 0) {
+		ret = -errno;
+		ULOG_ERRNO("eventfd", -ret);
+		goto error;
+	}
+
+	fd = shm_open(attrs->addr, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		ret = -errno;
+		ULOG_ERRNO("shm_open", -ret);
+		goto error;
+	}
+	queue->addr = strdup(attrs->addr);
+	if (!queue->addr) {
+		ret = -ENOMEM;
+		shm_unlink(attrs->addr);
+		goto error;
+	}
+
+	ret = ftruncate(fd, queue->map_size);
+	if (ret < 0) {
+		ret = -errno;
+		ULOG_ERRNO("ftruncate", -ret);
+		goto error;
+	}
+
+	queue->base_addr = mmap(NULL,
+				queue->map_size,
+				PROT_READ | PROT_WRITE,
+				MAP_SHARED,
+				fd,
+				0);
+	if (queue->base_addr == MAP_FAILED) {
+		ret = -errno;
+		ULOG_ERRNO("mmap", -ret);
+		goto error;
+	}
+	close(fd);
+	fd = -1;
+
+	queue->header = queue->base_addr;
+	queue->header->slot_count = queue->slot_count;
+	queue->header->slot_size = queue->slot_size;
+	queue->header->max_chunk_count = queue->max_chunk_count;
+	queue->header->max_meta_size = queue->max_meta_size;
+	atomic_init(&queue->header->write_count, 0);
+	atomic_init(&queue->header->read_count, 0);
+	atomic_thread_fence(memory_order_release);
+	queue->header->magic = MBUF_SHM_FRAME_QUEUE_MAGIC;
+
+	*ret_obj = queue;
+	return 0;
+
+error:
+	if (fd >= 0)
+		close(fd);
+	mbuf_shm_frame_queue_destroy(queue);
+	return ret;
+}
+
+
+int mbuf_shm_frame_queue_attach(const struct mbuf_shm_frame_queue_attr *attrs,
+				struct mbuf_shm_consumer *consumer,
+				int fd,
+				struct mbuf_shm_frame_queue **ret_obj)
+{
+	int ret;
+	int shm_fd = -1;
+	struct stat st;
+	struct mbuf_shm_frame_queue *queue;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!attrs, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!attrs->addr, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(attrs->slot_count == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!consumer, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(fd < 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!ret_obj, EINVAL);
+
+	queue = calloc(1, sizeof(*queue));
+	if (!queue)
+		return -ENOMEM;
+	ret = queue_init(queue, attrs);
+	if (ret != 0)
+		goto error;
+	queue->consumer = consumer;
+
+	queue->evt_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (queue->evt_fd < 0) {
+		ret = -errno;
+		ULOG_ERRNO("fcntl", -ret);
+		goto error;
+	}
+
+	shm_fd = shm_open(attrs->addr, O_RDWR, 0);
+	if (shm_fd < 0) {
+		ret = -errno;
+		ULOG_ERRNO("shm_open", -ret);
+		goto error;
+	}
+
+	ret = fstat(shm_fd, &st);
+	if (ret < 0) {
+		ret = -errno;
+		ULOG_ERRNO("fstat", -ret);
+		goto error;
+	}
+	if ((size_t)st.st_size < queue->map_size) {
+		ret = -EPROTO;
+		ULOGE("SHM '%s' is too small (%zu bytes, %zu expected)",
+		      attrs->addr,
+		      (size_t)st.st_size,
+		      queue->map_size);
+		goto error;
+	}
+
+	queue->base_addr = mmap(NULL,
+				queue->map_size,
+				PROT_READ | PROT_WRITE,
+				MAP_SHARED,
+				shm_fd,
+				0);
+	if (queue->base_addr == MAP_FAILED) {
+		ret = -errno;
+		ULOG_ERRNO("mmap", -ret);
+		goto error;
+	}
+	close(shm_fd);
+	shm_fd = -1;
+
+	queue->header = queue->base_addr;
+	if (queue->header->magic != MBUF_SHM_FRAME_QUEUE_MAGIC ||
+	    queue->header->slot_count != queue->slot_count ||
+	    queue->header->slot_size != queue->slot_size ||
+	    queue->header->max_chunk_count != queue->max_chunk_count ||
+	    queue->header->max_meta_size != queue->max_meta_size) {
+		ret = -EPROTO;
+		ULOGE("SHM '%s' attributes mismatch", attrs->addr);
+		goto error;
+	}
+	atomic_thread_fence(memory_order_acquire);
+
+	*ret_obj = queue;
+	return 0;
+
+error:
+	if (shm_fd >= 0)
+		close(shm_fd);
+	queue->consumer = NULL;
+	mbuf_shm_frame_queue_destroy(queue);
+	return ret;
+}
+
+
+int mbuf_shm_frame_queue_get_fd(struct mbuf_shm_frame_queue *queue)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+
+	return queue->evt_fd;
+}
+
+
+/* Get a free slot (producer side), or NULL if the queue is full */
+static struct shm_queue_slot *
+queue_get_free_slot(struct mbuf_shm_frame_queue *queue)
+{
+	uint64_t write_count = atomic_load_explicit(&queue->header->write_count,
+						    memory_order_relaxed);
+	uint64_t read_count = atomic_load_explicit(&queue->header->read_count,
+						   memory_order_acquire);
+	struct shm_queue_slot *slot;
+
+	if (write_count - read_count >= queue->slot_count)
+		return NULL;
+
+	slot = queue_get_slot(queue, write_count);
+	slot->chunk_count = 0;
+	slot->meta_size = 0;
+	slot->meta_mime_type[0] = '\0';
+	return slot;
+}
+
+
+static int queue_add_chunk(struct mbuf_shm_frame_queue *queue,
+			   struct shm_queue_slot *slot,
+			   struct mbuf_mem_info *info,
+			   const void *data,
+			   size_t len,
+			   const struct vdef_nalu *nalu)
+{
+	struct mem_shm_specific *shm_mem = info->specific;
+	struct shm_queue_chunk *chunk;
+
+	if (info->cookie != mbuf_mem_shm_cookie || !shm_mem) {
+		ULOGE("frame memory is not a SHM memory");
+		return -EINVAL;
+	}
+	if (queue->control && queue->control != shm_mem->control) {
+		ULOGE("frame memory is not from the queue SHM heap");
+		return -EINVAL;
+	}
+	if (slot->chunk_count >= queue->max_chunk_count) {
+		ULOGE("too many memory chunks in frame (max %zu)",
+		      queue->max_chunk_count);
+		return -ENOBUFS;
+	}
+	queue->control = shm_mem->control;
+
+	chunk = &slot->chunks[slot->chunk_count++];
+	chunk->index = shm_mem->index;
+	chunk->offset = (const uint8_t *)data - (const uint8_t *)shm_mem->data;
+	chunk->len = len;
+	if (nalu)
+		chunk->nalu = *nalu;
+	else
+		memset(&chunk->nalu, 0, sizeof(chunk->nalu));
+
+	return 0;
+}
+
+
+/* Serialize the metadata, share the chunks memories with the consumer and
+ * publish the slot (producer side) */
+static int queue_commit_slot(struct mbuf_shm_frame_queue *queue,
+			     struct shm_queue_slot *slot,
+			     struct vmeta_frame *meta)
+{
+	int ret;
+	struct vmeta_buffer buf;
+	const char *mime_type;
+	uint64_t value = 1;
+	ssize_t res;
+
+	if (meta) {
+		mime_type = vmeta_frame_get_mime_type(meta);
+		if (!mime_type ||
+		    strlen(mime_type) >= sizeof(slot->meta_mime_type)) {
+			ULOGE("invalid metadata mime type");
+			return -EINVAL;
+		}
+		strcpy(slot->meta_mime_type, mime_type);
+		vmeta_buffer_set_data(&buf,
+				      queue_get_slot_meta(queue, slot),
+				      queue->max_meta_size,
+				      0);
+		ret = vmeta_frame_write(&buf, meta);
+		if (ret < 0) {
+			ULOG_ERRNO("vmeta_frame_write", -ret);
+			return ret;
+		}
+		slot->meta_size = buf.pos;
+	}
+
+	for (uint32_t i = 0; i < slot->chunk_count; i++)
+		shm_control_share(queue->control, slot->chunks[i].index);
+
+	atomic_fetch_add_explicit(
+		&queue->header->write_count, 1, memory_order_release);
+
+	res = write(queue->evt_fd, &value, sizeof(value));
+	if (res < 0 && errno != EAGAIN)
+		ULOG_ERRNO("write", errno);
+
+	return 0;
+}
+
+
+int mbuf_shm_frame_queue_push_raw_video(struct mbuf_shm_frame_queue *queue,
+					struct mbuf_raw_video_frame *frame)
+{
+	int ret;
+	struct shm_queue_slot *slot;
+	struct vmeta_frame *meta = NULL;
+	unsigned int plane_count;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(queue->consumer, EPERM);
+
+	slot = queue_get_free_slot(queue);
+	if (!slot)
+		return -EAGAIN;
+
+	slot->type = MBUF_SHM_FRAME_TYPE_RAW_VIDEO;
+	ret = mbuf_raw_video_frame_get_frame_info(frame, &slot->info.raw);
+	if (ret != 0)
+		return ret;
+
+	plane_count = vdef_get_raw_frame_plane_count(&slot->info.raw.format);
+	for (unsigned int i = 0; i < plane_count; i++) {
+		struct mbuf_mem_info info;
+		const void *data;
+		size_t len;
+
+		ret = mbuf_raw_video_frame_get_plane_mem_info(frame, i, &info);
+		if (ret != 0)
+			return ret;
+		ret = mbuf_raw_video_frame_get_plane(frame, i, &data, &len);
+		if (ret != 0)
+			return ret;
+		ret = queue_add_chunk(queue, slot, &info, data, len, NULL);
+		mbuf_raw_video_frame_release_plane(frame, i, data);
+		if (ret != 0)
+			return ret;
+	}
+
+	ret = mbuf_raw_video_frame_get_metadata(frame, &meta);
+	if (ret != 0 && ret != -ENOENT)
+		return ret;
+
+	ret = queue_commit_slot(queue, slot, meta);
+
+	if (meta)
+		vmeta_frame_unref(meta);
+	return ret;
+}
+
+
+int mbuf_shm_frame_queue_push_coded_video(struct mbuf_shm_frame_queue *queue,
+					  struct mbuf_coded_video_frame *frame)
+{
+	int ret;
+	struct shm_queue_slot *slot;
+	struct vmeta_frame *meta = NULL;
+	int nalu_count;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(queue->consumer, EPERM);
+
+	slot = queue_get_free_slot(queue);
+	if (!slot)
+		return -EAGAIN;
+
+	slot->type = MBUF_SHM_FRAME_TYPE_CODED_VIDEO;
+	ret = mbuf_coded_video_frame_get_frame_info(frame, &slot->info.coded);
+	if (ret != 0)
+		return ret;
+
+	nalu_count = mbuf_coded_video_frame_get_nalu_count(frame);
+	if (nalu_count < 0)
+		return nalu_count;
+	for (int i = 0; i < nalu_count; i++) {
+		struct mbuf_mem_info info;
+		const void *data;
+		struct vdef_nalu nalu;
+
+		ret = mbuf_coded_video_frame_get_nalu_mem_info(frame, i, &info);
+		if (ret != 0)
+			return ret;
+		ret = mbuf_coded_video_frame_get_nalu(frame, i, &data, &nalu);
+		if (ret != 0)
+			return ret;
+		ret = queue_add_chunk(
+			queue, slot, &info, data, nalu.size, &nalu);
+		mbuf_coded_video_frame_release_nalu(frame, i, data);
+		if (ret != 0)
+			return ret;
+	}
+
+	ret = mbuf_coded_video_frame_get_metadata(frame, &meta);
+	if (ret != 0 && ret != -ENOENT)
+		return ret;
+
+	ret = queue_commit_slot(queue, slot, meta);
+
+	if (meta)
+		vmeta_frame_unref(meta);
+	return ret;
+}
+
+
+int mbuf_shm_frame_queue_push_audio(struct mbuf_shm_frame_queue *queue,
+				    struct mbuf_audio_frame *frame)
+{
+	int ret;
+	struct shm_queue_slot *slot;
+	struct mbuf_mem_info info;
+	const void *data;
+	size_t len;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(queue->consumer, EPERM);
+
+	slot = queue_get_free_slot(queue);
+	if (!slot)
+		return -EAGAIN;
+
+	slot->type = MBUF_SHM_FRAME_TYPE_AUDIO;
+	ret = mbuf_audio_frame_get_frame_info(frame, &slot->info.audio);
+	if (ret != 0)
+		return ret;
+
+	ret = mbuf_audio_frame_get_buffer_mem_info(frame, &info);
+	if (ret != 0)
+		return ret;
+	ret = mbuf_audio_frame_get_buffer(frame, &data, &len);
+	if (ret != 0)
+		return ret;
+	ret = queue_add_chunk(queue, slot, &info, data, len, NULL);
+	mbuf_audio_frame_release_buffer(frame, data);
+	if (ret != 0)
+		return ret;
+
+	return queue_commit_slot(queue, slot, NULL);
+}
+
+
+/* Get the next filled slot (consumer side), or NULL if the queue is empty */
+static struct shm_queue_slot *
+queue_get_next_slot(struct mbuf_shm_frame_queue *queue)
+{
+	uint64_t read_count = atomic_load_explicit(&queue->header->read_count,
+						   memory_order_relaxed);
+	uint64_t write_count = atomic_load_explicit(
+		&queue->header->write_count, memory_order_acquire);
+
+	if (read_count == write_count)
+		return NULL;
+
+	return queue_get_slot(queue, read_count);
+}
+
+
+/* Release the next slot (consumer side) */
+static void queue_release_slot(struct mbuf_shm_frame_queue *queue)
+{
+	uint64_t value;
+	ssize_t res;
+
+	atomic_fetch_add_explicit(
+		&queue->header->read_count, 1, memory_order_release);
+
+	if (queue_get_next_slot(queue))
+		return;
+
+	/* The queue is empty: clear the event, then check again to avoid
+	 * missing a frame pushed in-between */
+	res = read(queue->evt_fd, &value, sizeof(value));
+	if (res < 0 && errno != EAGAIN)
+		ULOG_ERRNO("read", errno);
+	if (queue_get_next_slot(queue)) {
+		value = 1;
+		res = write(queue->evt_fd, &value, sizeof(value));
+		if (res < 0 && errno != EAGAIN)
+			ULOG_ERRNO("write", errno);
+	}
+}
+
+
+/* Drop the shared references of the remaining chunks of a slot */
+static void queue_drop_chunks(struct mbuf_shm_frame_queue *queue,
+			      struct shm_queue_slot *slot,
+			      uint32_t first)
+{
+	int ret;
+	struct mbuf_mem *mem;
+
+	for (uint32_t i = first; i < slot->chunk_count; i++) {
+		ret = mbuf_mem_shm_consumer_get_mem(
+			queue->consumer, slot->chunks[i].index, &mem);
+		if (ret != 0) {
+			ULOG_ERRNO("mbuf_mem_shm_consumer_get_mem", -ret);
+			continue;
+		}
+		mbuf_mem_unref(mem);
+	}
+}
+
+
+static int queue_read_meta(struct mbuf_shm_frame_queue *queue,
+			   struct shm_queue_slot *slot,
+			   struct vmeta_frame **ret_meta)
+{
+	int ret;
+	struct vmeta_buffer buf;
+
+	*ret_meta = NULL;
+	if (slot->meta_size == 0)
+		return 0;
+	if (slot->meta_size > queue->max_meta_size ||
+	    memchr(slot->meta_mime_type, '\0', sizeof(slot->meta_mime_type)) ==
+		    NULL)
+		return -EPROTO;
+
+	vmeta_buffer_set_cdata(
+		&buf, queue_get_slot_meta(queue, slot), slot->meta_size, 0);
+	ret = vmeta_frame_read(&buf, slot->meta_mime_type, ret_meta);
+	if (ret < 0)
+		ULOG_ERRNO("vmeta_frame_read", -ret);
+	return ret;
+}
+
+
+/* Get the next slot of the given type (consumer side) */
+static int queue_pop_slot(struct mbuf_shm_frame_queue *queue,
+			  enum mbuf_shm_frame_type type,
+			  struct shm_queue_slot **ret_slot)
+{
+	struct shm_queue_slot *slot;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!queue->consumer, EPERM);
+
+	slot = queue_get_next_slot(queue);
+	if (!slot)
+		return -EAGAIN;
+	if (slot->type != type)
+		return -EPROTO;
+	if (slot->chunk_count > queue->max_chunk_count) {
+		/* Corrupted slot, drop it */
+		ULOGE("invalid chunk count in slot");
+		queue_release_slot(queue);
+		return -EPROTO;
+	}
+
+	*ret_slot = slot;
+	return 0;
+}
+
+
+int mbuf_shm_frame_queue_peek_type(struct mbuf_shm_frame_queue *queue,
+				   enum mbuf_shm_frame_type *type)
+{
+	struct shm_queue_slot *slot;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!queue->consumer, EPERM);
+	ULOG_ERRNO_RETURN_ERR_IF(!type, EINVAL);
+
+	slot = queue_get_next_slot(queue);
+	if (!slot)
+		return -EAGAIN;
+
+	*type = slot->type;
+	return 0;
+}
+
+
+int mbuf_shm_frame_queue_pop_raw_video(struct mbuf_shm_frame_queue *queue,
+				       struct mbuf_raw_video_frame **frame)
+{
+	int ret;
+	uint32_t i = 0;
+	struct shm_queue_slot *slot;
+	struct mbuf_raw_video_frame *raw_frame = NULL;
+	struct vmeta_frame *meta = NULL;
+	struct mbuf_mem *mem;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+
+	ret = queue_pop_slot(queue, MBUF_SHM_FRAME_TYPE_RAW_VIDEO, &slot);
+	if (ret != 0)
+		return ret;
+
+	ret = mbuf_raw_video_frame_new(&slot->info.raw, &raw_frame);
+	if (ret != 0)
+		goto out;
+
+	for (i = 0; i < slot->chunk_count; i++) {
+		struct shm_queue_chunk *chunk = &slot->chunks[i];
+		ret = mbuf_mem_shm_consumer_get_mem(
+			queue->consumer, chunk->index, &mem);
+		if (ret != 0)
+			goto out;
+		ret = mbuf_raw_video_frame_set_plane(
+			raw_frame, i, mem, chunk->offset, chunk->len);
+		mbuf_mem_unref(mem);
+		if (ret != 0) {
+			i++;
+			goto out;
+		}
+	}
+
+	ret = queue_read_meta(queue, slot, &meta);
+	if (ret != 0)
+		goto out;
+	if (meta) {
+		ret = mbuf_raw_video_frame_set_metadata(raw_frame, meta);
+		vmeta_frame_unref(meta);
+		if (ret != 0)
+			goto out;
+	}
+
+	ret = mbuf_raw_video_frame_finalize(raw_frame);
+
+out:
+	queue_drop_chunks(queue, slot, i);
+	queue_release_slot(queue);
+	if (ret != 0 && raw_frame) {
+		mbuf_raw_video_frame_unref(raw_frame);
+		raw_frame = NULL;
+	}
+	*frame = raw_frame;
+	return ret;
+}
+
+
+int mbuf_shm_frame_queue_pop_coded_video(struct mbuf_shm_frame_queue *queue,
+					 struct mbuf_coded_video_frame **frame)
+{
+	int ret;
+	uint32_t i = 0;
+	struct shm_queue_slot *slot;
+	struct mbuf_coded_video_frame *coded_frame = NULL;
+	struct vmeta_frame *meta = NULL;
+	struct mbuf_mem *mem;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+
+	ret = queue_pop_slot(queue, MBUF_SHM_FRAME_TYPE_CODED_VIDEO, &slot);
+	if (ret != 0)
+		return ret;
+
+	ret = mbuf_coded_video_frame_new(&slot->info.coded, &coded_frame);
+	if (ret != 0)
+		goto out;
+
+	for (i = 0; i < slot->chunk_count; i++) {
+		struct shm_queue_chunk *chunk = &slot->chunks[i];
+		struct vdef_nalu nalu = chunk->nalu;
+		ret = mbuf_mem_shm_consumer_get_mem(
+			queue->consumer, chunk->index, &mem);
+		if (ret != 0)
+			goto out;
+		ret = mbuf_coded_video_frame_add_nalu(
+			coded_frame, mem, chunk->offset, &nalu);
+		mbuf_mem_unref(mem);
+		if (ret != 0) {
+			i++;
+			goto out;
+		}
+	}
+
+	ret = queue_read_meta(queue, slot, &meta);
+	if (ret != 0)
+		goto out;
+	if (meta) {
+		ret = mbuf_coded_video_frame_set_metadata(coded_frame, meta);
+		vmeta_frame_unref(meta);
+		if (ret != 0)
+			goto out;
+	}
+
+	ret = mbuf_coded_video_frame_finalize(coded_frame);
+
+out:
+	queue_drop_chunks(queue, slot, i);
+	queue_release_slot(queue);
+	if (ret != 0 && coded_frame) {
+		mbuf_coded_video_frame_unref(coded_frame);
+		coded_frame = NULL;
+	}
+	*frame = coded_frame;
+	return ret;
+}
+
+
+int mbuf_shm_frame_queue_pop_audio(struct mbuf_shm_frame_queue *queue,
+				   struct mbuf_audio_frame **frame)
+{
+	int ret;
+	uint32_t i = 0;
+	struct shm_queue_slot *slot;
+	struct mbuf_audio_frame *audio_frame = NULL;
+	struct mbuf_mem *mem;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+
+	ret = queue_pop_slot(queue, MBUF_SHM_FRAME_TYPE_AUDIO, &slot);
+	if (ret != 0)
+		return ret;
+
+	ret = mbuf_audio_frame_new(&slot->info.audio, &audio_frame);
+	if (ret != 0)
+		goto out;
+
+	if (slot->chunk_count != 1) {
+		ret = -EPROTO;
+		goto out;
+	}
+	ret = mbuf_mem_shm_consumer_get_mem(
+		queue->consumer, slot->chunks[0].index, &mem);
+	if (ret != 0)
+		goto out;
+	i++;
+	ret = mbuf_audio_frame_set_buffer(
+		audio_frame, mem, slot->chunks[0].offset, slot->chunks[0].len);
+	mbuf_mem_unref(mem);
+	if (ret != 0)
+		goto out;
+
+	ret = mbuf_audio_frame_finalize(audio_frame);
+
+out:
+	queue_drop_chunks(queue, slot, i);
+	queue_release_slot(queue);
+	if (ret != 0 && audio_frame) {
+		mbuf_audio_frame_unref(audio_frame);
+		audio_frame = NULL;
+	}
+	*frame = audio_frame;
+	return ret;
+}
+
+
+int mbuf_shm_frame_queue_get_count(struct mbuf_shm_frame_queue *queue)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+
+	return atomic_load(&queue->header->write_count) -
+	       atomic_load(&queue->header->read_count);
+}
+
+
+int mbuf_shm_frame_queue_destroy(struct mbuf_shm_frame_queue *queue)
+{
+	int err;
+	struct shm_queue_slot *slot;
+
+	if (!queue)
+		return 0;
+
+	/* Give the memories of the remaining frames back to the producer */
+	if (queue->consumer) {
+		while ((slot = queue_get_next_slot(queue)) != NULL) {
+			if (slot->chunk_count <= queue->max_chunk_count)
+				queue_drop_chunks(queue, slot, 0);
+			queue_release_slot(queue);
+		}
+	}
+
+	if (queue->base_addr != MAP_FAILED) {
+		err = munmap(queue->base_addr, queue->map_size);
+		if (err == -1)
+			ULOG_ERRNO("munmap", errno);
+	}
+	if (queue->addr) {
+		err = shm_unlink(queue->addr);
+		if (err == -1)
+			ULOG_ERRNO("shm_unlink", errno);
+		free(queue->addr);
+	}
+	if (queue->evt_fd >= 0)
+		close(queue->evt_fd);
+	free(queue);
+
+	return 0;
+}
@@ -75,6 +75,23 @@ extern "C" {
 extern MBUF_API const char *MBUF_ANCILLARY_KEY_USERDATA_SEI;
 
 
+/**
+ * Interned key of MBUF_ANCILLARY_KEY_USERDATA_SEI.
+ *
+ * Well-known keys are pre-interned, and can be used directly with the
+ * mbuf_xxx_frame_xxx_ancillary_xxx_by_key() functions.
+ */
+#define MBUF_ANCILLARY_KEY_ID_USERDATA_SEI 1
+
+
+/**
+ * Maximum length of the instance pointer suffix (':' and hexadecimal
+ * pointer value) of an ancillary key built by
+ * mbuf_ancillary_data_build_key_buf().
+ */
+#define MBUF_ANCILLARY_KEY_PTR_MAX_LEN (1 + 2 * sizeof(uintptr_t))
+
+
 struct mbuf_ancillary_data;
 
 
@@ -102,6 +119,21 @@ struct mbuf_ancillary_data_cbs {
 };
 
 
+/**
+ * Release callback function for adopted ancillary data buffers.
+ *
+ * Called when an ancillary data which adopted a caller buffer is released,
+ * so that the caller can free the buffer.
+ *
+ * @param buffer: The buffer passed to mbuf_xxx_frame_add_ancillary_adopt().
+ * @param len: The length passed to mbuf_xxx_frame_add_ancillary_adopt().
+ * @param userdata: Callback function user data.
+ */
+typedef void (*mbuf_ancillary_data_release_t)(void *buffer,
+					      size_t len,
+					      void *userdata);
+
+
 /**
  * Callback type for mbuf_xxx_frame_foreach_ancillary_data().
  *
@@ -220,7 +252,9 @@ mbuf_ancillary_data_build_key(const char *name, uintptr_t ptr, char **key);
 /**
  * Parse an ancillary key to extract a name and an instance pointer.
  *
- * The name will be allocated and must be freed by the caller.
+ * The name will be allocated and must be freed by the caller. The key is
+ * parsed as with mbuf_ancillary_data_parse_key_buf(): the instance pointer,
+ * if any, is in hexadecimal.
  *
  * @param kezy: The ancillary key to parse.
  * @param name: The extracted name (must be freed).
@@ -232,6 +266,86 @@ MBUF_API int
 mbuf_ancillary_data_parse_key(const char *key, char **name, uintptr_t *ptr);
 
 
+/**
+ * Build an ancillary key from a name and an instance pointer into a caller
+ * provided buffer.
+ *
+ * This function is the allocation-free equivalent of
+ * mbuf_ancillary_data_build_key(), and produces the same key. A buffer of
+ * strlen(name) + MBUF_ANCILLARY_KEY_PTR_MAX_LEN + 1 bytes is always large
+ * enough.
+ *
+ * @param name: The ancillary data name.
+ * @param ptr: An instance pointer (optional, can be 0)
+ * @param key: [out] The buffer receiving the NULL-terminated ancillary key.
+ * @param key_len: The size of the key buffer.
+ *
+ * @return 0 on success, -ENOSPC if the buffer is too small, negative errno
+ *         on other errors.
+ */
+MBUF_API int mbuf_ancillary_data_build_key_buf(const char *name,
+					       uintptr_t ptr,
+					       char *key,
+					       size_t key_len);
+
+
+/**
+ * Parse an ancillary key to extract a name and an instance pointer into a
+ * caller provided buffer.
+ *
+ * This function is the allocation-free equivalent of
+ * mbuf_ancillary_data_parse_key(). The key is made of the name, optionally
+ * followed by a ':' and the instance pointer in hexadecimal (with an optional
+ * 0x prefix), so that keys built by mbuf_ancillary_data_build_key_buf() or
+ * mbuf_ancillary_data_build_key() are parsed back to the same name and
+ * pointer. A name buffer of strlen(key) + 1 bytes is always large enough.
+ *
+ * @param key: The ancillary key to parse.
+ * @param name: [out] The buffer receiving the NULL-terminated name.
+ * @param name_len: The size of the name buffer.
+ * @param ptr: [out] The instance pointer (0 if not present in the key).
+ *
+ * @return 0 on success, -ENOSPC if the buffer is too small, negative errno
+ *         on other errors.
+ */
+MBUF_API int mbuf_ancillary_data_parse_key_buf(const char *key,
+					       char *name,
+					       size_t name_len,
+					       uintptr_t *ptr);
+
+
+/**
+ * Intern an ancillary data key.
+ *
+ * This function returns a stable integer key for a given ancillary data name,
+ * to be used with the mbuf_xxx_frame_xxx_ancillary_xxx_by_key() functions,
+ * which neither hash nor copy the name. Interning the same name several times
+ * returns the same key. Keys are never released, so this function should be
+ * called once per name (e.g. at startup), and the number of interned keys is
+ * limited (the function returns -ENOSPC when the limit is reached).
+ *
+ * An ancillary data added with an interned key can also be accessed with its
+ * name, and vice versa.
+ *
+ * @param name: The ancillary data name.
+ * @param key: [out] The interned key (never 0).
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_ancillary_data_intern_key(const char *name, uint32_t *key);
+
+
+/**
+ * Get the name of an interned ancillary data key.
+ *
+ * @param key: The interned key.
+ *
+ * @return A NULL-terminated string containing the key name (valid for the
+ *         process lifetime), or NULL on error.
+ */
+MBUF_API const char *mbuf_ancillary_data_get_key_name(uint32_t key);
+
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
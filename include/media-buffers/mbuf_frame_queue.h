@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2026 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MBUF_FRAME_QUEUE_H_
+#define _MBUF_FRAME_QUEUE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/* Maximum number of released frames kept for reuse by each frame type */
+#define MBUF_FRAME_CACHE_MAX_SIZE 32
+
+
+/**
+ * Frame queue implementation mode, common to all frame queue types.
+ */
+enum mbuf_frame_queue_mode {
+	/**
+	 * Mutex-protected queue. Any number of producers and consumers can
+	 * use the queue concurrently. This is the default mode.
+	 */
+	MBUF_FRAME_QUEUE_MODE_LOCKED = 0,
+
+	/**
+	 * Lock-free bounded ring. Any number of producers and consumers can
+	 * use the queue concurrently, and push and pop do not allocate
+	 * memory. When the queue is full, the producer drops the oldest
+	 * frame itself. The max_frames queue argument is mandatory in this
+	 * mode, and the peek functions are not supported (they return
+	 * -EOPNOTSUPP).
+	 */
+	MBUF_FRAME_QUEUE_MODE_LOCKFREE,
+};
+
+
+/**
+ * Frame queue ordering, common to all frame queue types.
+ */
+enum mbuf_frame_queue_order {
+	/**
+	 * Frames are popped in push order. This is the default ordering.
+	 */
+	MBUF_FRAME_QUEUE_ORDER_FIFO = 0,
+
+	/**
+	 * Frames are popped by increasing frame info timestamp, and in push
+	 * order for equal timestamps.
+	 */
+	MBUF_FRAME_QUEUE_ORDER_TIMESTAMP,
+
+	/**
+	 * Frames are popped in the order defined by the queue comparison
+	 * function, and in push order for equivalent frames.
+	 */
+	MBUF_FRAME_QUEUE_ORDER_CUSTOM,
+};
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _MBUF_FRAME_QUEUE_H_ */
@@ -51,6 +51,10 @@ struct mbuf_mem_implem;
 struct mbuf_pool;
 
 
+/* Maximum number of memories kept in a pool per-thread cache */
+#define MBUF_POOL_THREAD_CACHE_MAX_SIZE 16
+
+
 /**
  * Pool behavior when a memory chunk is requested while the pool is empty.
  * For all policies, if the number of buffers is already equal to the maximum,
@@ -120,6 +124,33 @@ MBUF_API int mbuf_pool_new(const struct mbuf_mem_implem *implem,
 MBUF_API const char *mbuf_pool_get_name(struct mbuf_pool *pool);
 
 
+/**
+ * Enable the per-thread caches of a pool.
+ *
+ * When enabled, each thread keeps up to cache_size of the memories it
+ * releases in a private cache, and mbuf_pool_get() first tries to take a
+ * memory from the calling thread cache, without touching the shared pool
+ * state. Memories are only cached while the pool size does not exceed its
+ * initial capacity (or for MBUF_POOL_NO_GROW and MBUF_POOL_GROW pools), and
+ * cached memories are reclaimed from other threads before the pool grows or
+ * returns -EAGAIN, so the grow policy and maximum count are respected.
+ * The memories cached by a thread are returned to the pool when the thread
+ * exits.
+ *
+ * This function must be called before any memory is taken from the pool, and
+ * can only be called once. Each pool with per-thread caches uses one
+ * thread-specific data key.
+ *
+ * @param pool: The memory pool.
+ * @param cache_size: Maximum number of memories cached per thread, up to
+ *   MBUF_POOL_THREAD_CACHE_MAX_SIZE.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_pool_set_thread_cache_size(struct mbuf_pool *pool,
+					     size_t cache_size);
+
+
 /**
  * Get a memory from the pool.
  *
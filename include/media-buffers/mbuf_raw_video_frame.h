@@ -29,6 +29,7 @@
 
 #include <libpomp.h>
 #include <media-buffers/mbuf_ancillary_data.h>
+#include <media-buffers/mbuf_frame_queue.h>
 #include <media-buffers/mbuf_mem.h>
 #include <stdbool.h>
 #include <video-defs/vdefs.h>
@@ -40,6 +41,8 @@ extern "C" {
 
 struct mbuf_raw_video_frame;
 struct mbuf_raw_video_frame_queue;
+struct mbuf_raw_video_frame_bcast;
+struct mbuf_raw_video_frame_bcast_reader;
 
 
 /**
@@ -68,6 +71,23 @@ typedef bool (*mbuf_raw_video_frame_queue_filter_t)(
 	void *userdata);
 
 
+/**
+ * Comparison function for ordered frame queues.
+ *
+ * @param a: The first frame to compare.
+ * @param b: The second frame to compare.
+ * @param userdata: Comparison function userdata passed in
+ *                  mbuf_raw_video_frame_queue_args.
+ *
+ * @return a negative value if a must be popped before b, a positive value if
+ *         b must be popped before a, zero if both frames are equivalent.
+ */
+typedef int (*mbuf_raw_video_frame_queue_cmp_t)(
+	struct mbuf_raw_video_frame *a,
+	struct mbuf_raw_video_frame *b,
+	void *userdata);
+
+
 /**
  * Optional callback functions structure for mbuf_raw_video_frame.
  */
@@ -101,6 +121,43 @@ struct mbuf_raw_video_frame_queue_args {
 	 * be dropped.
 	 */
 	uint32_t max_frames;
+	/**
+	 * Queue implementation mode (see enum mbuf_frame_queue_mode).
+	 * The lock-free mode requires a non-zero max_frames.
+	 */
+	enum mbuf_frame_queue_mode mode;
+	/**
+	 * Maximum total payload size of the frames in the queue, in bytes
+	 * (0 means no limit). Oldest frames are dropped when a pushed frame
+	 * would exceed this limit, but a single frame larger than the limit
+	 * is always accepted. Requires the MBUF_FRAME_QUEUE_MODE_LOCKED mode
+	 * and MBUF_FRAME_QUEUE_ORDER_FIFO ordering.
+	 */
+	size_t max_bytes;
+	/**
+	 * Maximum duration of the queue, in microseconds, computed from the
+	 * frame info timestamp and timescale of the oldest frame and of the
+	 * pushed frame (0 means no limit). Same constraints as max_bytes.
+	 */
+	uint64_t max_duration_us;
+	/**
+	 * Queue ordering (see enum mbuf_frame_queue_order). Ordered queues
+	 * are backed by a binary heap: push and pop are O(log n), peek is
+	 * O(1), peek_at is only supported for index 0 and peek_range is not
+	 * supported. When the queue is full, the first frame in queue order
+	 * is dropped. FIFO queues are backed by a ring: all operations are
+	 * O(1), including peek_at.
+	 * Ordered queues require the MBUF_FRAME_QUEUE_MODE_LOCKED mode.
+	 */
+	enum mbuf_frame_queue_order order;
+	/**
+	 * Comparison function, for MBUF_FRAME_QUEUE_ORDER_CUSTOM ordering
+	 */
+	mbuf_raw_video_frame_queue_cmp_t cmp;
+	/**
+	 * Userdata for the comparison function
+	 */
+	void *cmp_userdata;
 };
 
 
@@ -121,6 +178,41 @@ MBUF_API int mbuf_raw_video_frame_new(struct vdef_raw_frame *frame_info,
 				      struct mbuf_raw_video_frame **ret_obj);
 
 
+/**
+ * Enable or disable the reuse of released raw frames.
+ *
+ * When enabled, up to cache_size released frames are kept in an internal
+ * cache so that mbuf_raw_video_frame_new() can reuse them without allocating
+ * memory. The cache is disabled by default. A frame used after its last
+ * reference is released may then be a recycled frame, and cached frames are
+ * still allocated when checking for memory leaks: the cache cannot be
+ * enabled in sanitizer builds.
+ *
+ * Reducing the cache size frees the cached frames in excess, and a
+ * cache_size of 0 disables the cache and frees all cached frames.
+ *
+ * @param cache_size: Maximum number of cached frames, up to
+ *   MBUF_FRAME_CACHE_MAX_SIZE.
+ *
+ * @return 0 on success, -EOPNOTSUPP if the cache is not supported in this
+ *   build, negative errno on error.
+ */
+MBUF_API int mbuf_raw_video_frame_cache_set_size(unsigned int cache_size);
+
+
+/**
+ * Free the released raw frames kept for reuse.
+ *
+ * When enabled by mbuf_raw_video_frame_cache_set_size(), released frames are
+ * kept in an internal cache. This function frees the cached frames, e.g.
+ * after a burst of frames or before checking for memory leaks. The cache
+ * stays enabled. It is also flushed when the library is unloaded.
+ *
+ * @return the number of freed frames.
+ */
+MBUF_API int mbuf_raw_video_frame_cache_flush(void);
+
+
 /**
  * Set the optional callback functions for a raw frame.
  *
@@ -195,6 +287,11 @@ mbuf_raw_video_frame_set_frame_info(struct mbuf_raw_video_frame *frame,
  *
  * @note Multiple frames can use the same metadata.
  *
+ * @note The previous metadata is unreferenced once the concurrent
+ * mbuf_raw_video_frame_get_metadata() calls which may have loaded it have
+ * completed, so this function may briefly wait for them. Calls started after
+ * this function do not delay it.
+ *
  * @param frame: The frame.
  * @param meta: The metadata.
  *
@@ -631,6 +728,60 @@ MBUF_API int mbuf_raw_video_frame_add_ancillary_buffer_with_cbs(
 	const struct mbuf_ancillary_data_cbs *cbs);
 
 
+/**
+ * Add a new ancillary data buffer to a given frame, without copying it.
+ *
+ * The frame takes ownership of the buffer: when the ancillary data is
+ * released, the release callback is called (or free() if the callback is
+ * NULL). On error, the ownership of the buffer stays with the caller.
+ *
+ * @note If a data with the same name already exists, the function returns
+ * -EEXIST. It does not replace the data.
+ *
+ * @param frame: The frame.
+ * @param name: The ancillary data name.
+ * @param buffer: The ancillary data buffer to adopt.
+ * @param len: The ancillary data length.
+ * @param release: Optional buffer release callback function.
+ * @param userdata: Release callback function user data.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int
+mbuf_raw_video_frame_add_ancillary_adopt(struct mbuf_raw_video_frame *frame,
+					 const char *name,
+					 void *buffer,
+					 size_t len,
+					 mbuf_ancillary_data_release_t release,
+					 void *userdata);
+
+
+/**
+ * Add a new ancillary data stored in a memory to a given frame.
+ *
+ * The ancillary data buffer is the part of the memory at the given offset,
+ * which is referenced by the ancillary data instead of being copied. This
+ * allows ancillary data to use memories from a pool.
+ *
+ * @note If a data with the same name already exists, the function returns
+ * -EEXIST. It does not replace the data.
+ *
+ * @param frame: The frame.
+ * @param name: The ancillary data name.
+ * @param mem: The memory holding the ancillary data.
+ * @param offset: The ancillary data offset in the memory.
+ * @param len: The ancillary data length.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int
+mbuf_raw_video_frame_add_ancillary_mem(struct mbuf_raw_video_frame *frame,
+				       const char *name,
+				       struct mbuf_mem *mem,
+				       size_t offset,
+				       size_t len);
+
+
 /**
  * Add an existing ancillary data to a given frame.
  *
@@ -685,6 +836,84 @@ mbuf_raw_video_frame_remove_ancillary_data(struct mbuf_raw_video_frame *frame,
 					   const char *name);
 
 
+/**
+ * Add a new ancillary data string to a given frame, using an interned key.
+ *
+ * This function behaves like mbuf_raw_video_frame_add_ancillary_string(), but
+ * the data name is the name of the interned key (see
+ * mbuf_ancillary_data_intern_key()), which is neither hashed nor copied.
+ *
+ * @param frame: The frame.
+ * @param key: The interned ancillary data key.
+ * @param value: The ancillary data value.
+ *
+ * @return 0 on success, -ENOENT if the key is not interned, negative errno on
+ *         error.
+ */
+MBUF_API int mbuf_raw_video_frame_add_ancillary_string_by_key(
+	struct mbuf_raw_video_frame *frame,
+	uint32_t key,
+	const char *value);
+
+
+/**
+ * Add a new ancillary data buffer to a given frame, using an interned key.
+ *
+ * This function behaves like mbuf_raw_video_frame_add_ancillary_buffer(), but
+ * the data name is the name of the interned key (see
+ * mbuf_ancillary_data_intern_key()), which is neither hashed nor copied.
+ *
+ * @param frame: The frame.
+ * @param key: The interned ancillary data key.
+ * @param buffer: The ancillary data buffer.
+ * @param len: The ancillary data length.
+ *
+ * @return 0 on success, -ENOENT if the key is not interned, negative errno on
+ *         error.
+ */
+MBUF_API int mbuf_raw_video_frame_add_ancillary_buffer_by_key(
+	struct mbuf_raw_video_frame *frame,
+	uint32_t key,
+	const void *buffer,
+	size_t len);
+
+
+/**
+ * Get an ancillary data from a frame, using an interned key.
+ *
+ * This function behaves like mbuf_raw_video_frame_get_ancillary_data(), without
+ * hashing nor comparing the data name when the data was added with the same
+ * key.
+ *
+ * @param frame: The frame.
+ * @param key: The interned ancillary data key.
+ * @param data: [out] The ancillary data.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_raw_video_frame_get_ancillary_data_by_key(
+	struct mbuf_raw_video_frame *frame,
+	uint32_t key,
+	struct mbuf_ancillary_data **data);
+
+
+/**
+ * Remove an ancillary data from a frame, using an interned key.
+ *
+ * This function behaves like mbuf_raw_video_frame_remove_ancillary_data(),
+ * without hashing nor comparing the data name when the data was added with the
+ * same key.
+ *
+ * @param frame: The frame.
+ * @param key: The interned ancillary data key.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_raw_video_frame_remove_ancillary_data_by_key(
+	struct mbuf_raw_video_frame *frame,
+	uint32_t key);
+
+
 /**
  * Iterate over ancillary data from a frame.
  *
@@ -797,6 +1026,36 @@ mbuf_raw_video_frame_queue_push(struct mbuf_raw_video_frame_queue *queue,
 				struct mbuf_raw_video_frame *frame);
 
 
+/**
+ * Push several frames into a queue.
+ *
+ * This function behaves like mbuf_raw_video_frame_queue_push() called on each
+ * frame, but the queue lock is taken and the queue event is signaled once for
+ * the whole batch (or once per 64 frames for large batches). Frames refused by
+ * the queue filter are skipped.
+ *
+ * All frames are checked before any frame is pushed, so that a batch with an
+ * invalid (NULL or not finalized) frame is not partially pushed. Otherwise,
+ * the frames are pushed in order and the function stops at the first frame
+ * which can not be pushed (e.g. -ENOMEM): out_count is then the index of that
+ * frame, all previous frames having been pushed or skipped by the filter, and
+ * none of the following frames having been pushed.
+ *
+ * @param queue: The queue.
+ * @param frames: The frames to push.
+ * @param count: Number of frames in the frames array.
+ * @param out_count: [out] Number of frames processed (pushed or skipped by
+ *                   the filter) from the start of the frames array.
+ *
+ * @return 0 on success (all frames processed), negative errno on error.
+ */
+MBUF_API int mbuf_raw_video_frame_queue_push_batch(
+	struct mbuf_raw_video_frame_queue *queue,
+	struct mbuf_raw_video_frame *const *frames,
+	unsigned int count,
+	unsigned int *out_count);
+
+
 /**
  * Peek a frame from a queue.
  *
@@ -808,7 +1067,8 @@ mbuf_raw_video_frame_queue_push(struct mbuf_raw_video_frame_queue *queue,
  * @param queue: The queue.
  * @param frame: [out] The first frame in the queue.
  *
- * @return 0 on success, negative errno on error.
+ * @return 0 on success, -EOPNOTSUPP for lock-free queues (see
+ *         MBUF_FRAME_QUEUE_MODE_LOCKFREE), negative errno on error.
  */
 MBUF_API int
 mbuf_raw_video_frame_queue_peek(struct mbuf_raw_video_frame_queue *queue,
@@ -828,7 +1088,8 @@ mbuf_raw_video_frame_queue_peek(struct mbuf_raw_video_frame_queue *queue,
  * @param index: Index in the queue.
  * @param frame: [out] The first frame in the queue.
  *
- * @return 0 on success, negative errno on error.
+ * @return 0 on success, -EOPNOTSUPP for lock-free queues (see
+ *         MBUF_FRAME_QUEUE_MODE_LOCKFREE), negative errno on error.
  */
 MBUF_API int
 mbuf_raw_video_frame_queue_peek_at(struct mbuf_raw_video_frame_queue *queue,
@@ -836,6 +1097,35 @@ mbuf_raw_video_frame_queue_peek_at(struct mbuf_raw_video_frame_queue *queue,
 				   struct mbuf_raw_video_frame **frame);
 
 
+/**
+ * Peek several consecutive frames from a queue.
+ *
+ * This function returns up to max_count frames in the queue starting at a
+ * given index, but does not remove them from the queue. A 0 start index
+ * corresponds to the first frame in the queue. The queue lock is taken once
+ * for the whole range (or once per 64 frames for large ranges). The returned
+ * frames are properly referenced, so the caller will need to call
+ * mbuf_raw_video_frame_unref() on each of them when they are no longer needed.
+ * This function is not supported by ordered and lock-free queues.
+ *
+ * @param queue: The queue.
+ * @param start: Index in the queue of the first frame to peek.
+ * @param frames: [out] Array of at least max_count frames.
+ * @param max_count: Maximum number of frames to peek.
+ * @param out_count: [out] Number of frames actually peeked.
+ *
+ * @return 0 on success (at least one frame peeked), -EAGAIN if the queue is
+ *         empty, -ENOENT if start is out of the queue, negative errno on
+ *         error.
+ */
+MBUF_API int
+mbuf_raw_video_frame_queue_peek_range(struct mbuf_raw_video_frame_queue *queue,
+				      unsigned int start,
+				      struct mbuf_raw_video_frame **frames,
+				      unsigned int max_count,
+				      unsigned int *out_count);
+
+
 /**
  * Pop a frame from a queue.
  *
@@ -854,6 +1144,55 @@ mbuf_raw_video_frame_queue_pop(struct mbuf_raw_video_frame_queue *queue,
 			       struct mbuf_raw_video_frame **frame);
 
 
+/**
+ * Pop a frame from a queue, waiting for a frame to be pushed if the queue is
+ * empty.
+ *
+ * This function is meant for consumer threads without a pomp_loop. It can be
+ * used together with the queue event: pushing a frame both signals the event
+ * and wakes up the waiting threads. The returned frame is properly referenced,
+ * so the caller will need to call mbuf_raw_video_frame_unref() when the frame
+ * is no longer needed.
+ *
+ * @param queue: The queue.
+ * @param frame: [out] The first frame in the queue.
+ * @param timeout_ns: Maximum time to wait in nanoseconds, 0 to return
+ *                    immediately, negative to wait forever.
+ *
+ * @return 0 on success, -ETIMEDOUT if no frame was pushed before the timeout
+ *         expired (or -EAGAIN if timeout_ns is 0 and the queue is empty),
+ *         negative errno on error.
+ */
+MBUF_API int
+mbuf_raw_video_frame_queue_pop_wait(struct mbuf_raw_video_frame_queue *queue,
+				    struct mbuf_raw_video_frame **frame,
+				    int64_t timeout_ns);
+
+
+/**
+ * Pop several frames from a queue.
+ *
+ * This function behaves like mbuf_raw_video_frame_queue_pop() called up to
+ * max_count times, but the queue lock is taken once for the whole batch (or
+ * once per 64 frames for large batches). The returned frames are properly
+ * referenced, so the caller will need to call mbuf_raw_video_frame_unref() on
+ * each of them when they are no longer needed.
+ *
+ * @param queue: The queue.
+ * @param frames: [out] Array of at least max_count frames.
+ * @param max_count: Maximum number of frames to pop.
+ * @param out_count: [out] Number of frames actually popped.
+ *
+ * @return 0 on success (at least one frame popped), -EAGAIN if the queue is
+ *         empty, negative errno on error.
+ */
+MBUF_API int
+mbuf_raw_video_frame_queue_pop_batch(struct mbuf_raw_video_frame_queue *queue,
+				     struct mbuf_raw_video_frame **frames,
+				     unsigned int max_count,
+				     unsigned int *out_count);
+
+
 /**
  * Flush a queue.
  *
@@ -917,6 +1256,140 @@ mbuf_raw_video_frame_queue_get_count(struct mbuf_raw_video_frame_queue *queue);
 MBUF_API int
 mbuf_raw_video_frame_queue_destroy(struct mbuf_raw_video_frame_queue *queue);
 
+
+/* Broadcast queue API */
+
+
+/**
+ * Create a new raw frame broadcast queue.
+ *
+ * A broadcast queue delivers each pushed frame to all its readers (see
+ * mbuf_raw_video_frame_bcast_reader_new()). The frames are stored once in a
+ * shared ring, with a single reference per frame, and each reader has its own
+ * read cursor. A frame is released once all readers have popped or dropped it.
+ *
+ * If the ring is full when a frame is pushed, the oldest frame is dropped for
+ * the readers which have not popped it yet.
+ *
+ * @param max_frames: Size of the ring, must not be zero.
+ * @param ret_obj: [out] The new broadcast queue.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int
+mbuf_raw_video_frame_bcast_new(unsigned int max_frames,
+			       struct mbuf_raw_video_frame_bcast **ret_obj);
+
+
+/**
+ * Push a frame into a broadcast queue.
+ *
+ * This call does not transfer ownership of the frame, the broadcast queue will
+ * reference the frame internally. If the broadcast queue has no readers, the
+ * frame is released immediately.
+ *
+ * @param bcast: The broadcast queue.
+ * @param frame: The frame to push.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int
+mbuf_raw_video_frame_bcast_push(struct mbuf_raw_video_frame_bcast *bcast,
+				struct mbuf_raw_video_frame *frame);
+
+
+/**
+ * Destroy a broadcast queue.
+ *
+ * All readers must have been destroyed before calling this function.
+ *
+ * @param bcast: The broadcast queue.
+ *
+ * @return 0 on success, -EBUSY if the broadcast queue still has readers,
+ *         negative errno on error.
+ */
+MBUF_API int
+mbuf_raw_video_frame_bcast_destroy(struct mbuf_raw_video_frame_bcast *bcast);
+
+
+/**
+ * Create a new reader on a broadcast queue.
+ *
+ * The reader will receive the frames pushed after its creation. The
+ * max_frames parameter limits the number of frames pending for this reader:
+ * if a frame is pushed while max_frames frames are pending, the oldest frame
+ * is dropped for this reader only. If max_frames is zero, the reader is only
+ * limited by the broadcast queue size.
+ *
+ * @param bcast: The broadcast queue.
+ * @param max_frames: Maximum number of pending frames for this reader.
+ * @param ret_obj: [out] The new reader.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_raw_video_frame_bcast_reader_new(
+	struct mbuf_raw_video_frame_bcast *bcast,
+	unsigned int max_frames,
+	struct mbuf_raw_video_frame_bcast_reader **ret_obj);
+
+
+/**
+ * Pop a frame from a broadcast queue reader.
+ *
+ * This function returns the oldest frame pending for this reader (or -EAGAIN if
+ * there is none). The returned frame is properly referenced, so the caller will
+ * need to call mbuf_raw_video_frame_unref() when the frame is no longer needed.
+ *
+ * @param reader: The reader.
+ * @param frame: [out] The oldest pending frame.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_raw_video_frame_bcast_reader_pop(
+	struct mbuf_raw_video_frame_bcast_reader *reader,
+	struct mbuf_raw_video_frame **frame);
+
+
+/**
+ * Get the pomp_evt associated with a broadcast queue reader.
+ *
+ * The event is signaled when a frame is pushed into the broadcast queue, and
+ * cleared when the reader pops its last pending frame.
+ *
+ * @param reader: The reader.
+ * @param evt: [out] The reader event.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_raw_video_frame_bcast_reader_get_event(
+	struct mbuf_raw_video_frame_bcast_reader *reader,
+	struct pomp_evt **evt);
+
+
+/**
+ * Get the number of frames pending for a broadcast queue reader.
+ *
+ * @param reader: The reader.
+ *
+ * @return the pending frame count on success, negative errno on error.
+ */
+MBUF_API int mbuf_raw_video_frame_bcast_reader_get_count(
+	struct mbuf_raw_video_frame_bcast_reader *reader);
+
+
+/**
+ * Destroy a broadcast queue reader.
+ *
+ * The frames pending for this reader are dropped. The reader event must not be
+ * attached to any loop when this function is called.
+ *
+ * @param reader: The reader.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+MBUF_API int mbuf_raw_video_frame_bcast_reader_destroy(
+	struct mbuf_raw_video_frame_bcast_reader *reader);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
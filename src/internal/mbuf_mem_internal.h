@@ -64,7 +64,10 @@ struct mbuf_mem_implem {
 	 * This function allows late binding of memory (so an in-pool memory
 	 * does not actually consumes memory)
 	 *
-	 * If this function returns an error, the pool_get call will be aborted.
+	 * If this function returns -EBUSY, the memory is considered as still
+	 * in use (e.g. by another process), and the pool_get call will try
+	 * another memory. If this function returns any other error, the
+	 * pool_get call will be aborted.
 	 *
 	 * @param mem: The memory to initialize
 	 * @param specific: The implementation specific data.
@@ -111,19 +114,59 @@ struct mbuf_mem {
 	atomic_uint refcount;
 	struct mbuf_pool *pool;
 	struct list_node node;
+
+	/* Index of the memory in its pool, and index + 1 of the next memory
+	 * in the pool free stack (0 if this memory is the last one) */
+	uint32_t index;
+	atomic_uint_least32_t free_next;
+};
+
+/* Per-thread memory cache of a pool. The slots are only filled by the owner
+ * thread, but can be emptied by any thread */
+struct mbuf_pool_cache {
+	struct mbuf_pool *pool;
+	struct mbuf_mem *_Atomic mems[MBUF_POOL_THREAD_CACHE_MAX_SIZE];
+	struct list_node node;
 };
 
+/* Maximum number of descriptor segments in a pool */
+#define MBUF_POOL_SEGMENT_COUNT 32
+
 struct mbuf_pool {
 	const struct mbuf_mem_implem *implem;
 	enum mbuf_pool_grow_policy policy;
 	size_t mem_size;
 	size_t initial_mem_count;
 	size_t max_mem_count;
-	size_t mem_count;
-	size_t mem_free;
-	struct list_node memories;
+	atomic_size_t mem_count;
+	atomic_size_t mem_free;
 	char *name;
 
+	/* Lock-free stack of free memories. The low 32 bits hold the index + 1
+	 * of the top memory (0 if the stack is empty), the high 32 bits hold a
+	 * tag incremented on each update to avoid ABA issues */
+	atomic_uint_least64_t free_head;
+
+	/* Memory descriptors storage: segment 0 holds segment_size
+	 * descriptors, segment n (n > 0) holds segment_size << (n - 1)
+	 * descriptors. Descriptors never move nor are freed before the pool
+	 * is destroyed, so the free stack can safely reference them */
+	struct mbuf_mem *segments[MBUF_POOL_SEGMENT_COUNT];
+	size_t segment_size;
+	uint32_t next_index;
+
+	/* Allocated memories, and released descriptors available for reuse */
+	struct list_node memories;
+	struct list_node spares;
+
+	/* Per-thread caches (cache_size is 0 if disabled) */
+	size_t cache_size;
+	pthread_key_t cache_key;
+	bool cache_key_created;
+	struct list_node caches;
+
+	/* The lock is only taken to grow or shrink the pool, and to register
+	 * or reclaim per-thread caches */
 	pthread_mutex_t lock;
 	bool lock_created;
 };
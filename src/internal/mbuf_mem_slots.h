@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2026 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MBUF_MEM_SLOTS_H_
+#define _MBUF_MEM_SLOTS_H_
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/* Fixed set of memory slots, identified by their index, for implementations
+ * carving their memories from a single mapping. The free slots are kept in a
+ * stack protected by a mutex. */
+struct mbuf_mem_slots {
+	pthread_mutex_t lock;
+	/* Stack of free slot indexes */
+	size_t *free_slots;
+	size_t free_count;
+	size_t count;
+};
+
+
+/* Initialize the slots, all slots are initially free */
+static inline int mbuf_mem_slots_init(struct mbuf_mem_slots *slots,
+				      size_t count)
+{
+	slots->free_slots = calloc(count, sizeof(*slots->free_slots));
+	if (!slots->free_slots)
+		return -ENOMEM;
+	/* Push the slots in reverse order so that the first allocations use
+	 * the first slots */
+	for (size_t i = 0; i < count; i++)
+		slots->free_slots[i] = count - i - 1;
+	slots->free_count = count;
+	slots->count = count;
+	pthread_mutex_init(&slots->lock, NULL);
+
+	return 0;
+}
+
+
+/* Release the slots; can be called on zero-initialized slots */
+static inline void mbuf_mem_slots_deinit(struct mbuf_mem_slots *slots)
+{
+	if (!slots->free_slots)
+		return;
+	free(slots->free_slots);
+	slots->free_slots = NULL;
+	pthread_mutex_destroy(&slots->lock);
+}
+
+
+/* Take a free slot; returns -ENOMEM if all slots are used */
+static inline int mbuf_mem_slots_take(struct mbuf_mem_slots *slots,
+				      size_t *ret_index)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&slots->lock);
+	if (slots->free_count == 0)
+		ret = -ENOMEM;
+	else
+		*ret_index = slots->free_slots[--slots->free_count];
+	pthread_mutex_unlock(&slots->lock);
+
+	return ret;
+}
+
+
+/* Give back a slot taken with mbuf_mem_slots_take() */
+static inline void mbuf_mem_slots_release(struct mbuf_mem_slots *slots,
+					  size_t index)
+{
+	pthread_mutex_lock(&slots->lock);
+	slots->free_slots[slots->free_count++] = index;
+	pthread_mutex_unlock(&slots->lock);
+}
+
+
+/* Number of slots currently taken */
+static inline size_t mbuf_mem_slots_used(struct mbuf_mem_slots *slots)
+{
+	size_t used;
+
+	pthread_mutex_lock(&slots->lock);
+	used = slots->count - slots->free_count;
+	pthread_mutex_unlock(&slots->lock);
+
+	return used;
+}
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _MBUF_MEM_SLOTS_H_ */
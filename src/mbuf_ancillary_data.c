@@ -25,13 +25,17 @@
  */
 
 #include <media-buffers/mbuf_ancillary_data.h>
+#include <media-buffers/mbuf_mem.h>
 
 #include "mbuf_internal.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define ULOG_TAG mbuf_ancillary_data
 #include <ulog.h>
@@ -41,6 +45,153 @@ ULOG_DECLARE_TAG(ULOG_TAG);
 const char *MBUF_ANCILLARY_KEY_USERDATA_SEI = "mbuf.userdata_sei";
 
 
+/* Maximum number of interned keys (including the invalid key 0) */
+#define MBUF_ANCILLARY_KEY_MAX 256
+
+
+struct mbuf_ancillary_key {
+	const char *name;
+	uint32_t hash;
+};
+
+
+/* Interned keys registry: keys are never removed, so a key below the count
+ * can be read without locking once the count has been loaded */
+static struct mbuf_ancillary_key s_keys[MBUF_ANCILLARY_KEY_MAX];
+static atomic_uint s_keys_count;
+static pthread_mutex_t s_keys_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t s_keys_once = PTHREAD_ONCE_INIT;
+
+
+static void mbuf_ancillary_keys_init(void)
+{
+	/* Pre-interned well-known keys */
+	s_keys[MBUF_ANCILLARY_KEY_ID_USERDATA_SEI].name =
+		MBUF_ANCILLARY_KEY_USERDATA_SEI;
+	s_keys[MBUF_ANCILLARY_KEY_ID_USERDATA_SEI].hash =
+		mbuf_ancillary_data_hash(MBUF_ANCILLARY_KEY_USERDATA_SEI);
+
+	atomic_store(&s_keys_count, MBUF_ANCILLARY_KEY_ID_USERDATA_SEI + 1);
+}
+
+
+/* If key is not 0, name must be the interned key name (it is not copied),
+ * otherwise the name is stored inline after inline_len bytes of payload */
+struct mbuf_ancillary_data *
+mbuf_ancillary_data_alloc(uint32_t key, const char *name, size_t inline_len)
+{
+	struct mbuf_ancillary_data *data;
+	size_t name_len = key == 0 ? strlen(name) + 1 : 0;
+
+	data = malloc(sizeof(*data) + inline_len + name_len);
+	if (!data)
+		return NULL;
+	memset(data, 0, sizeof(*data));
+
+	/* Initialize ref_count to 1, the caller will unref it later */
+	atomic_init(&data->ref_count, 1);
+
+	data->key = key;
+	if (key != 0) {
+		/* Interned names are owned by the keys registry */
+		data->name = (char *)name;
+	} else {
+		data->name = (char *)data->storage + inline_len;
+		memcpy(data->name, name, name_len);
+	}
+	/* The buffer is valid even for an empty payload */
+	data->buffer = data->storage;
+
+	return data;
+}
+
+
+/* FNV-1a hash of an ancillary data name */
+uint32_t mbuf_ancillary_data_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	for (; *name != '\0'; name++) {
+		hash ^= (uint8_t)*name;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+int mbuf_ancillary_key_lookup(uint32_t key, const char **name, uint32_t *hash)
+{
+	pthread_once(&s_keys_once, mbuf_ancillary_keys_init);
+
+	if (key == 0 || key >= atomic_load(&s_keys_count))
+		return -ENOENT;
+
+	*name = s_keys[key].name;
+	*hash = s_keys[key].hash;
+	return 0;
+}
+
+
+int mbuf_ancillary_data_intern_key(const char *name, uint32_t *key)
+{
+	int ret = 0;
+	uint32_t hash, count;
+	char *dup;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!name, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!key, EINVAL);
+
+	*key = 0;
+
+	pthread_once(&s_keys_once, mbuf_ancillary_keys_init);
+	hash = mbuf_ancillary_data_hash(name);
+
+	pthread_mutex_lock(&s_keys_lock);
+
+	count = atomic_load(&s_keys_count);
+	for (uint32_t i = 1; i < count; i++) {
+		if (s_keys[i].hash != hash || strcmp(s_keys[i].name, name) != 0)
+			continue;
+		*key = i;
+		goto out;
+	}
+
+	if (count == MBUF_ANCILLARY_KEY_MAX) {
+		ret = -ENOSPC;
+		ULOG_ERRNO("too many interned keys", -ret);
+		goto out;
+	}
+
+	dup = strdup(name);
+	if (!dup) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	s_keys[count].name = dup;
+	s_keys[count].hash = hash;
+	/* Publish the key once it is fully initialized */
+	atomic_store(&s_keys_count, count + 1);
+	*key = count;
+
+out:
+	pthread_mutex_unlock(&s_keys_lock);
+	return ret;
+}
+
+
+const char *mbuf_ancillary_data_get_key_name(uint32_t key)
+{
+	const char *name;
+	uint32_t hash;
+
+	int ret = mbuf_ancillary_key_lookup(key, &name, &hash);
+	ULOG_ERRNO_RETURN_VAL_IF(ret != 0, -ret, NULL);
+
+	return name;
+}
+
+
 int mbuf_ancillary_data_ref(struct mbuf_ancillary_data *data)
 {
 	ULOG_ERRNO_RETURN_ERR_IF(!data, EINVAL);
@@ -64,8 +215,13 @@ int mbuf_ancillary_data_unref(struct mbuf_ancillary_data *data)
 	if (data->cbs.cleaner)
 		data->cbs.cleaner(data, data->cbs.cleaner_userdata);
 
-	free(data->name);
-	free(data->buffer);
+	/* The name and copied payloads are stored inline */
+	if (data->mem)
+		mbuf_mem_unref(data->mem);
+	else if (data->release)
+		data->release(data->buffer, data->len, data->release_userdata);
+	else if (data->buffer != (void *)data->storage)
+		free(data->buffer);
 	free(data);
 
 	return 0;
@@ -135,45 +291,98 @@ int mbuf_ancillary_data_build_key(const char *name, uintptr_t ptr, char **key)
 int mbuf_ancillary_data_parse_key(const char *key, char **name, uintptr_t *ptr)
 {
 	int ret;
-	char *_key = NULL, *_name = NULL, *_ptr_str = NULL;
-	char *savedptr = NULL;
+	size_t name_len;
+	uintptr_t _ptr;
 
 	ULOG_ERRNO_RETURN_ERR_IF(!key, EINVAL);
 	ULOG_ERRNO_RETURN_ERR_IF(!name, EINVAL);
 
-	_key = strdup(key);
-	if (_key == NULL)
+	*name = NULL;
+	if (ptr)
+		*ptr = 0;
+
+	/* The name is never longer than the key */
+	name_len = strlen(key) + 1;
+	*name = malloc(name_len);
+	if (*name == NULL)
 		return -ENOMEM;
 
-	*name = NULL;
+	ret = mbuf_ancillary_data_parse_key_buf(key, *name, name_len, &_ptr);
+	if (ret != 0) {
+		free(*name);
+		*name = NULL;
+		return ret;
+	}
+	if (ptr)
+		*ptr = _ptr;
+
+	return 0;
+}
+
+
+int mbuf_ancillary_data_build_key_buf(const char *name,
+				      uintptr_t ptr,
+				      char *key,
+				      size_t key_len)
+{
+	int ret;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!name, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!key, EINVAL);
+
+	if (ptr != 0)
+		ret = snprintf(key, key_len, "%s:%" PRIxPTR, name, ptr);
+	else
+		ret = snprintf(key, key_len, "%s", name);
+	if (ret < 0)
+		return -EINVAL;
+	if ((size_t)ret >= key_len)
+		return -ENOSPC;
+
+	return 0;
+}
+
+
+int mbuf_ancillary_data_parse_key_buf(const char *key,
+				      char *name,
+				      size_t name_len,
+				      uintptr_t *ptr)
+{
+	const char *sep;
+	size_t len;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!key, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!name, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!ptr, EINVAL);
+
 	*ptr = 0;
 
-	_name = strtok_r(_key, ":", &savedptr);
-	_ptr_str = strtok_r(NULL, ":", &savedptr);
+	sep = strchr(key, ':');
+	len = sep ? (size_t)(sep - key) : strlen(key);
+	if (len == 0)
+		return -EINVAL;
+	if (len >= name_len)
+		return -ENOSPC;
 
-	if (_name == NULL) {
-		ret = -EINVAL;
-		goto out;
-	}
-	if (_ptr_str != NULL) {
+	if (sep) {
+		/* Hexadecimal pointer, as written by the build functions (an
+		 * optional 0x prefix is accepted, but no sign or spaces) */
 		char *end_ptr = NULL;
+		if (!isxdigit((unsigned char)sep[1]))
+			return -EINVAL;
 		errno = 0;
-		long unsigned int parsed_ulong = strtoul(_ptr_str, &end_ptr, 0);
-		if (_ptr_str[0] == '\0' || end_ptr[0] != '\0' || errno != 0) {
-			ret = -errno;
-			goto out;
-		}
-		*ptr = (uintptr_t)parsed_ulong;
-	}
-	*name = strdup(_name);
-	if (*name == NULL) {
-		ret = -ENOMEM;
-		goto out;
+		uintmax_t parsed = strtoumax(sep + 1, &end_ptr, 16);
+		if (end_ptr[0] != '\0')
+			return -EINVAL;
+		if (errno != 0)
+			return -errno;
+		if (parsed > UINTPTR_MAX)
+			return -ERANGE;
+		*ptr = (uintptr_t)parsed;
 	}
 
-	ret = 0;
+	memcpy(name, key, len);
+	name[len] = '\0';
 
-out:
-	free(_key);
-	return ret;
+	return 0;
 }
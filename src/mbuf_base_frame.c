@@ -28,7 +28,10 @@
 #include "mbuf_internal.h"
 
 #include <errno.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include <libpomp.h>
 #include <video-metadata/vmeta.h>
@@ -38,11 +41,97 @@
 ULOG_DECLARE_TAG(ULOG_TAG);
 
 
-struct mbuf_ancillary_data_holder {
-	struct mbuf_ancillary_data *data;
+/* Initial number of ancillary data entries of a frame */
+#define MBUF_ANCILLARY_DATA_MIN_CAPACITY 8
 
-	struct list_node node;
-};
+
+/* Ancillary data set */
+
+
+/* Returns the index of the entry with the given name, or -ENOENT; entries
+ * with the same interned key (if not 0) match without comparing the names */
+static int mbuf_ancillary_set_find(const struct mbuf_ancillary_set *set,
+				   const char *name,
+				   uint32_t hash,
+				   uint32_t key)
+{
+	const struct mbuf_ancillary_data_entry *entry;
+	unsigned int mask, slot;
+
+	if (!set || set->count == 0)
+		return -ENOENT;
+
+	mask = 2 * set->capacity - 1;
+	for (slot = hash & mask; set->index[slot] != 0;
+	     slot = (slot + 1) & mask) {
+		entry = &set->entries[set->index[slot] - 1];
+		if (entry->hash != hash)
+			continue;
+		if ((key != 0 && entry->key == key) ||
+		    strcmp(entry->data->name, name) == 0)
+			return set->index[slot] - 1;
+	}
+
+	return -ENOENT;
+}
+
+
+/* Rebuilds the hash index from the entries (the index is at most half
+ * full, so probing always ends) */
+static void mbuf_ancillary_set_reindex(struct mbuf_ancillary_set *set)
+{
+	unsigned int mask = 2 * set->capacity - 1;
+	unsigned int slot;
+
+	memset(set->index, 0, 2 * set->capacity * sizeof(*set->index));
+	for (unsigned int i = 0; i < set->count; i++) {
+		slot = set->entries[i].hash & mask;
+		while (set->index[slot] != 0)
+			slot = (slot + 1) & mask;
+		set->index[slot] = i + 1;
+	}
+}
+
+
+/* Allocates an ancillary data set of the given capacity, with a copy of
+ * the entries of src (if not NULL) which are referenced again */
+static struct mbuf_ancillary_set *
+mbuf_ancillary_set_new(unsigned int capacity,
+		       const struct mbuf_ancillary_set *src)
+{
+	struct mbuf_ancillary_set *set;
+
+	set = malloc(sizeof(*set) + capacity * sizeof(set->entries[0]) +
+		     2 * capacity * sizeof(*set->index));
+	if (!set)
+		return NULL;
+
+	atomic_init(&set->refcount, 1);
+	set->count = 0;
+	set->capacity = capacity;
+	set->index = (unsigned int *)&set->entries[capacity];
+	if (src) {
+		for (unsigned int i = 0; i < src->count; i++) {
+			set->entries[i] = src->entries[i];
+			mbuf_ancillary_data_ref(set->entries[i].data);
+		}
+		set->count = src->count;
+	}
+	mbuf_ancillary_set_reindex(set);
+
+	return set;
+}
+
+
+static void mbuf_ancillary_set_unref(struct mbuf_ancillary_set *set)
+{
+	if (atomic_fetch_sub(&set->refcount, 1) != 1)
+		return;
+
+	for (unsigned int i = 0; i < set->count; i++)
+		mbuf_ancillary_data_unref(set->entries[i].data);
+	free(set);
+}
 
 
 /* Frame API */
@@ -55,49 +144,172 @@ int mbuf_base_frame_init(struct mbuf_base_frame *frame,
 	int ret;
 	atomic_init(&frame->refcount, 1);
 	atomic_init(&frame->finalized, false);
+	atomic_init(&frame->meta, NULL);
+	atomic_init(&frame->meta_readers[0], 0);
+	atomic_init(&frame->meta_readers[1], 0);
+	atomic_init(&frame->meta_epoch, 0);
+	atomic_init(&frame->meta_writer, false);
 	mbuf_rwlock_init(&frame->rwlock);
 
 	frame->parent = parent;
 	frame->cleaner = cleanup_cb;
 
-	list_init(&frame->ancillary_data);
-
 	ret = pthread_mutex_init(&frame->ancillary_lock, NULL);
 	if (ret != 0)
 		return -ret;
 	frame->ancillary_lock_created = true;
 
-	ret = pthread_mutex_init(&frame->meta_lock, NULL);
-	if (ret != 0)
-		return -ret;
-	frame->meta_lock_created = true;
-
 	return 0;
 }
 
 
-int mbuf_base_frame_deinit(struct mbuf_base_frame *frame)
+/* Releases the metadata and ancillary data of a frame which is no longer
+ * referenced, but keeps its ancillary lock */
+static void mbuf_base_frame_release(struct mbuf_base_frame *frame)
 {
-	struct mbuf_ancillary_data_holder *holder, *tmp;
+	struct vmeta_frame *meta;
 
-	if (frame->meta_lock_created) {
-		mbuf_base_frame_set_metadata(frame, NULL);
-		pthread_mutex_destroy(&frame->meta_lock);
-	}
+	/* The frame is no longer referenced, so there can be no readers */
+	meta = atomic_exchange(&frame->meta, NULL);
+	if (meta)
+		vmeta_frame_unref(meta);
 
 	if (!frame->ancillary_lock_created)
-		return 0;
+		return;
 	pthread_mutex_lock(&frame->ancillary_lock);
 
-	list_walk_entry_forward_safe(&frame->ancillary_data, holder, tmp, node)
-	{
-		mbuf_ancillary_data_unref(holder->data);
-		list_del(&holder->node);
-		free(holder);
-	}
+	if (frame->ancillary)
+		mbuf_ancillary_set_unref(frame->ancillary);
+	frame->ancillary = NULL;
 
 	pthread_mutex_unlock(&frame->ancillary_lock);
+}
+
+
+int mbuf_base_frame_deinit(struct mbuf_base_frame *frame)
+{
+	mbuf_base_frame_release(frame);
+
+	if (!frame->ancillary_lock_created)
+		return 0;
 	pthread_mutex_destroy(&frame->ancillary_lock);
+	frame->ancillary_lock_created = false;
+	return 0;
+}
+
+
+void *mbuf_base_frame_cache_get(struct mbuf_base_frame_cache *cache)
+{
+	struct mbuf_base_frame *frame;
+
+	if (atomic_load_explicit(&cache->maxcount, memory_order_relaxed) == 0)
+		return NULL;
+
+	/* Do not wait for a contended cache, allocating a new frame is
+	 * cheaper */
+	if (pthread_mutex_trylock(&cache->lock) != 0)
+		return NULL;
+	frame = cache->frames;
+	if (frame) {
+		cache->frames = frame->cache_next;
+		cache->count--;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	if (!frame)
+		return NULL;
+
+	/* Same state as after mbuf_base_frame_init(), the parent, the
+	 * cleaner and the ancillary lock are kept */
+	frame->cache_next = NULL;
+	atomic_store(&frame->refcount, 1);
+	atomic_store(&frame->finalized, false);
+	atomic_store(&frame->meta_readers[0], 0);
+	atomic_store(&frame->meta_readers[1], 0);
+	mbuf_rwlock_init(&frame->rwlock);
+
+	return frame->parent;
+}
+
+
+bool mbuf_base_frame_cache_put(struct mbuf_base_frame_cache *cache,
+			       struct mbuf_base_frame *frame)
+{
+	bool cached = false;
+
+	mbuf_base_frame_release(frame);
+	if (!frame->ancillary_lock_created)
+		return false;
+	if (atomic_load_explicit(&cache->maxcount, memory_order_relaxed) == 0)
+		return false;
+
+	/* Do not wait for a contended cache, the frame is freed instead */
+	if (pthread_mutex_trylock(&cache->lock) != 0)
+		return false;
+	if (cache->count < atomic_load(&cache->maxcount)) {
+		frame->cache_next = cache->frames;
+		cache->frames = frame;
+		cache->count++;
+		cached = true;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return cached;
+}
+
+
+unsigned int mbuf_base_frame_cache_flush(struct mbuf_base_frame_cache *cache,
+					 void (*destroy)(void *parent))
+{
+	struct mbuf_base_frame *frames, *frame;
+	unsigned int count;
+
+	pthread_mutex_lock(&cache->lock);
+	frames = cache->frames;
+	count = cache->count;
+	cache->frames = NULL;
+	cache->count = 0;
+	pthread_mutex_unlock(&cache->lock);
+
+	while (frames) {
+		frame = frames;
+		frames = frame->cache_next;
+		frame->cache_next = NULL;
+		destroy(frame->parent);
+	}
+
+	return count;
+}
+
+
+int mbuf_base_frame_cache_set_size(struct mbuf_base_frame_cache *cache,
+				   unsigned int size,
+				   void (*destroy)(void *parent))
+{
+	struct mbuf_base_frame *frames = NULL, *frame;
+
+	ULOG_ERRNO_RETURN_ERR_IF(size > MBUF_FRAME_CACHE_MAX_SIZE, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!MBUF_BASE_FRAME_CACHE_SUPPORTED && size > 0,
+				 EOPNOTSUPP);
+
+	pthread_mutex_lock(&cache->lock);
+	atomic_store(&cache->maxcount, size);
+	while (cache->count > size) {
+		frame = cache->frames;
+		cache->frames = frame->cache_next;
+		cache->count--;
+		frame->cache_next = frames;
+		frames = frame;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	while (frames) {
+		frame = frames;
+		frames = frame->cache_next;
+		frame->cache_next = NULL;
+		destroy(frame->parent);
+	}
+
 	return 0;
 }
 
@@ -127,33 +339,44 @@ int mbuf_base_frame_set_metadata(struct mbuf_base_frame *frame,
 				 struct vmeta_frame *meta)
 {
 	int ret;
+	struct vmeta_frame *old;
 
-	pthread_mutex_lock(&frame->meta_lock);
-
-	/* Remove old metadata if present */
-	if (frame->meta) {
-		ret = vmeta_frame_unref(frame->meta);
-		if (ret != 0) {
-			ULOG_ERRNO("vmeta_frame_unref", -ret);
-			goto out;
-		}
-		frame->meta = NULL;
-	}
-
-	/* Add new metadata if given */
+	/* Reference the new metadata before publishing it */
 	if (meta) {
 		ret = vmeta_frame_ref(meta);
 		if (ret != 0) {
 			ULOG_ERRNO("vmeta_frame_ref", -ret);
-			goto out;
+			return ret;
 		}
-		frame->meta = meta;
 	}
 
-	ret = 0;
+	while (atomic_exchange(&frame->meta_writer, true))
+		sched_yield();
+
+	old = atomic_exchange(&frame->meta, meta);
+	if (old) {
+		/* Readers which may have loaded the old pointer registered
+		 * themselves in one of the slots before loading it. Each flip
+		 * of the epoch sends the new readers to the other slot, so
+		 * the slot which is then waited for only holds readers which
+		 * started before the flip: the wait is bounded by the
+		 * duration of the get_metadata() calls in progress, and can
+		 * not be extended by new readers */
+		for (unsigned int i = 0; i < 2; i++) {
+			unsigned int slot =
+				atomic_fetch_add(&frame->meta_epoch, 1) & 1;
+			while (atomic_load(&frame->meta_readers[slot]) != 0)
+				sched_yield();
+		}
+	}
 
-out:
-	pthread_mutex_unlock(&frame->meta_lock);
+	atomic_store(&frame->meta_writer, false);
+
+	if (!old)
+		return 0;
+	ret = vmeta_frame_unref(old);
+	if (ret != 0)
+		ULOG_ERRNO("vmeta_frame_unref", -ret);
 	return ret;
 }
 
@@ -161,26 +384,43 @@ out:
 int mbuf_base_frame_get_metadata(struct mbuf_base_frame *frame,
 				 struct vmeta_frame **meta)
 {
-	int ret;
+	int ret = -ENOENT;
+	struct vmeta_frame *cur;
+	unsigned int slot;
 
 	*meta = NULL;
 
-	pthread_mutex_lock(&frame->meta_lock);
-
-	if (!frame->meta) {
-		ret = -ENOENT;
-		goto out;
+	/* Lock-free read path: the reader count prevents a concurrent
+	 * set_metadata() from releasing the loaded pointer before it is
+	 * referenced */
+	slot = atomic_load(&frame->meta_epoch) & 1;
+	atomic_fetch_add(&frame->meta_readers[slot], 1);
+	cur = atomic_load(&frame->meta);
+	if (cur) {
+		ret = vmeta_frame_ref(cur);
+		if (ret == 0)
+			*meta = cur;
 	}
+	atomic_fetch_sub(&frame->meta_readers[slot], 1);
 
-	ret = vmeta_frame_ref(frame->meta);
-	if (ret != 0)
-		goto out;
+	return ret;
+}
 
-	*meta = frame->meta;
 
-	ret = 0;
-out:
-	pthread_mutex_unlock(&frame->meta_lock);
+int mbuf_base_frame_copy_metadata(struct mbuf_base_frame *dst,
+				  struct mbuf_base_frame *src)
+{
+	int ret;
+	struct vmeta_frame *meta;
+
+	ret = mbuf_base_frame_get_metadata(src, &meta);
+	if (ret == -ENOENT)
+		return 0;
+	else if (ret != 0)
+		return ret;
+
+	ret = mbuf_base_frame_set_metadata(dst, meta);
+	vmeta_frame_unref(meta);
 	return ret;
 }
 
@@ -221,38 +461,82 @@ int mbuf_base_frame_wrunlock(struct mbuf_base_frame *frame)
 }
 
 
+/* Must be called with the ancillary lock held, makes the frame set private
+ * to the frame and able to hold extra more entries: a set shared with other
+ * frames (or too small) is replaced by a copy. As the set is only
+ * referenced again by a frame holding it under its ancillary lock, a
+ * reference count of 1 means that no other frame can see the set */
+static int mbuf_base_frame_writable_ancillary(struct mbuf_base_frame *frame,
+					      unsigned int extra)
+{
+	struct mbuf_ancillary_set *set = frame->ancillary;
+	unsigned int capacity = MBUF_ANCILLARY_DATA_MIN_CAPACITY;
+
+	if (set && atomic_load(&set->refcount) == 1 &&
+	    set->count + extra <= set->capacity)
+		return 0;
+
+	if (set) {
+		capacity = set->capacity;
+		while (set->count + extra > capacity)
+			capacity *= 2;
+	}
+	frame->ancillary = mbuf_ancillary_set_new(capacity, set);
+	if (!frame->ancillary) {
+		frame->ancillary = set;
+		return -ENOMEM;
+	}
+	if (set)
+		mbuf_ancillary_set_unref(set);
+
+	return 0;
+}
+
+
 static int
 mbuf_base_frame_add_ancillary_internal(struct mbuf_base_frame *frame,
 				       struct mbuf_ancillary_data *data)
 {
 	int ret = 0;
-	struct mbuf_ancillary_data_holder *holder;
+	struct mbuf_ancillary_set *set;
+	struct mbuf_ancillary_data_entry *entry;
+	const char *name;
+	uint32_t hash;
+	unsigned int mask, slot;
+
+	if (data->key == 0)
+		hash = mbuf_ancillary_data_hash(data->name);
+	else if (mbuf_ancillary_key_lookup(data->key, &name, &hash) != 0)
+		return -EPROTO;
 
 	pthread_mutex_lock(&frame->ancillary_lock);
 
-	list_walk_entry_forward(&frame->ancillary_data, holder, node)
-	{
-		if (strcmp(data->name, holder->data->name) == 0) {
-			ret = -EEXIST;
-			goto out;
-		}
+	ret = mbuf_ancillary_set_find(
+		frame->ancillary, data->name, hash, data->key);
+	if (ret >= 0) {
+		ret = -EEXIST;
+		goto out;
 	}
 
-	holder = calloc(1, sizeof(*holder));
-	if (!holder) {
-		ret = -ENOMEM;
+	ret = mbuf_base_frame_writable_ancillary(frame, 1);
+	if (ret != 0)
 		goto out;
-	}
 
 	ret = mbuf_ancillary_data_ref(data);
-	if (ret != 0) {
-		free(holder);
+	if (ret != 0)
 		goto out;
-	}
 
-	holder->data = data;
+	set = frame->ancillary;
+	entry = &set->entries[set->count++];
+	entry->data = data;
+	entry->hash = hash;
+	entry->key = data->key;
 
-	list_add_before(&frame->ancillary_data, &holder->node);
+	mask = 2 * set->capacity - 1;
+	slot = hash & mask;
+	while (set->index[slot] != 0)
+		slot = (slot + 1) & mask;
+	set->index[slot] = set->count;
 
 out:
 	pthread_mutex_unlock(&frame->ancillary_lock);
@@ -260,44 +544,34 @@ out:
 }
 
 
+/* If key is not 0, name must be the interned key name (it is not copied) */
 static int mbuf_base_frame_create_ancillary_internal(
 	struct mbuf_base_frame *frame,
+	uint32_t key,
 	const char *name,
 	const void *buffer,
 	size_t len,
 	bool is_string,
 	const struct mbuf_ancillary_data_cbs *cbs)
 {
-	int ret = 0;
+	int ret;
 	struct mbuf_ancillary_data *ad;
 
-	ad = calloc(1, sizeof(*ad));
+	/* Single allocation for the structure, the payload and the name */
+	ad = mbuf_ancillary_data_alloc(key, name, len);
 	if (!ad)
 		return -ENOMEM;
 
-	/* Initialize ref_count to 1, we will unref it later */
-	atomic_store(&ad->ref_count, 1);
-
 	ad->is_string = is_string;
 	ad->len = len;
-	ad->name = strdup(name);
-	if (!ad->name) {
-		ret = -ENOMEM;
-		goto out;
-	}
-	ad->buffer = malloc(len);
-	if (!ad->buffer) {
-		ret = -ENOMEM;
-		goto out;
-	}
-	memcpy(ad->buffer, buffer, len);
+	if (len > 0)
+		memcpy(ad->buffer, buffer, len);
 
 	if (cbs != NULL)
 		memcpy(&ad->cbs, cbs, sizeof(*cbs));
 
 	ret = mbuf_base_frame_add_ancillary_internal(frame, ad);
 
-out:
 	mbuf_ancillary_data_unref(ad);
 	return ret;
 }
@@ -309,7 +583,7 @@ int mbuf_base_frame_add_ancillary_string(struct mbuf_base_frame *frame,
 {
 	size_t len = strlen(value) + 1;
 	return mbuf_base_frame_create_ancillary_internal(
-		frame, name, value, len, true, NULL);
+		frame, 0, name, value, len, true, NULL);
 }
 
 
@@ -319,7 +593,7 @@ int mbuf_base_frame_add_ancillary_buffer(struct mbuf_base_frame *frame,
 					 size_t len)
 {
 	return mbuf_base_frame_create_ancillary_internal(
-		frame, name, buffer, len, false, NULL);
+		frame, 0, name, buffer, len, false, NULL);
 }
 
 
@@ -331,7 +605,7 @@ int mbuf_base_frame_add_ancillary_buffer_with_cbs(
 	const struct mbuf_ancillary_data_cbs *cbs)
 {
 	return mbuf_base_frame_create_ancillary_internal(
-		frame, name, buffer, len, false, cbs);
+		frame, 0, name, buffer, len, false, cbs);
 }
 
 
@@ -342,51 +616,101 @@ int mbuf_base_frame_add_ancillary_data(struct mbuf_base_frame *frame,
 }
 
 
-int mbuf_base_frame_get_ancillary_data(struct mbuf_base_frame *frame,
-				       const char *name,
-				       struct mbuf_ancillary_data **data)
+/* Creates an ancillary data which does not copy the buffer: the buffer is
+ * either a part of mem, or adopted (and released with the release callback,
+ * or with free() if the callback is NULL). On error, the caller keeps the
+ * buffer ownership */
+static int mbuf_base_frame_wrap_ancillary_internal(
+	struct mbuf_base_frame *frame,
+	const char *name,
+	void *buffer,
+	size_t len,
+	struct mbuf_mem *mem,
+	mbuf_ancillary_data_release_t release,
+	void *userdata)
 {
 	int ret = 0;
-	struct mbuf_ancillary_data_holder *holder;
+	struct mbuf_ancillary_data *ad;
 
-	pthread_mutex_lock(&frame->ancillary_lock);
+	ad = mbuf_ancillary_data_alloc(0, name, 0);
+	if (!ad)
+		return -ENOMEM;
 
-	list_walk_entry_forward(&frame->ancillary_data, holder, node)
-	{
-		if (strcmp(name, holder->data->name) != 0)
-			continue;
-		mbuf_ancillary_data_ref(holder->data);
-		*data = holder->data;
-		goto out;
+	ad->len = len;
+	if (mem) {
+		ret = mbuf_mem_ref(mem);
+		if (ret != 0)
+			goto out;
+		ad->mem = mem;
 	}
+	ad->buffer = buffer;
+	ad->release = release;
+	ad->release_userdata = userdata;
 
-	ret = -ENOENT;
+	ret = mbuf_base_frame_add_ancillary_internal(frame, ad);
 
 out:
-	pthread_mutex_unlock(&frame->ancillary_lock);
+	if (ret != 0 && !ad->mem) {
+		/* Do not release the caller buffer */
+		ad->buffer = NULL;
+		ad->release = NULL;
+	}
+	mbuf_ancillary_data_unref(ad);
 	return ret;
 }
 
 
-int mbuf_base_frame_remove_ancillary_data(struct mbuf_base_frame *frame,
-					  const char *name)
+int mbuf_base_frame_add_ancillary_adopt(struct mbuf_base_frame *frame,
+					const char *name,
+					void *buffer,
+					size_t len,
+					mbuf_ancillary_data_release_t release,
+					void *userdata)
 {
-	int ret = 0;
-	struct mbuf_ancillary_data_holder *holder, *tmp;
+	return mbuf_base_frame_wrap_ancillary_internal(
+		frame, name, buffer, len, NULL, release, userdata);
+}
+
+
+int mbuf_base_frame_add_ancillary_mem(struct mbuf_base_frame *frame,
+				      const char *name,
+				      struct mbuf_mem *mem,
+				      size_t offset,
+				      size_t len)
+{
+	int ret;
+	void *data;
+	size_t capacity;
+
+	ret = mbuf_mem_get_data(mem, &data, &capacity);
+	if (ret != 0)
+		return ret;
+	ULOG_ERRNO_RETURN_ERR_IF(offset > capacity, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(len > capacity - offset, EINVAL);
+
+	return mbuf_base_frame_wrap_ancillary_internal(
+		frame, name, (uint8_t *)data + offset, len, mem, NULL, NULL);
+}
+
+
+static int
+mbuf_base_frame_get_ancillary_internal(struct mbuf_base_frame *frame,
+				       const char *name,
+				       uint32_t hash,
+				       uint32_t key,
+				       struct mbuf_ancillary_data **data)
+{
+	int ret;
 
 	pthread_mutex_lock(&frame->ancillary_lock);
 
-	list_walk_entry_forward_safe(&frame->ancillary_data, holder, tmp, node)
-	{
-		if (strcmp(name, holder->data->name) != 0)
-			continue;
-		mbuf_ancillary_data_unref(holder->data);
-		list_del(&holder->node);
-		free(holder);
+	ret = mbuf_ancillary_set_find(frame->ancillary, name, hash, key);
+	if (ret < 0)
 		goto out;
-	}
 
-	ret = -ENOENT;
+	*data = frame->ancillary->entries[ret].data;
+	mbuf_ancillary_data_ref(*data);
+	ret = 0;
 
 out:
 	pthread_mutex_unlock(&frame->ancillary_lock);
@@ -394,86 +718,693 @@ out:
 }
 
 
-int mbuf_base_frame_foreach_ancillary_data(struct mbuf_base_frame *frame,
-					   mbuf_ancillary_data_cb_t cb,
-					   void *userdata)
+static int
+mbuf_base_frame_remove_ancillary_internal(struct mbuf_base_frame *frame,
+					  const char *name,
+					  uint32_t hash,
+					  uint32_t key)
 {
-	struct mbuf_ancillary_data_holder *holder;
+	int ret;
+	unsigned int index;
+	struct mbuf_ancillary_set *set;
 
 	pthread_mutex_lock(&frame->ancillary_lock);
 
-	list_walk_entry_forward(&frame->ancillary_data, holder, node)
-	{
-		bool cont = cb(holder->data, userdata);
-		if (!cont)
-			break;
-	}
+	ret = mbuf_ancillary_set_find(frame->ancillary, name, hash, key);
+	if (ret < 0)
+		goto out;
+	index = ret;
+
+	ret = mbuf_base_frame_writable_ancillary(frame, 0);
+	if (ret != 0)
+		goto out;
+
+	/* Keep the insertion order, then rebuild the index as the following
+	 * entries have moved */
+	set = frame->ancillary;
+	mbuf_ancillary_data_unref(set->entries[index].data);
+	memmove(&set->entries[index],
+		&set->entries[index + 1],
+		(set->count - index - 1) * sizeof(set->entries[0]));
+	set->count--;
+	mbuf_ancillary_set_reindex(set);
+	ret = 0;
 
+out:
 	pthread_mutex_unlock(&frame->ancillary_lock);
-	return 0;
+	return ret;
 }
 
 
-/* Queue API */
+int mbuf_base_frame_get_ancillary_data(struct mbuf_base_frame *frame,
+				       const char *name,
+				       struct mbuf_ancillary_data **data)
+{
+	return mbuf_base_frame_get_ancillary_internal(
+		frame, name, mbuf_ancillary_data_hash(name), 0, data);
+}
 
 
-static int
-mbuf_base_frame_queue_flush_internal(struct mbuf_base_frame_queue *queue)
+int mbuf_base_frame_remove_ancillary_data(struct mbuf_base_frame *frame,
+					  const char *name)
 {
-	struct mbuf_frame_holder *holder, *tmp;
+	return mbuf_base_frame_remove_ancillary_internal(
+		frame, name, mbuf_ancillary_data_hash(name), 0);
+}
 
-	list_walk_entry_forward_safe(&queue->frames, holder, tmp, node)
-	{
-		int res = mbuf_base_frame_unref(holder->base);
-		if (res != 0 && res != -ENOENT)
-			ULOG_ERRNO("mbuf_base_frame_unref", -res);
-		list_del(&holder->node);
-		free(holder);
-	}
 
-	queue->nframes = 0;
-	pomp_evt_clear(queue->event);
+int mbuf_base_frame_add_ancillary_string_by_key(struct mbuf_base_frame *frame,
+						uint32_t key,
+						const char *value)
+{
+	const char *name;
+	uint32_t hash;
+	size_t len = strlen(value) + 1;
 
-	return 0;
+	int ret = mbuf_ancillary_key_lookup(key, &name, &hash);
+	if (ret != 0)
+		return ret;
+
+	return mbuf_base_frame_create_ancillary_internal(
+		frame, key, name, value, len, true, NULL);
 }
 
 
-int mbuf_base_frame_queue_init(struct mbuf_base_frame_queue *queue,
-			       int maxframes)
+int mbuf_base_frame_add_ancillary_buffer_by_key(struct mbuf_base_frame *frame,
+						uint32_t key,
+						const void *buffer,
+						size_t len)
 {
-	queue->maxframes = maxframes;
-	list_init(&queue->frames);
-	int ret = pthread_mutex_init(&queue->lock, NULL);
+	const char *name;
+	uint32_t hash;
+
+	int ret = mbuf_ancillary_key_lookup(key, &name, &hash);
 	if (ret != 0)
 		return ret;
-	queue->lock_created = true;
 
-	queue->event = pomp_evt_new();
-	if (!queue->event) {
-		ret = -ENOMEM;
+	return mbuf_base_frame_create_ancillary_internal(
+		frame, key, name, buffer, len, false, NULL);
+}
+
+
+int mbuf_base_frame_get_ancillary_data_by_key(
+	struct mbuf_base_frame *frame,
+	uint32_t key,
+	struct mbuf_ancillary_data **data)
+{
+	const char *name;
+	uint32_t hash;
+
+	int ret = mbuf_ancillary_key_lookup(key, &name, &hash);
+	if (ret != 0)
 		return ret;
-	}
 
-	return 0;
+	return mbuf_base_frame_get_ancillary_internal(
+		frame, name, hash, key, data);
 }
 
 
-int mbuf_base_frame_queue_deinit(struct mbuf_base_frame_queue *queue)
+int mbuf_base_frame_remove_ancillary_data_by_key(struct mbuf_base_frame *frame,
+						 uint32_t key)
 {
-	int ret;
+	const char *name;
+	uint32_t hash;
 
-	if (queue->lock_created)
-		pthread_mutex_lock(&queue->lock);
+	int ret = mbuf_ancillary_key_lookup(key, &name, &hash);
+	if (ret != 0)
+		return ret;
 
-	if (queue->nframes > 0) {
-		ULOGW("destroying a non-empty queue");
-		ret = mbuf_base_frame_queue_flush_internal(queue);
-		if (ret != 0)
-			ULOG_ERRNO("mbuf_base_frame_queue_flush_internal",
-				   -ret);
-	}
+	return mbuf_base_frame_remove_ancillary_internal(
+		frame, name, hash, key);
+}
 
-	if (queue->event) {
+
+int mbuf_base_frame_foreach_ancillary_data(struct mbuf_base_frame *frame,
+					   mbuf_ancillary_data_cb_t cb,
+					   void *userdata)
+{
+	struct mbuf_ancillary_set *set;
+
+	pthread_mutex_lock(&frame->ancillary_lock);
+
+	set = frame->ancillary;
+	for (unsigned int i = 0; set && i < set->count; i++) {
+		bool cont = cb(set->entries[i].data, userdata);
+		if (!cont)
+			break;
+	}
+
+	pthread_mutex_unlock(&frame->ancillary_lock);
+	return 0;
+}
+
+
+int mbuf_base_frame_copy_ancillary(struct mbuf_base_frame *dst,
+				   struct mbuf_base_frame *src)
+{
+	int ret = 0;
+	struct mbuf_ancillary_set *set;
+
+	pthread_mutex_lock(&src->ancillary_lock);
+	set = src->ancillary;
+	if (set)
+		atomic_fetch_add(&set->refcount, 1);
+	pthread_mutex_unlock(&src->ancillary_lock);
+
+	if (!set)
+		return 0;
+
+	pthread_mutex_lock(&dst->ancillary_lock);
+	if (!dst->ancillary || dst->ancillary->count == 0) {
+		/* Share the source set, which will be copied by the first
+		 * frame to modify it */
+		if (dst->ancillary)
+			mbuf_ancillary_set_unref(dst->ancillary);
+		dst->ancillary = set;
+		set = NULL;
+	}
+	pthread_mutex_unlock(&dst->ancillary_lock);
+
+	if (!set)
+		return 0;
+
+	/* Merge into the existing entries, which take precedence */
+	for (unsigned int i = 0; i < set->count; i++) {
+		ret = mbuf_base_frame_add_ancillary_internal(
+			dst, set->entries[i].data);
+		if (ret == -EEXIST)
+			ret = 0;
+		if (ret != 0)
+			break;
+	}
+	mbuf_ancillary_set_unref(set);
+
+	return ret;
+}
+
+
+/* Queue API */
+
+
+static bool
+mbuf_base_frame_queue_is_lock_free(struct mbuf_base_frame_queue *queue)
+{
+	return queue->mode != MBUF_FRAME_QUEUE_MODE_LOCKED;
+}
+
+
+/* Lock-free ring, based on D. Vyukov bounded MPMC queue: each cell sequence
+ * number tells whether the cell is ready to be written (seq == pos) or read
+ * (seq == pos + 1) for a given position. The ring supports concurrent
+ * consumers, which allows the producers to drop the oldest frame (so even a
+ * single producer and a single consumer need the per-cell sequences). */
+static bool mbuf_frame_ring_enqueue(struct mbuf_base_frame_queue *queue,
+				    struct mbuf_base_frame *base)
+{
+	struct mbuf_frame_cell *cell;
+	size_t pos, seq;
+	intptr_t diff;
+
+	pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+	for (;;) {
+		cell = &queue->cells[pos & queue->cell_mask];
+		seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(
+				    &queue->enqueue_pos,
+				    &pos,
+				    pos + 1,
+				    memory_order_relaxed,
+				    memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			/* Full */
+			return false;
+		} else {
+			pos = atomic_load_explicit(&queue->enqueue_pos,
+						   memory_order_relaxed);
+		}
+	}
+
+	cell->base = base;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+	return true;
+}
+
+
+static struct mbuf_base_frame *
+mbuf_frame_ring_dequeue(struct mbuf_base_frame_queue *queue)
+{
+	struct mbuf_frame_cell *cell;
+	struct mbuf_base_frame *base;
+	size_t pos, seq;
+	intptr_t diff;
+
+	pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+	for (;;) {
+		cell = &queue->cells[pos & queue->cell_mask];
+		seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		diff = (intptr_t)seq - (intptr_t)(pos + 1);
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(
+				    &queue->dequeue_pos,
+				    &pos,
+				    pos + 1,
+				    memory_order_relaxed,
+				    memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			/* Empty */
+			return NULL;
+		} else {
+			pos = atomic_load_explicit(&queue->dequeue_pos,
+						   memory_order_relaxed);
+		}
+	}
+
+	base = cell->base;
+	cell->base = NULL;
+	atomic_store_explicit(
+		&cell->seq, pos + queue->cell_mask + 1, memory_order_release);
+	return base;
+}
+
+
+static size_t mbuf_frame_ring_count(struct mbuf_base_frame_queue *queue)
+{
+	size_t dequeue_pos = atomic_load(&queue->dequeue_pos);
+	size_t enqueue_pos = atomic_load(&queue->enqueue_pos);
+
+	return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
+
+
+static void mbuf_frame_ring_clear_event(struct mbuf_base_frame_queue *queue)
+{
+	/* Clear the event, then check again to avoid missing a frame pushed
+	 * in-between */
+	pomp_evt_clear(queue->event);
+	if (mbuf_frame_ring_count(queue) != 0)
+		pomp_evt_signal(queue->event);
+}
+
+
+/* Initial ring size of an unbounded locked FIFO queue */
+#define MBUF_FRAME_FIFO_MIN_SIZE 16
+
+
+/* Must be called with the queue lock held, returns the holder at a given
+ * index of a locked FIFO queue (0 is the oldest frame) */
+static inline struct mbuf_frame_holder *
+mbuf_frame_fifo_at(struct mbuf_base_frame_queue *queue, unsigned int index)
+{
+	return &queue->fifo[(queue->fifo_head + index) & queue->fifo_mask];
+}
+
+
+/* Must be called with the queue lock held, grows the ring when it is full */
+static int mbuf_frame_fifo_reserve(struct mbuf_base_frame_queue *queue)
+{
+	struct mbuf_frame_holder *fifo;
+	unsigned int capacity = queue->fifo ? queue->fifo_mask + 1 : 0;
+	unsigned int new_capacity;
+
+	if ((unsigned int)queue->nframes < capacity)
+		return 0;
+
+	new_capacity = capacity ? 2 * capacity : MBUF_FRAME_FIFO_MIN_SIZE;
+	fifo = realloc(queue->fifo, new_capacity * sizeof(*fifo));
+	if (!fifo)
+		return -ENOMEM;
+
+	/* The ring is full: move its wrapped part after the old end so that
+	 * the frames are contiguous again from the head */
+	memcpy(&fifo[capacity], fifo, queue->fifo_head * sizeof(*fifo));
+	queue->fifo = fifo;
+	queue->fifo_mask = new_capacity - 1;
+
+	return 0;
+}
+
+
+/* Must be called with the queue lock held, removes the holder at a given
+ * index of a locked FIFO queue by shifting the shortest side of the ring */
+static void mbuf_frame_fifo_remove(struct mbuf_base_frame_queue *queue,
+				   unsigned int index)
+{
+	unsigned int i, n = queue->nframes;
+
+	if (index < n / 2) {
+		for (i = index; i > 0; i--)
+			*mbuf_frame_fifo_at(queue, i) =
+				*mbuf_frame_fifo_at(queue, i - 1);
+		queue->fifo_head = (queue->fifo_head + 1) & queue->fifo_mask;
+	} else {
+		for (i = index; i + 1 < n; i++)
+			*mbuf_frame_fifo_at(queue, i) =
+				*mbuf_frame_fifo_at(queue, i + 1);
+	}
+	queue->nframes--;
+}
+
+
+static bool mbuf_frame_heap_before(struct mbuf_base_frame_queue *queue,
+				   struct mbuf_frame_heap_entry *a,
+				   struct mbuf_frame_heap_entry *b)
+{
+	int res = queue->cmp(a->base, b->base, queue->cmp_userdata);
+	if (res != 0)
+		return res < 0;
+	/* Keep the push order for equivalent frames */
+	return a->seq < b->seq;
+}
+
+
+/* Must be called with the queue lock held */
+static int mbuf_frame_heap_push(struct mbuf_base_frame_queue *queue,
+				struct mbuf_base_frame *base)
+{
+	struct mbuf_frame_heap_entry *heap, tmp;
+	unsigned int i, parent;
+
+	if ((unsigned int)queue->nframes == queue->heap_capacity) {
+		unsigned int capacity =
+			queue->heap_capacity ? 2 * queue->heap_capacity : 16;
+		heap = realloc(queue->heap, capacity * sizeof(*heap));
+		if (!heap)
+			return -ENOMEM;
+		queue->heap = heap;
+		queue->heap_capacity = capacity;
+	}
+
+	heap = queue->heap;
+	i = queue->nframes++;
+	heap[i].base = base;
+	heap[i].seq = queue->heap_seq++;
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!mbuf_frame_heap_before(queue, &heap[i], &heap[parent]))
+			break;
+		tmp = heap[parent];
+		heap[parent] = heap[i];
+		heap[i] = tmp;
+		i = parent;
+	}
+
+	return 0;
+}
+
+
+/* Must be called with the queue lock held */
+static struct mbuf_base_frame *
+mbuf_frame_heap_pop(struct mbuf_base_frame_queue *queue)
+{
+	struct mbuf_frame_heap_entry *heap = queue->heap, tmp;
+	struct mbuf_base_frame *base;
+	unsigned int i = 0, child, n;
+
+	if (queue->nframes == 0)
+		return NULL;
+
+	base = heap[0].base;
+	n = --queue->nframes;
+	heap[0] = heap[n];
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n &&
+		    mbuf_frame_heap_before(
+			    queue, &heap[child + 1], &heap[child]))
+			child++;
+		if (!mbuf_frame_heap_before(queue, &heap[child], &heap[i]))
+			break;
+		tmp = heap[child];
+		heap[child] = heap[i];
+		heap[i] = tmp;
+		i = child;
+	}
+
+	return base;
+}
+
+
+/* Must be called with the queue lock held, returns the first frame of the
+ * queue without removing it */
+static struct mbuf_base_frame *
+mbuf_base_frame_queue_first_locked(struct mbuf_base_frame_queue *queue)
+{
+	if (queue->nframes == 0)
+		return NULL;
+	if (queue->cmp)
+		return queue->heap[0].base;
+
+	return mbuf_frame_fifo_at(queue, 0)->base;
+}
+
+
+/* Must be called with the queue lock held, removes the first frame of the
+ * queue and returns it (the queue reference is transferred to the caller) */
+static struct mbuf_base_frame *
+mbuf_base_frame_queue_take_locked(struct mbuf_base_frame_queue *queue)
+{
+	struct mbuf_frame_holder *holder;
+	struct mbuf_base_frame *base;
+
+	if (queue->nframes == 0)
+		return NULL;
+	if (queue->cmp)
+		return mbuf_frame_heap_pop(queue);
+
+	holder = mbuf_frame_fifo_at(queue, 0);
+	base = holder->base;
+	holder->base = NULL;
+	queue->nbytes -= holder->size;
+	queue->fifo_head = (queue->fifo_head + 1) & queue->fifo_mask;
+	queue->nframes--;
+	return base;
+}
+
+
+static int
+mbuf_base_frame_queue_flush_internal(struct mbuf_base_frame_queue *queue)
+{
+	struct mbuf_base_frame *base;
+
+	/* The heap order does not matter when flushing */
+	for (int i = 0; i < queue->nframes; i++) {
+		if (queue->cmp)
+			base = queue->heap[i].base;
+		else
+			base = mbuf_frame_fifo_at(queue, i)->base;
+		int res = mbuf_base_frame_unref(base);
+		if (res != 0 && res != -ENOENT)
+			ULOG_ERRNO("mbuf_base_frame_unref", -res);
+	}
+
+	queue->nframes = 0;
+	queue->fifo_head = 0;
+	queue->nbytes = 0;
+	queue->wait_sync = false;
+	pomp_evt_clear(queue->event);
+
+	return 0;
+}
+
+
+static void
+mbuf_base_frame_queue_flush_lock_free(struct mbuf_base_frame_queue *queue)
+{
+	struct mbuf_base_frame *base;
+
+	while ((base = mbuf_frame_ring_dequeue(queue)) != NULL) {
+		int res = mbuf_base_frame_unref(base);
+		if (res != 0 && res != -ENOENT)
+			ULOG_ERRNO("mbuf_base_frame_unref", -res);
+	}
+
+	mbuf_frame_ring_clear_event(queue);
+}
+
+
+int mbuf_base_frame_queue_init(struct mbuf_base_frame_queue *queue,
+			       int maxframes,
+			       enum mbuf_frame_queue_mode mode,
+			       mbuf_base_frame_cmp_t cmp,
+			       void *cmp_userdata)
+{
+	size_t size = 1;
+
+	queue->mode = mode;
+	queue->cmp = cmp;
+	queue->cmp_userdata = cmp_userdata;
+	atomic_init(&queue->ndropped, 0);
+	queue->maxframes = maxframes;
+	int ret = pthread_mutex_init(&queue->lock, NULL);
+	if (ret != 0)
+		return ret;
+	queue->lock_created = true;
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+#ifndef __APPLE__
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+	ret = pthread_cond_init(&queue->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	if (ret != 0)
+		return -ret;
+	queue->cond_created = true;
+	atomic_init(&queue->nwaiters, 0);
+
+	queue->event = pomp_evt_new();
+	if (!queue->event) {
+		ret = -ENOMEM;
+		return ret;
+	}
+
+	switch (mode) {
+	case MBUF_FRAME_QUEUE_MODE_LOCKED:
+		/* Preallocate the heap or the ring of bounded queues, so that
+		 * pushing frames never allocates memory */
+		if (maxframes <= 0)
+			break;
+		if (cmp) {
+			queue->heap = calloc(maxframes, sizeof(*queue->heap));
+			if (!queue->heap)
+				return -ENOMEM;
+			queue->heap_capacity = maxframes;
+			break;
+		}
+		/* The ring size is the next power of two */
+		while (size < (size_t)maxframes)
+			size <<= 1;
+		queue->fifo = calloc(size, sizeof(*queue->fifo));
+		if (!queue->fifo)
+			return -ENOMEM;
+		queue->fifo_mask = size - 1;
+		break;
+	case MBUF_FRAME_QUEUE_MODE_LOCKFREE:
+		/* The ring size is the next power of two */
+		ULOG_ERRNO_RETURN_ERR_IF(maxframes <= 0, EINVAL);
+		ULOG_ERRNO_RETURN_ERR_IF(cmp != NULL, EINVAL);
+		while (size < (size_t)maxframes)
+			size <<= 1;
+		queue->cells = calloc(size, sizeof(*queue->cells));
+		if (!queue->cells)
+			return -ENOMEM;
+		for (size_t i = 0; i < size; i++)
+			atomic_init(&queue->cells[i].seq, i);
+		queue->cell_mask = size - 1;
+		atomic_init(&queue->enqueue_pos, 0);
+		atomic_init(&queue->dequeue_pos, 0);
+		break;
+	default:
+		ULOGE("unknown queue mode %d", mode);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+int mbuf_base_frame_queue_set_drop_policy(
+	struct mbuf_base_frame_queue *queue,
+	enum mbuf_base_frame_drop_policy policy,
+	mbuf_base_frame_classify_t classify)
+{
+	switch (policy) {
+	case MBUF_BASE_FRAME_DROP_OLDEST:
+		break;
+	case MBUF_BASE_FRAME_DROP_NEWEST:
+	case MBUF_BASE_FRAME_DROP_NON_REF:
+	case MBUF_BASE_FRAME_DROP_TO_SYNC:
+		/* Other policies are only supported by locked FIFO queues */
+		ULOG_ERRNO_RETURN_ERR_IF(
+			queue->mode != MBUF_FRAME_QUEUE_MODE_LOCKED, EINVAL);
+		ULOG_ERRNO_RETURN_ERR_IF(queue->cmp != NULL, EINVAL);
+		ULOG_ERRNO_RETURN_ERR_IF(classify == NULL, EINVAL);
+		break;
+	default:
+		ULOGE("unknown drop policy %d", policy);
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&queue->lock);
+	queue->drop_policy = policy;
+	queue->classify = classify;
+	queue->wait_sync = false;
+	pthread_mutex_unlock(&queue->lock);
+
+	return 0;
+}
+
+
+uint64_t
+mbuf_base_frame_queue_get_drop_count(struct mbuf_base_frame_queue *queue)
+{
+	return atomic_load(&queue->ndropped);
+}
+
+
+int mbuf_base_frame_queue_set_limits(struct mbuf_base_frame_queue *queue,
+				     size_t maxbytes,
+				     uint64_t maxduration_us,
+				     mbuf_base_frame_get_size_t get_size,
+				     mbuf_base_frame_get_time_t get_time)
+{
+	if (maxbytes == 0 && maxduration_us == 0)
+		return 0;
+
+	/* Limits are only supported by locked FIFO queues */
+	ULOG_ERRNO_RETURN_ERR_IF(queue->mode != MBUF_FRAME_QUEUE_MODE_LOCKED,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(queue->cmp != NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!get_size || !get_time, EINVAL);
+
+	pthread_mutex_lock(&queue->lock);
+	queue->maxbytes = maxbytes;
+	queue->maxduration_us = maxduration_us;
+	queue->get_size = get_size;
+	queue->get_time = get_time;
+	pthread_mutex_unlock(&queue->lock);
+
+	return 0;
+}
+
+
+int mbuf_base_frame_queue_deinit(struct mbuf_base_frame_queue *queue)
+{
+	int ret;
+
+	if (queue->cells) {
+		if (mbuf_frame_ring_count(queue) > 0) {
+			ULOGW("destroying a non-empty queue");
+			mbuf_base_frame_queue_flush_lock_free(queue);
+		}
+		free(queue->cells);
+		queue->cells = NULL;
+	}
+
+	if (queue->lock_created)
+		pthread_mutex_lock(&queue->lock);
+
+	if (queue->nframes > 0) {
+		ULOGW("destroying a non-empty queue");
+		ret = mbuf_base_frame_queue_flush_internal(queue);
+		if (ret != 0)
+			ULOG_ERRNO("mbuf_base_frame_queue_flush_internal",
+				   -ret);
+	}
+
+	free(queue->heap);
+	queue->heap = NULL;
+
+	free(queue->fifo);
+	queue->fifo = NULL;
+
+	if (queue->event) {
 		ret = pomp_evt_destroy(queue->event);
 		if (ret != 0)
 			ULOG_ERRNO("pomp_evt_destroy", -ret);
@@ -484,52 +1415,285 @@ int mbuf_base_frame_queue_deinit(struct mbuf_base_frame_queue *queue)
 		pthread_mutex_unlock(&queue->lock);
 		pthread_mutex_destroy(&queue->lock);
 	}
+
+	if (queue->cond_created)
+		pthread_cond_destroy(&queue->cond);
 	return 0;
 }
 
 
-int mbuf_base_frame_queue_push(struct mbuf_base_frame_queue *queue,
-			       struct mbuf_base_frame *base)
+/* Wake the threads waiting in pop_wait, if any (lock-free mode only) */
+static void
+mbuf_base_frame_queue_wake_lock_free(struct mbuf_base_frame_queue *queue)
+{
+	/* Pairs with the nwaiters increment in pop_wait: either the waiter
+	 * sees the pushed frames, or the waiter count is seen here */
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load(&queue->nwaiters) == 0)
+		return;
+
+	pthread_mutex_lock(&queue->lock);
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+
+/* Does not signal the queue event */
+static int
+mbuf_base_frame_queue_push_lock_free(struct mbuf_base_frame_queue *queue,
+				     struct mbuf_base_frame *base)
 {
 	int ret;
-	struct mbuf_frame_holder *holder, *tmp;
+	struct mbuf_base_frame *dropped;
 
-	holder = calloc(1, sizeof(*holder));
-	if (!holder)
-		return -ENOMEM;
-	list_node_unref(&holder->node);
+	ret = mbuf_base_frame_ref(base);
+	if (ret != 0)
+		return ret;
 
-	pthread_mutex_lock(&queue->lock);
+	/* Drop the oldest frames if needed */
+	while (mbuf_frame_ring_count(queue) >= (size_t)queue->maxframes ||
+	       !mbuf_frame_ring_enqueue(queue, base)) {
+		dropped = mbuf_frame_ring_dequeue(queue);
+		if (dropped) {
+			mbuf_base_frame_unref(dropped);
+			atomic_fetch_add(&queue->ndropped, 1);
+		}
+	}
+
+	return 0;
+}
+
+
+/* Must be called with the queue lock held, drops the frame at a given index
+ * of a locked FIFO queue */
+static void
+mbuf_base_frame_queue_drop_holder(struct mbuf_base_frame_queue *queue,
+				  unsigned int index)
+{
+	struct mbuf_frame_holder *holder = mbuf_frame_fifo_at(queue, index);
+
+	queue->nbytes -= holder->size;
+	mbuf_base_frame_unref(holder->base);
+	mbuf_frame_fifo_remove(queue, index);
+	atomic_fetch_add(&queue->ndropped, 1);
+}
+
+
+/* Must be called with the queue lock held, makes room for the pushed frame
+ * according to the queue drop policy. Returns 1 if the pushed frame must be
+ * dropped instead, 0 if room has been made, -ENOBUFS if the pushed frame is
+ * refused, negative errno on error */
+static int
+mbuf_base_frame_queue_drop_locked(struct mbuf_base_frame_queue *queue,
+				  struct mbuf_base_frame *base)
+{
+	struct mbuf_base_frame *dropped;
+	unsigned int i, sync;
+
+	switch (queue->drop_policy) {
+	case MBUF_BASE_FRAME_DROP_NEWEST:
+		/* Reported to the caller, so that a batch push stops at the
+		 * first refused frame */
+		atomic_fetch_add(&queue->ndropped, 1);
+		return -ENOBUFS;
+
+	case MBUF_BASE_FRAME_DROP_NON_REF:
+		for (i = 0; i < (unsigned int)queue->nframes; i++) {
+			if (queue->classify(
+				    mbuf_frame_fifo_at(queue, i)->base) &
+			    MBUF_BASE_FRAME_FLAG_NON_REF) {
+				mbuf_base_frame_queue_drop_holder(queue, i);
+				return 0;
+			}
+		}
+		/* No non-reference frame, drop the oldest frame */
+		break;
+
+	case MBUF_BASE_FRAME_DROP_TO_SYNC:
+		/* Find the first sync frame after the first frame */
+		for (sync = 1; sync < (unsigned int)queue->nframes; sync++) {
+			if (queue->classify(
+				    mbuf_frame_fifo_at(queue, sync)->base) &
+			    MBUF_BASE_FRAME_FLAG_SYNC)
+				break;
+		}
+		if (sync == (unsigned int)queue->nframes &&
+		    !(queue->classify(base) & MBUF_BASE_FRAME_FLAG_SYNC)) {
+			/* The pushed frame depends on the queued frames, drop
+			 * it and all frames until the next sync frame */
+			queue->wait_sync = true;
+			atomic_fetch_add(&queue->ndropped, 1);
+			return 1;
+		}
+		/* Drop all frames before the sync frame (or all frames if the
+		 * pushed frame is a sync frame) */
+		for (i = 0; i < sync; i++)
+			mbuf_base_frame_queue_drop_holder(queue, 0);
+		return 0;
+
+	default:
+		break;
+	}
+
+	dropped = mbuf_base_frame_queue_take_locked(queue);
+	if (!dropped)
+		return -EPROTO;
+	mbuf_base_frame_unref(dropped);
+	atomic_fetch_add(&queue->ndropped, 1);
+	return 0;
+}
+
+
+/* Must be called with the queue lock held, checks whether the queue size or
+ * duration limits would be exceeded by pushing a frame */
+static bool
+mbuf_base_frame_queue_over_limits(struct mbuf_base_frame_queue *queue,
+				  size_t size,
+				  uint64_t time_us)
+{
+	struct mbuf_frame_holder *oldest;
+
+	if (queue->nframes == 0)
+		return false;
+
+	if (queue->maxbytes != 0 && queue->nbytes + size > queue->maxbytes)
+		return true;
+
+	if (queue->maxduration_us != 0) {
+		oldest = mbuf_frame_fifo_at(queue, 0);
+		if (time_us > oldest->time_us &&
+		    time_us - oldest->time_us > queue->maxduration_us)
+			return true;
+	}
+
+	return false;
+}
+
+
+/* Must be called with the queue lock held, does not signal the queue event */
+static int
+mbuf_base_frame_queue_push_locked(struct mbuf_base_frame_queue *queue,
+				  struct mbuf_base_frame *base)
+{
+	int ret;
+	struct mbuf_frame_holder *holder;
+	size_t size = 0;
+	uint64_t time_us = 0;
+
+	/* After a GOP drop, drop the frames until the next sync frame */
+	if (queue->wait_sync) {
+		if (!(queue->classify(base) & MBUF_BASE_FRAME_FLAG_SYNC)) {
+			atomic_fetch_add(&queue->ndropped, 1);
+			return 0;
+		}
+		queue->wait_sync = false;
+	}
 
 	/* Drop a frame if needed */
 	if (queue->maxframes != 0 && queue->nframes >= queue->maxframes) {
-		tmp = list_pop(&queue->frames, struct mbuf_frame_holder, node);
-		if (!tmp) {
-			ret = -EPROTO;
-			goto out;
+		ret = mbuf_base_frame_queue_drop_locked(queue, base);
+		if (ret < 0)
+			return ret;
+		else if (ret > 0)
+			/* The pushed frame was dropped */
+			return 0;
+	}
+
+	/* Drop frames until the size and duration limits are met (a single
+	 * frame exceeding the limits is always accepted) */
+	if (queue->get_size) {
+		size = queue->get_size(base);
+		time_us = queue->get_time(base);
+		while (mbuf_base_frame_queue_over_limits(
+			queue, size, time_us)) {
+			ret = mbuf_base_frame_queue_drop_locked(queue, base);
+			if (ret < 0)
+				return ret;
+			else if (ret > 0)
+				return 0;
 		}
-		queue->nframes--;
-		mbuf_base_frame_unref(tmp->base);
-		free(tmp);
 	}
 
-	ret = mbuf_base_frame_ref(base);
+	if (queue->cmp) {
+		ret = mbuf_base_frame_ref(base);
+		if (ret != 0)
+			return ret;
+		ret = mbuf_frame_heap_push(queue, base);
+		if (ret != 0)
+			mbuf_base_frame_unref(base);
+		return ret;
+	}
+
+	ret = mbuf_frame_fifo_reserve(queue);
 	if (ret != 0)
-		goto out;
-	holder->base = base;
+		return ret;
 
-	ret = pomp_evt_signal(queue->event);
+	ret = mbuf_base_frame_ref(base);
 	if (ret != 0)
-		goto out;
+		return ret;
+	holder = mbuf_frame_fifo_at(queue, queue->nframes);
+	holder->base = base;
+	holder->size = size;
+	holder->time_us = time_us;
 
-	list_push(&queue->frames, &holder->node);
 	queue->nframes++;
+	queue->nbytes += size;
 
-out:
-	pthread_mutex_unlock(&queue->lock);
+	return 0;
+}
 
-	if (ret != 0)
-		free(holder);
+
+int mbuf_base_frame_queue_push(struct mbuf_base_frame_queue *queue,
+			       struct mbuf_base_frame *base)
+{
+	unsigned int pushed;
+
+	return mbuf_base_frame_queue_push_batch(queue, &base, 1, &pushed);
+}
+
+
+int mbuf_base_frame_queue_push_batch(struct mbuf_base_frame_queue *queue,
+				     struct mbuf_base_frame *const *bases,
+				     unsigned int count,
+				     unsigned int *out_count)
+{
+	int ret = 0;
+	unsigned int i;
+
+	if (mbuf_base_frame_queue_is_lock_free(queue)) {
+		for (i = 0; i < count; i++) {
+			ret = mbuf_base_frame_queue_push_lock_free(queue,
+								   bases[i]);
+			if (ret != 0)
+				break;
+		}
+		if (i > 0) {
+			pomp_evt_signal(queue->event);
+			mbuf_base_frame_queue_wake_lock_free(queue);
+		}
+		*out_count = i;
+		return ret;
+	}
+
+	pthread_mutex_lock(&queue->lock);
+
+	for (i = 0; i < count; i++) {
+		ret = mbuf_base_frame_queue_push_locked(queue, bases[i]);
+		if (ret != 0)
+			break;
+	}
+
+	/* Signal the event once for the whole batch */
+	if (i > 0) {
+		int err = pomp_evt_signal(queue->event);
+		if (err != 0 && ret == 0)
+			ret = err;
+		if (atomic_load(&queue->nwaiters) > 0)
+			pthread_cond_broadcast(&queue->cond);
+	}
+	*out_count = i;
+
+	pthread_mutex_unlock(&queue->lock);
 	return ret;
 }
 
@@ -538,7 +1702,10 @@ int mbuf_base_frame_queue_peek(struct mbuf_base_frame_queue *queue,
 			       void **out_frame)
 {
 	int ret;
-	struct mbuf_frame_holder *holder;
+	struct mbuf_base_frame *base;
+
+	if (mbuf_base_frame_queue_is_lock_free(queue))
+		return -EOPNOTSUPP;
 
 	pthread_mutex_lock(&queue->lock);
 
@@ -547,17 +1714,16 @@ int mbuf_base_frame_queue_peek(struct mbuf_base_frame_queue *queue,
 		goto out;
 	}
 
-	holder = list_entry(
-		list_first(&queue->frames), struct mbuf_frame_holder, node);
-	if (!holder) {
+	base = mbuf_base_frame_queue_first_locked(queue);
+	if (!base) {
 		ret = -EPROTO;
 		goto out;
 	}
 
-	ret = mbuf_base_frame_ref(holder->base);
+	ret = mbuf_base_frame_ref(base);
 	if (ret != 0)
 		goto out;
-	*out_frame = holder->base->parent;
+	*out_frame = base->parent;
 
 out:
 	pthread_mutex_unlock(&queue->lock);
@@ -570,9 +1736,16 @@ int mbuf_base_frame_queue_peek_at(struct mbuf_base_frame_queue *queue,
 				  void **out_frame)
 {
 	int ret;
-	struct mbuf_frame_holder *holder = NULL;
-	unsigned int i = 0;
-	bool found = false;
+	struct mbuf_base_frame *base;
+
+	if (mbuf_base_frame_queue_is_lock_free(queue))
+		return -EOPNOTSUPP;
+
+	/* Ordered queues are only sorted at the top of the heap */
+	if (queue->cmp && index > 0)
+		return -EOPNOTSUPP;
+	else if (queue->cmp)
+		return mbuf_base_frame_queue_peek(queue, out_frame);
 
 	pthread_mutex_lock(&queue->lock);
 
@@ -581,24 +1754,16 @@ int mbuf_base_frame_queue_peek_at(struct mbuf_base_frame_queue *queue,
 		goto out;
 	}
 
-	list_walk_entry_forward(&queue->frames, holder, node)
-	{
-		if (i == index) {
-			found = true;
-			break;
-		}
-		i++;
-	}
-
-	if (!found) {
+	if (index >= (unsigned int)queue->nframes) {
 		ret = -ENOENT;
 		goto out;
 	}
 
-	ret = mbuf_base_frame_ref(holder->base);
+	base = mbuf_frame_fifo_at(queue, index)->base;
+	ret = mbuf_base_frame_ref(base);
 	if (ret != 0)
 		goto out;
-	*out_frame = holder->base->parent;
+	*out_frame = base->parent;
 
 out:
 	pthread_mutex_unlock(&queue->lock);
@@ -606,11 +1771,67 @@ out:
 }
 
 
+int mbuf_base_frame_queue_peek_range(struct mbuf_base_frame_queue *queue,
+				     unsigned int start,
+				     void **out_frames,
+				     unsigned int max_count,
+				     unsigned int *out_count)
+{
+	int ret = 0;
+	unsigned int n = 0;
+	struct mbuf_base_frame *base;
+
+	*out_count = 0;
+
+	if (mbuf_base_frame_queue_is_lock_free(queue))
+		return -EOPNOTSUPP;
+
+	/* Ordered queues are only sorted at the top of the heap */
+	if (queue->cmp)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&queue->lock);
+
+	if (queue->nframes == 0) {
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	if (start >= (unsigned int)queue->nframes) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	while (n < max_count && start + n < (unsigned int)queue->nframes) {
+		base = mbuf_frame_fifo_at(queue, start + n)->base;
+		ret = mbuf_base_frame_ref(base);
+		if (ret != 0)
+			break;
+		out_frames[n++] = base->parent;
+	}
+
+out:
+	pthread_mutex_unlock(&queue->lock);
+	*out_count = n;
+	return n > 0 ? 0 : ret;
+}
+
+
 int mbuf_base_frame_queue_pop(struct mbuf_base_frame_queue *queue,
 			      void **out_frame)
 {
 	int ret = 0;
-	struct mbuf_frame_holder *holder;
+	struct mbuf_base_frame *base;
+
+	if (mbuf_base_frame_queue_is_lock_free(queue)) {
+		base = mbuf_frame_ring_dequeue(queue);
+		if (!base)
+			return -EAGAIN;
+		if (mbuf_frame_ring_count(queue) == 0)
+			mbuf_frame_ring_clear_event(queue);
+		*out_frame = base->parent;
+		return 0;
+	}
 
 	pthread_mutex_lock(&queue->lock);
 
@@ -619,18 +1840,16 @@ int mbuf_base_frame_queue_pop(struct mbuf_base_frame_queue *queue,
 		goto out;
 	}
 
-	holder = list_pop(&queue->frames, struct mbuf_frame_holder, node);
-	if (!holder) {
+	base = mbuf_base_frame_queue_take_locked(queue);
+	if (!base) {
 		ret = -EPROTO;
 		goto out;
 	}
-	queue->nframes--;
 
 	if (queue->nframes == 0)
 		pomp_evt_clear(queue->event);
 
-	*out_frame = holder->base->parent;
-	free(holder);
+	*out_frame = base->parent;
 
 out:
 	pthread_mutex_unlock(&queue->lock);
@@ -638,8 +1857,101 @@ out:
 }
 
 
+int mbuf_base_frame_queue_pop_wait(struct mbuf_base_frame_queue *queue,
+				   void **out_frame,
+				   int64_t timeout_ns)
+{
+	int ret, err = 0;
+	struct timespec deadline;
+	bool empty;
+
+	if (timeout_ns > 0) {
+#ifndef __APPLE__
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+#else
+		clock_gettime(CLOCK_REALTIME, &deadline);
+#endif
+		deadline.tv_sec += timeout_ns / 1000000000;
+		deadline.tv_nsec += timeout_ns % 1000000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	for (;;) {
+		ret = mbuf_base_frame_queue_pop(queue, out_frame);
+		if (ret != -EAGAIN || timeout_ns == 0)
+			return ret;
+		if (err == ETIMEDOUT)
+			return -ETIMEDOUT;
+
+		pthread_mutex_lock(&queue->lock);
+		atomic_fetch_add(&queue->nwaiters, 1);
+		/* Check again with the waiter registered, to avoid missing a
+		 * push done in-between */
+		if (mbuf_base_frame_queue_is_lock_free(queue))
+			empty = mbuf_frame_ring_count(queue) == 0;
+		else
+			empty = queue->nframes == 0;
+		if (empty && timeout_ns < 0)
+			err = pthread_cond_wait(&queue->cond, &queue->lock);
+		else if (empty)
+			err = pthread_cond_timedwait(
+				&queue->cond, &queue->lock, &deadline);
+		atomic_fetch_sub(&queue->nwaiters, 1);
+		pthread_mutex_unlock(&queue->lock);
+	}
+}
+
+
+int mbuf_base_frame_queue_pop_batch(struct mbuf_base_frame_queue *queue,
+				    void **out_frames,
+				    unsigned int max_count,
+				    unsigned int *out_count)
+{
+	unsigned int n = 0;
+	struct mbuf_base_frame *base;
+
+	if (mbuf_base_frame_queue_is_lock_free(queue)) {
+		while (n < max_count) {
+			base = mbuf_frame_ring_dequeue(queue);
+			if (!base)
+				break;
+			out_frames[n++] = base->parent;
+		}
+		if (mbuf_frame_ring_count(queue) == 0)
+			mbuf_frame_ring_clear_event(queue);
+		*out_count = n;
+		return n > 0 ? 0 : -EAGAIN;
+	}
+
+	pthread_mutex_lock(&queue->lock);
+
+	while (n < max_count) {
+		base = mbuf_base_frame_queue_take_locked(queue);
+		if (!base)
+			break;
+		out_frames[n++] = base->parent;
+	}
+
+	if (queue->nframes == 0)
+		pomp_evt_clear(queue->event);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	*out_count = n;
+	return n > 0 ? 0 : -EAGAIN;
+}
+
+
 int mbuf_base_frame_queue_flush(struct mbuf_base_frame_queue *queue)
 {
+	if (mbuf_base_frame_queue_is_lock_free(queue)) {
+		mbuf_base_frame_queue_flush_lock_free(queue);
+		return 0;
+	}
+
 	pthread_mutex_lock(&queue->lock);
 
 	mbuf_base_frame_queue_flush_internal(queue);
@@ -662,9 +1974,247 @@ int mbuf_base_frame_queue_get_count(struct mbuf_base_frame_queue *queue)
 {
 	int ret;
 
+	if (mbuf_base_frame_queue_is_lock_free(queue))
+		return mbuf_frame_ring_count(queue);
+
 	pthread_mutex_lock(&queue->lock);
 	ret = queue->nframes;
 	pthread_mutex_unlock(&queue->lock);
 
 	return ret;
 }
+
+
+int mbuf_base_frame_bcast_new(unsigned int maxframes,
+			      struct mbuf_base_frame_bcast **ret_obj)
+{
+	int ret;
+	struct mbuf_base_frame_bcast *bcast;
+
+	*ret_obj = NULL;
+
+	bcast = calloc(1, sizeof(*bcast));
+	if (!bcast)
+		return -ENOMEM;
+	list_init(&bcast->readers);
+	bcast->capacity = maxframes;
+	bcast->ring = calloc(maxframes, sizeof(*bcast->ring));
+	if (!bcast->ring) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	ret = pthread_mutex_init(&bcast->lock, NULL);
+	if (ret != 0) {
+		ret = -ret;
+		goto error;
+	}
+
+	*ret_obj = bcast;
+	return 0;
+
+error:
+	free(bcast->ring);
+	free(bcast);
+	return ret;
+}
+
+
+/* Must be called with the broadcast queue lock held */
+static void mbuf_base_frame_bcast_release(struct mbuf_base_frame_bcast *bcast)
+{
+	struct mbuf_base_frame_bcast_reader *reader;
+	uint64_t min = bcast->head;
+	struct mbuf_base_frame **slot;
+
+	/* Release the frames which have been passed by all readers */
+	list_walk_entry_forward(&bcast->readers, reader, node)
+	{
+		if (reader->cursor < min)
+			min = reader->cursor;
+	}
+
+	while (bcast->tail < min) {
+		slot = &bcast->ring[bcast->tail % bcast->capacity];
+		int res = mbuf_base_frame_unref(*slot);
+		if (res != 0 && res != -ENOENT)
+			ULOG_ERRNO("mbuf_base_frame_unref", -res);
+		*slot = NULL;
+		bcast->tail++;
+	}
+}
+
+
+int mbuf_base_frame_bcast_destroy(struct mbuf_base_frame_bcast *bcast)
+{
+	pthread_mutex_lock(&bcast->lock);
+
+	if (bcast->nreaders > 0) {
+		pthread_mutex_unlock(&bcast->lock);
+		ULOGE("broadcast queue still has %u readers", bcast->nreaders);
+		return -EBUSY;
+	}
+
+	mbuf_base_frame_bcast_release(bcast);
+
+	pthread_mutex_unlock(&bcast->lock);
+	pthread_mutex_destroy(&bcast->lock);
+	free(bcast->ring);
+	free(bcast);
+
+	return 0;
+}
+
+
+int mbuf_base_frame_bcast_push(struct mbuf_base_frame_bcast *bcast,
+			       struct mbuf_base_frame *base)
+{
+	int ret;
+	struct mbuf_base_frame_bcast_reader *reader;
+
+	ret = mbuf_base_frame_ref(base);
+	if (ret != 0)
+		return ret;
+
+	pthread_mutex_lock(&bcast->lock);
+
+	/* Ring full: drop the oldest frame for the readers which still have it
+	 * in their queue */
+	if (bcast->head - bcast->tail >= bcast->capacity) {
+		list_walk_entry_forward(&bcast->readers, reader, node)
+		{
+			if (reader->cursor == bcast->tail)
+				reader->cursor++;
+		}
+		mbuf_base_frame_bcast_release(bcast);
+	}
+
+	bcast->ring[bcast->head % bcast->capacity] = base;
+	bcast->head++;
+
+	list_walk_entry_forward(&bcast->readers, reader, node)
+	{
+		/* Per-reader drop policy */
+		if (reader->maxframes != 0 &&
+		    bcast->head - reader->cursor > reader->maxframes)
+			reader->cursor = bcast->head - reader->maxframes;
+		pomp_evt_signal(reader->event);
+	}
+
+	/* Without readers, the frame is released immediately */
+	mbuf_base_frame_bcast_release(bcast);
+
+	pthread_mutex_unlock(&bcast->lock);
+
+	return 0;
+}
+
+
+int mbuf_base_frame_bcast_reader_new(
+	struct mbuf_base_frame_bcast *bcast,
+	unsigned int maxframes,
+	struct mbuf_base_frame_bcast_reader **ret_obj)
+{
+	struct mbuf_base_frame_bcast_reader *reader;
+
+	*ret_obj = NULL;
+
+	reader = calloc(1, sizeof(*reader));
+	if (!reader)
+		return -ENOMEM;
+	reader->event = pomp_evt_new();
+	if (!reader->event) {
+		free(reader);
+		return -ENOMEM;
+	}
+	reader->maxframes = maxframes;
+	reader->bcast = bcast;
+	list_node_unref(&reader->node);
+
+	pthread_mutex_lock(&bcast->lock);
+	/* New readers only get the frames pushed after they subscribed */
+	reader->cursor = bcast->head;
+	list_add_before(&bcast->readers, &reader->node);
+	bcast->nreaders++;
+	pthread_mutex_unlock(&bcast->lock);
+
+	*ret_obj = reader;
+	return 0;
+}
+
+
+int mbuf_base_frame_bcast_reader_destroy(
+	struct mbuf_base_frame_bcast_reader *reader)
+{
+	int ret;
+	struct mbuf_base_frame_bcast *bcast = reader->bcast;
+
+	pthread_mutex_lock(&bcast->lock);
+	list_del(&reader->node);
+	bcast->nreaders--;
+	mbuf_base_frame_bcast_release(bcast);
+	pthread_mutex_unlock(&bcast->lock);
+
+	ret = pomp_evt_destroy(reader->event);
+	if (ret != 0)
+		ULOG_ERRNO("pomp_evt_destroy", -ret);
+	free(reader);
+
+	return 0;
+}
+
+
+int mbuf_base_frame_bcast_reader_pop(
+	struct mbuf_base_frame_bcast_reader *reader,
+	void **out_frame)
+{
+	int ret = 0;
+	struct mbuf_base_frame_bcast *bcast = reader->bcast;
+	struct mbuf_base_frame *base;
+
+	pthread_mutex_lock(&bcast->lock);
+
+	if (reader->cursor == bcast->head) {
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	base = bcast->ring[reader->cursor % bcast->capacity];
+	ret = mbuf_base_frame_ref(base);
+	if (ret != 0)
+		goto out;
+	*out_frame = base->parent;
+	reader->cursor++;
+
+	if (reader->cursor == bcast->head)
+		pomp_evt_clear(reader->event);
+
+	mbuf_base_frame_bcast_release(bcast);
+
+out:
+	pthread_mutex_unlock(&bcast->lock);
+	return ret;
+}
+
+
+int mbuf_base_frame_bcast_reader_get_event(
+	struct mbuf_base_frame_bcast_reader *reader,
+	struct pomp_evt **out_evt)
+{
+	*out_evt = reader->event;
+	return 0;
+}
+
+
+int mbuf_base_frame_bcast_reader_get_count(
+	struct mbuf_base_frame_bcast_reader *reader)
+{
+	int ret;
+	struct mbuf_base_frame_bcast *bcast = reader->bcast;
+
+	pthread_mutex_lock(&bcast->lock);
+	ret = bcast->head - reader->cursor;
+	pthread_mutex_unlock(&bcast->lock);
+
+	return ret;
+}
@@ -31,6 +31,8 @@
 #include <stdatomic.h>
 
 #include <media-buffers/mbuf_ancillary_data.h>
+#include <media-buffers/mbuf_frame_queue.h>
+#include <media-buffers/mbuf_mem.h>
 
 #include <futils/list.h>
 #include <video-metadata/vmeta.h>
@@ -39,35 +41,192 @@
 
 typedef void (*frame_cleaner_t)(void *frame);
 
+/* Frame ancillary data entry, the name hash and the interned key (0 if
+ * none) are cached for lookups */
+struct mbuf_ancillary_data_entry {
+	struct mbuf_ancillary_data *data;
+	uint32_t hash;
+	uint32_t key;
+};
+
+/* Immutable once shared: a set of ancillary data entries in insertion
+ * order, followed in the same allocation by an open-addressing hash index of
+ * twice the capacity (index slots hold an entry index + 1, 0 is an empty
+ * slot). Frame copies share the set, the first frame to modify a shared set
+ * replaces it by a private copy */
+struct mbuf_ancillary_set {
+	atomic_uint refcount;
+	unsigned int count;
+	unsigned int capacity;
+	unsigned int *index;
+	struct mbuf_ancillary_data_entry entries[];
+};
+
 struct mbuf_base_frame {
 	void *parent;
 	frame_cleaner_t cleaner;
 
-	pthread_mutex_t meta_lock;
-	bool meta_lock_created;
-	struct vmeta_frame *meta;
-
+	/* Metadata pointer, readers are counted in one of two slots (selected
+	 * by the epoch parity) so that a writer replacing the metadata can
+	 * wait for the readers which may have loaded the old pointer to have
+	 * referenced it before unreferencing it. Writers are serialized by
+	 * the meta_writer flag */
+	_Atomic(struct vmeta_frame *) meta;
+	atomic_uint meta_readers[2];
+	atomic_uint meta_epoch;
+	atomic_bool meta_writer;
+
+	/* Ancillary data set (NULL if the frame never had ancillary data),
+	 * the lock protects the pointer and the private set modifications */
 	pthread_mutex_t ancillary_lock;
 	bool ancillary_lock_created;
-	struct list_node ancillary_data;
+	struct mbuf_ancillary_set *ancillary;
 
 	atomic_bool finalized;
 	mbuf_rwlock_t rwlock;
 	atomic_uint refcount;
+
+	/* Next frame in a frame cache (only while cached) */
+	struct mbuf_base_frame *cache_next;
+};
+
+
+/* Frame caches are never enabled in sanitizer builds: a recycled frame
+ * would hide use-after-free errors, and cached frames would be reported as
+ * leaks */
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#	define MBUF_BASE_FRAME_CACHE_SUPPORTED 0
+#elif defined(__has_feature)
+#	if __has_feature(address_sanitizer) ||                                \
+		__has_feature(thread_sanitizer) ||                             \
+		__has_feature(memory_sanitizer)
+#		define MBUF_BASE_FRAME_CACHE_SUPPORTED 0
+#	endif
+#endif
+#ifndef MBUF_BASE_FRAME_CACHE_SUPPORTED
+#	define MBUF_BASE_FRAME_CACHE_SUPPORTED 1
+#endif
+
+/* Cache of released frames of a given type: cached frames keep their
+ * ancillary lock and their type-specific allocations, so that creating a
+ * new frame does not need to allocate and initialize them again. The cache
+ * is disabled (maxcount is 0) until its size is set */
+struct mbuf_base_frame_cache {
+	pthread_mutex_t lock;
+	struct mbuf_base_frame *frames;
+	unsigned int count;
+	atomic_uint maxcount;
 };
 
+#define MBUF_BASE_FRAME_CACHE_INITIALIZER                                      \
+	{                                                                      \
+		.lock = PTHREAD_MUTEX_INITIALIZER, .frames = NULL, .count = 0, \
+		.maxcount = 0,                                                 \
+	}
+
 struct mbuf_frame_holder {
 	struct mbuf_base_frame *base;
-	struct list_node node;
+	/* Payload size and timestamp (only for size/duration bounded
+	 * queues) */
+	size_t size;
+	uint64_t time_us;
+};
+
+/* Ordering function for ordered queues, returns a negative value if a must
+ * be popped before b, a positive value if b must be popped before a, and zero
+ * if both frames are equivalent (push order is kept) */
+typedef int (*mbuf_base_frame_cmp_t)(struct mbuf_base_frame *a,
+				     struct mbuf_base_frame *b,
+				     void *userdata);
+
+/* Frame queue drop policies, applied when a bounded queue is full */
+enum mbuf_base_frame_drop_policy {
+	/* Drop the oldest frame (default) */
+	MBUF_BASE_FRAME_DROP_OLDEST = 0,
+	/* Refuse the pushed frame (the push fails with -ENOBUFS) */
+	MBUF_BASE_FRAME_DROP_NEWEST,
+	/* Drop the oldest non-reference frame, or the oldest frame */
+	MBUF_BASE_FRAME_DROP_NON_REF,
+	/* Drop all frames up to the next sync frame */
+	MBUF_BASE_FRAME_DROP_TO_SYNC,
+};
+
+/* Frame classification flags for the drop policies */
+#define MBUF_BASE_FRAME_FLAG_NON_REF (1 << 0)
+#define MBUF_BASE_FRAME_FLAG_SYNC (1 << 1)
+
+typedef unsigned int (*mbuf_base_frame_classify_t)(
+	struct mbuf_base_frame *base);
+
+/* Frame payload size and timestamp (in microseconds) getters for size and
+ * duration bounded queues */
+typedef size_t (*mbuf_base_frame_get_size_t)(struct mbuf_base_frame *base);
+typedef uint64_t (*mbuf_base_frame_get_time_t)(struct mbuf_base_frame *base);
+
+/* Ordered queue binary heap entry */
+struct mbuf_frame_heap_entry {
+	struct mbuf_base_frame *base;
+	uint64_t seq;
+};
+
+/* Lock-free ring cell */
+struct mbuf_frame_cell {
+	atomic_size_t seq;
+	struct mbuf_base_frame *base;
 };
 
 struct mbuf_base_frame_queue {
+	enum mbuf_frame_queue_mode mode;
 	pthread_mutex_t lock;
 	bool lock_created;
-	struct list_node frames;
+	/* Signaled on push when some threads are waiting in pop_wait */
+	pthread_cond_t cond;
+	bool cond_created;
+	atomic_int nwaiters;
 	int nframes;
 	int maxframes;
 	struct pomp_evt *event;
+
+	/* Drop policy (locked FIFO queues only for other policies than
+	 * MBUF_BASE_FRAME_DROP_OLDEST) */
+	enum mbuf_base_frame_drop_policy drop_policy;
+	mbuf_base_frame_classify_t classify;
+	/* When set, frames are dropped until the next sync frame */
+	bool wait_sync;
+	atomic_ullong ndropped;
+
+	/* Size and duration limits (locked FIFO queues only), the duration
+	 * is the difference between the newest and the oldest frames
+	 * timestamps */
+	size_t maxbytes;
+	size_t nbytes;
+	uint64_t maxduration_us;
+	mbuf_base_frame_get_size_t get_size;
+	mbuf_base_frame_get_time_t get_time;
+
+	/* Binary heap (ordered queues only, nframes is the heap size) */
+	mbuf_base_frame_cmp_t cmp;
+	void *cmp_userdata;
+	struct mbuf_frame_heap_entry *heap;
+	unsigned int heap_capacity;
+	uint64_t heap_seq;
+
+	/* Ring of frame holders (locked FIFO queues only, nframes is the
+	 * number of holders in use), the ring size is a power of two */
+	struct mbuf_frame_holder *fifo;
+	unsigned int fifo_mask;
+	unsigned int fifo_head;
+
+	/* Lock-free ring (lock-free mode only), the positions are padded to
+	 * avoid false sharing between producers and consumer (the queue is
+	 * heap-allocated, so alignment attributes can not be relied upon) */
+	struct mbuf_frame_cell *cells;
+	size_t cell_mask;
+	uint8_t pad0[64];
+	atomic_size_t enqueue_pos;
+	uint8_t pad1[64 - sizeof(atomic_size_t)];
+	atomic_size_t dequeue_pos;
+	uint8_t pad2[64 - sizeof(atomic_size_t)];
 };
 
 /* Frame API */
@@ -78,6 +237,29 @@ int mbuf_base_frame_init(struct mbuf_base_frame *frame,
 
 int mbuf_base_frame_deinit(struct mbuf_base_frame *frame);
 
+/* Returns the parent of a cached frame, reset as after
+ * mbuf_base_frame_init() (the parent must reset its own fields), or NULL if
+ * the cache is empty or contended */
+void *mbuf_base_frame_cache_get(struct mbuf_base_frame_cache *cache);
+
+/* Releases the metadata and ancillary data of a frame which is no longer
+ * referenced and puts it in the cache; returns false if the cache is full or
+ * contended, in which case the frame must be deinitialized and freed as
+ * usual */
+bool mbuf_base_frame_cache_put(struct mbuf_base_frame_cache *cache,
+			       struct mbuf_base_frame *frame);
+
+/* Empties the cache, destroy is called on the parent of each cached frame;
+ * returns the number of destroyed frames */
+unsigned int mbuf_base_frame_cache_flush(struct mbuf_base_frame_cache *cache,
+					 void (*destroy)(void *parent));
+
+/* Sets the maximum number of frames kept in the cache (0 disables the
+ * cache), destroy is called on the parent of each cached frame in excess */
+int mbuf_base_frame_cache_set_size(struct mbuf_base_frame_cache *cache,
+				   unsigned int size,
+				   void (*destroy)(void *parent));
+
 int mbuf_base_frame_ref(struct mbuf_base_frame *frame);
 
 int mbuf_base_frame_unref(struct mbuf_base_frame *frame);
@@ -88,6 +270,9 @@ int mbuf_base_frame_set_metadata(struct mbuf_base_frame *frame,
 int mbuf_base_frame_get_metadata(struct mbuf_base_frame *frame,
 				 struct vmeta_frame **meta);
 
+int mbuf_base_frame_copy_metadata(struct mbuf_base_frame *dst,
+				  struct mbuf_base_frame *src);
+
 void mbuf_base_frame_finalize(struct mbuf_base_frame *frame);
 
 bool mbuf_base_frame_is_finalized(struct mbuf_base_frame *frame);
@@ -119,6 +304,19 @@ int mbuf_base_frame_add_ancillary_buffer_with_cbs(
 int mbuf_base_frame_add_ancillary_data(struct mbuf_base_frame *frame,
 				       struct mbuf_ancillary_data *data);
 
+int mbuf_base_frame_add_ancillary_adopt(struct mbuf_base_frame *frame,
+					const char *name,
+					void *buffer,
+					size_t len,
+					mbuf_ancillary_data_release_t release,
+					void *userdata);
+
+int mbuf_base_frame_add_ancillary_mem(struct mbuf_base_frame *frame,
+				      const char *name,
+				      struct mbuf_mem *mem,
+				      size_t offset,
+				      size_t len);
+
 int mbuf_base_frame_get_ancillary_data(struct mbuf_base_frame *frame,
 				       const char *name,
 				       struct mbuf_ancillary_data **data);
@@ -126,20 +324,93 @@ int mbuf_base_frame_get_ancillary_data(struct mbuf_base_frame *frame,
 int mbuf_base_frame_remove_ancillary_data(struct mbuf_base_frame *frame,
 					  const char *name);
 
+int mbuf_base_frame_add_ancillary_string_by_key(struct mbuf_base_frame *frame,
+						uint32_t key,
+						const char *value);
+
+int mbuf_base_frame_add_ancillary_buffer_by_key(struct mbuf_base_frame *frame,
+						uint32_t key,
+						const void *buffer,
+						size_t len);
+
+int mbuf_base_frame_get_ancillary_data_by_key(
+	struct mbuf_base_frame *frame,
+	uint32_t key,
+	struct mbuf_ancillary_data **data);
+
+int mbuf_base_frame_remove_ancillary_data_by_key(struct mbuf_base_frame *frame,
+						 uint32_t key);
+
 int mbuf_base_frame_foreach_ancillary_data(struct mbuf_base_frame *frame,
 					   mbuf_ancillary_data_cb_t cb,
 					   void *userdata);
 
+/* Shares the src ancillary data with dst (copy-on-write), existing dst
+ * entries are kept */
+int mbuf_base_frame_copy_ancillary(struct mbuf_base_frame *dst,
+				   struct mbuf_base_frame *src);
+
+/* Broadcast queue: a single ring of frame references, with one read cursor
+ * per reader. The ring holds one reference per frame, which is released once
+ * every reader has passed it (or dropped it) */
+struct mbuf_base_frame_bcast {
+	pthread_mutex_t lock;
+	struct mbuf_base_frame **ring;
+	unsigned int capacity;
+	/* Positions are never wrapped, the ring index is pos % capacity */
+	uint64_t head;
+	uint64_t tail;
+	struct list_node readers;
+	unsigned int nreaders;
+};
+
+struct mbuf_base_frame_bcast_reader {
+	struct mbuf_base_frame_bcast *bcast;
+	struct list_node node;
+	uint64_t cursor;
+	unsigned int maxframes;
+	struct pomp_evt *event;
+};
+
+
 /* Queue API */
 
+/* Number of frames handled per lock/unlock cycle by the typed batch
+ * functions, which need a local array of base frames */
+#define MBUF_BASE_FRAME_QUEUE_BATCH_SIZE 64
+
 int mbuf_base_frame_queue_init(struct mbuf_base_frame_queue *queue,
-			       int maxframes);
+			       int maxframes,
+			       enum mbuf_frame_queue_mode mode,
+			       mbuf_base_frame_cmp_t cmp,
+			       void *cmp_userdata);
 
 int mbuf_base_frame_queue_deinit(struct mbuf_base_frame_queue *queue);
 
+int mbuf_base_frame_queue_set_drop_policy(
+	struct mbuf_base_frame_queue *queue,
+	enum mbuf_base_frame_drop_policy policy,
+	mbuf_base_frame_classify_t classify);
+
+uint64_t
+mbuf_base_frame_queue_get_drop_count(struct mbuf_base_frame_queue *queue);
+
+int mbuf_base_frame_queue_set_limits(struct mbuf_base_frame_queue *queue,
+				     size_t maxbytes,
+				     uint64_t maxduration_us,
+				     mbuf_base_frame_get_size_t get_size,
+				     mbuf_base_frame_get_time_t get_time);
+
 int mbuf_base_frame_queue_push(struct mbuf_base_frame_queue *queue,
 			       struct mbuf_base_frame *base);
 
+/* Pushes the frames in order, stops at the first error; out_count is the
+ * number of frames pushed (even on error) */
+int mbuf_base_frame_queue_push_batch(struct mbuf_base_frame_queue *queue,
+				     struct mbuf_base_frame *const *bases,
+				     unsigned int count,
+				     unsigned int *out_count);
+
 int mbuf_base_frame_queue_peek(struct mbuf_base_frame_queue *queue,
 			       void **out_frame);
 
@@ -147,9 +418,24 @@ int mbuf_base_frame_queue_peek_at(struct mbuf_base_frame_queue *queue,
 				  unsigned int index,
 				  void **out_frame);
 
+int mbuf_base_frame_queue_peek_range(struct mbuf_base_frame_queue *queue,
+				     unsigned int start,
+				     void **out_frames,
+				     unsigned int max_count,
+				     unsigned int *out_count);
+
 int mbuf_base_frame_queue_pop(struct mbuf_base_frame_queue *queue,
 			      void **out_frame);
 
+int mbuf_base_frame_queue_pop_wait(struct mbuf_base_frame_queue *queue,
+				   void **out_frame,
+				   int64_t timeout_ns);
+
+int mbuf_base_frame_queue_pop_batch(struct mbuf_base_frame_queue *queue,
+				    void **out_frames,
+				    unsigned int max_count,
+				    unsigned int *out_count);
+
 int mbuf_base_frame_queue_flush(struct mbuf_base_frame_queue *queue);
 
 int mbuf_base_frame_queue_get_event(struct mbuf_base_frame_queue *queue,
@@ -157,4 +443,35 @@ int mbuf_base_frame_queue_get_event(struct mbuf_base_frame_queue *queue,
 
 int mbuf_base_frame_queue_get_count(struct mbuf_base_frame_queue *queue);
 
+
+/* Broadcast queue API */
+
+int mbuf_base_frame_bcast_new(unsigned int maxframes,
+			      struct mbuf_base_frame_bcast **ret_obj);
+
+/* Fails with -EBUSY if the broadcast queue still has readers */
+int mbuf_base_frame_bcast_destroy(struct mbuf_base_frame_bcast *bcast);
+
+int mbuf_base_frame_bcast_push(struct mbuf_base_frame_bcast *bcast,
+			       struct mbuf_base_frame *base);
+
+int mbuf_base_frame_bcast_reader_new(
+	struct mbuf_base_frame_bcast *bcast,
+	unsigned int maxframes,
+	struct mbuf_base_frame_bcast_reader **ret_obj);
+
+int mbuf_base_frame_bcast_reader_destroy(
+	struct mbuf_base_frame_bcast_reader *reader);
+
+int mbuf_base_frame_bcast_reader_pop(
+	struct mbuf_base_frame_bcast_reader *reader,
+	void **out_frame);
+
+int mbuf_base_frame_bcast_reader_get_event(
+	struct mbuf_base_frame_bcast_reader *reader,
+	struct pomp_evt **out_evt);
+
+int mbuf_base_frame_bcast_reader_get_count(
+	struct mbuf_base_frame_bcast_reader *reader);
+
 #endif /* _MBUF_BASE_FRAME_H_ */
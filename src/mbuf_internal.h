@@ -30,15 +30,43 @@
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include <media-buffers/mbuf_ancillary_data.h>
+
+struct mbuf_mem;
 
 struct mbuf_ancillary_data {
+	/* Interned key, or 0 if the data has been created with a string name
+	 * (the name is then stored inline) */
+	uint32_t key;
 	char *name;
 	void *buffer;
 	size_t len;
 	bool is_string;
 	struct mbuf_ancillary_data_cbs cbs;
 
+	/* Buffer owner: if mem is set, the buffer is a part of the memory;
+	 * otherwise if release is set, the buffer has been adopted from the
+	 * caller; otherwise the buffer is either a copy stored inline, or an
+	 * adopted buffer to release with free() */
+	struct mbuf_mem *mem;
+	mbuf_ancillary_data_release_t release;
+	void *release_userdata;
+
 	atomic_int ref_count;
+
+	/* Inline storage, allocated with the structure: the copied payload
+	 * (first, for alignment), then the name */
+	max_align_t storage[];
 };
 
+
+struct mbuf_ancillary_data *
+mbuf_ancillary_data_alloc(uint32_t key, const char *name, size_t inline_len);
+
+uint32_t mbuf_ancillary_data_hash(const char *name);
+
+int mbuf_ancillary_key_lookup(uint32_t key, const char **name, uint32_t *hash);
+
 #endif /* _MBUF_INTERNAL_H_ */
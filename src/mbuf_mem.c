@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define ULOG_TAG mbuf_mem
 #include <ulog.h>
@@ -38,6 +39,9 @@ ULOG_DECLARE_TAG(ULOG_TAG);
 
 #define MBUF_POOL_DEFAULT_NAME "default"
 
+/* Descriptors segment size for pools created without initial memories */
+#define MBUF_POOL_DEFAULT_SEGMENT_SIZE 8
+
 
 static int call_alloc(const struct mbuf_mem_implem *implem,
 		      struct mbuf_mem *mem)
@@ -75,6 +79,230 @@ static void call_free(const struct mbuf_mem_implem *implem,
 }
 
 
+/* Get a memory descriptor from its index in the pool */
+static struct mbuf_mem *mbuf_pool_get_mem(struct mbuf_pool *pool,
+					  uint32_t index)
+{
+	size_t segment = 0;
+	size_t offset = index;
+
+	if (index >= pool->segment_size) {
+		unsigned long q = index / pool->segment_size;
+		segment = (sizeof(q) * 8) - __builtin_clzl(q);
+		offset = index - (pool->segment_size << (segment - 1));
+	}
+
+	return &pool->segments[segment][offset];
+}
+
+
+/* Pop a memory from the pool free stack, returns NULL if the stack is empty */
+static struct mbuf_mem *mbuf_pool_pop_free(struct mbuf_pool *pool)
+{
+	struct mbuf_mem *mem;
+	uint64_t head, next;
+	uint32_t top;
+
+	head = atomic_load_explicit(&pool->free_head, memory_order_acquire);
+	do {
+		top = (uint32_t)head;
+		if (top == 0)
+			return NULL;
+		mem = mbuf_pool_get_mem(pool, top - 1);
+		next = (((head >> 32) + 1) << 32) |
+		       atomic_load_explicit(&mem->free_next,
+					    memory_order_relaxed);
+	} while (!atomic_compare_exchange_weak_explicit(&pool->free_head,
+							&head,
+							next,
+							memory_order_acquire,
+							memory_order_acquire));
+
+	return mem;
+}
+
+
+/* Push a memory on the pool free stack */
+static void mbuf_pool_push_free(struct mbuf_pool *pool, struct mbuf_mem *mem)
+{
+	uint64_t head, next;
+
+	head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+	do {
+		atomic_store_explicit(
+			&mem->free_next, (uint32_t)head, memory_order_relaxed);
+		next = (((head >> 32) + 1) << 32) | (mem->index + 1);
+	} while (!atomic_compare_exchange_weak_explicit(&pool->free_head,
+							&head,
+							next,
+							memory_order_release,
+							memory_order_relaxed));
+}
+
+
+/* Get a new memory descriptor, either by reusing a previously released
+ * descriptor, or by creating a new one. Must be called with the pool lock
+ * held, or during the pool creation */
+static struct mbuf_mem *mbuf_pool_new_mem(struct mbuf_pool *pool)
+{
+	struct mbuf_mem *mem;
+	size_t segment, count;
+
+	mem = list_pop(&pool->spares, struct mbuf_mem, node);
+	if (mem)
+		goto out;
+
+	if (pool->next_index == UINT32_MAX)
+		return NULL;
+	if (pool->next_index < pool->segment_size) {
+		segment = 0;
+		count = pool->segment_size;
+	} else {
+		unsigned long q = pool->next_index / pool->segment_size;
+		segment = (sizeof(q) * 8) - __builtin_clzl(q);
+		count = pool->segment_size << (segment - 1);
+	}
+	if (segment >= MBUF_POOL_SEGMENT_COUNT)
+		return NULL;
+	if (!pool->segments[segment]) {
+		pool->segments[segment] =
+			calloc(count, sizeof(*pool->segments[segment]));
+		if (!pool->segments[segment])
+			return NULL;
+	}
+	mem = mbuf_pool_get_mem(pool, pool->next_index);
+	mem->index = pool->next_index;
+	mem->pool = pool;
+	pool->next_index++;
+
+out:
+	mem->data = NULL;
+	mem->size = pool->mem_size;
+	mem->cookie = 0;
+	mem->specific = NULL;
+	atomic_store(&mem->refcount, 0);
+	return mem;
+}
+
+
+/* Thread-specific data destructor: return the cached memories to the pool */
+static void mbuf_pool_cache_destroy(void *data)
+{
+	struct mbuf_pool_cache *cache = data;
+	struct mbuf_pool *pool = cache->pool;
+	struct mbuf_mem *mem;
+
+	pthread_mutex_lock(&pool->lock);
+	list_del(&cache->node);
+	for (size_t i = 0; i < pool->cache_size; i++) {
+		mem = atomic_exchange(&cache->mems[i], NULL);
+		if (!mem)
+			continue;
+		atomic_fetch_add(&pool->mem_free, 1);
+		mbuf_pool_push_free(pool, mem);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	free(cache);
+}
+
+
+/* Check whether released memories can be kept in the thread caches without
+ * breaking the pool grow policy */
+static bool mbuf_pool_can_cache(struct mbuf_pool *pool)
+{
+	switch (pool->policy) {
+	case MBUF_POOL_NO_GROW:
+	case MBUF_POOL_GROW:
+		return true;
+	default:
+		return atomic_load(&pool->mem_count) <= pool->initial_mem_count;
+	}
+}
+
+
+/* Take a memory from the calling thread cache */
+static struct mbuf_mem *mbuf_pool_cache_get(struct mbuf_pool *pool)
+{
+	struct mbuf_pool_cache *cache;
+	struct mbuf_mem *mem;
+
+	if (pool->cache_size == 0)
+		return NULL;
+	cache = pthread_getspecific(pool->cache_key);
+	if (!cache)
+		return NULL;
+
+	for (size_t i = pool->cache_size; i > 0; i--) {
+		if (!atomic_load_explicit(&cache->mems[i - 1],
+					  memory_order_relaxed))
+			continue;
+		mem = atomic_exchange(&cache->mems[i - 1], NULL);
+		if (mem)
+			return mem;
+	}
+
+	return NULL;
+}
+
+
+/* Keep a released memory in the calling thread cache, returns false if the
+ * memory must be returned to the pool free stack instead */
+static bool mbuf_pool_cache_put(struct mbuf_pool *pool, struct mbuf_mem *mem)
+{
+	struct mbuf_pool_cache *cache;
+	struct mbuf_mem *expected;
+
+	if (pool->cache_size == 0 || !mbuf_pool_can_cache(pool))
+		return false;
+	cache = pthread_getspecific(pool->cache_key);
+	if (!cache) {
+		cache = calloc(1, sizeof(*cache));
+		if (!cache)
+			return false;
+		cache->pool = pool;
+		if (pthread_setspecific(pool->cache_key, cache) != 0) {
+			free(cache);
+			return false;
+		}
+		pthread_mutex_lock(&pool->lock);
+		list_add_before(&pool->caches, &cache->node);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	for (size_t i = 0; i < pool->cache_size; i++) {
+		if (atomic_load_explicit(&cache->mems[i], memory_order_relaxed))
+			continue;
+		expected = NULL;
+		if (atomic_compare_exchange_strong(
+			    &cache->mems[i], &expected, mem))
+			return true;
+	}
+
+	return false;
+}
+
+
+/* Take a memory from any thread cache. Must be called with the pool lock
+ * held */
+static struct mbuf_mem *mbuf_pool_cache_steal(struct mbuf_pool *pool)
+{
+	struct mbuf_pool_cache *cache;
+	struct mbuf_mem *mem;
+
+	list_walk_entry_forward(&pool->caches, cache, node)
+	{
+		for (size_t i = 0; i < pool->cache_size; i++) {
+			mem = atomic_exchange(&cache->mems[i], NULL);
+			if (mem)
+				return mem;
+		}
+	}
+
+	return NULL;
+}
+
+
 int mbuf_pool_new(const struct mbuf_mem_implem *implem,
 		  size_t mem_size,
 		  size_t mem_count,
@@ -96,13 +324,18 @@ int mbuf_pool_new(const struct mbuf_mem_implem *implem,
 		return -ENOMEM;
 
 	list_init(&pool->memories);
+	list_init(&pool->spares);
+	list_init(&pool->caches);
 	pool->implem = implem;
 	pool->initial_mem_count = mem_count;
-	pool->mem_count = mem_count;
 	pool->mem_size = mem_size;
 	pool->max_mem_count = max_mem_count;
-	pool->mem_free = mem_count;
 	pool->policy = grow_policy;
+	pool->segment_size =
+		mem_count > 0 ? mem_count : MBUF_POOL_DEFAULT_SEGMENT_SIZE;
+	atomic_init(&pool->mem_count, 0);
+	atomic_init(&pool->mem_free, 0);
+	atomic_init(&pool->free_head, 0);
 	pool->name = name ? strdup(name) : strdup(MBUF_POOL_DEFAULT_NAME);
 	if (!pool->name) {
 		ret = -ENOMEM;
@@ -115,20 +348,21 @@ int mbuf_pool_new(const struct mbuf_mem_implem *implem,
 		goto error;
 	}
 	pool->lock_created = true;
-	for (size_t i = 0; i < pool->mem_count; i++) {
-		struct mbuf_mem *mem = calloc(1, sizeof(*mem));
+	for (size_t i = 0; i < mem_count; i++) {
+		struct mbuf_mem *mem = mbuf_pool_new_mem(pool);
 		if (!mem) {
 			ret = -ENOMEM;
 			goto error;
 		}
-		mem->size = mem_size;
-		mem->pool = pool;
 		ret = call_alloc(pool->implem, mem);
 		if (ret != 0) {
-			free(mem);
+			list_add_before(&pool->spares, &mem->node);
 			goto error;
 		}
 		list_add_before(&pool->memories, &mem->node);
+		atomic_fetch_add(&pool->mem_count, 1);
+		atomic_fetch_add(&pool->mem_free, 1);
+		mbuf_pool_push_free(pool, mem);
 	}
 
 	*ret_obj = pool;
@@ -140,64 +374,106 @@ error:
 }
 
 
-int mbuf_pool_get(struct mbuf_pool *pool, struct mbuf_mem **ret_obj)
+/* Slow path of mbuf_pool_get(), called when the free stack is empty */
+static int mbuf_pool_grow(struct mbuf_pool *pool, struct mbuf_mem **ret_obj)
 {
-	struct mbuf_mem *mem, *tmp;
-	unsigned int zero;
-	int ret;
-
-	ULOG_ERRNO_RETURN_ERR_IF(!pool, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(!ret_obj, EINVAL);
+	struct mbuf_mem *mem;
+	int ret = 0;
 
-	ret = pthread_mutex_lock(&pool->lock);
+	pthread_mutex_lock(&pool->lock);
 
-	list_walk_entry_forward_safe(&pool->memories, mem, tmp, node)
-	{
-		zero = 0;
-		if (atomic_compare_exchange_strong(&mem->refcount, &zero, 1)) {
-			/* We got a free memory from the pool, use it and
-			 * reduce the free memory count */
-			*ret_obj = mem;
-			ret = call_pool_get(pool->implem, mem);
-			if (ret != 0)
-				atomic_store(&mem->refcount, 0);
-			else
-				pool->mem_free--;
-			goto exit;
-		}
+	/* A memory might have been released in the meantime */
+	mem = mbuf_pool_pop_free(pool);
+	if (mem) {
+		atomic_fetch_sub(&pool->mem_free, 1);
+		goto exit;
 	}
+	/* Reclaim a memory from another thread cache before growing */
+	mem = mbuf_pool_cache_steal(pool);
+	if (mem)
+		goto exit;
 	if (pool->policy == MBUF_POOL_NO_GROW) {
 		ret = -EAGAIN;
 		goto exit;
 	}
-	if (pool->max_mem_count > 0 && pool->mem_count >= pool->max_mem_count) {
+	if (pool->max_mem_count > 0 &&
+	    atomic_load(&pool->mem_count) >= pool->max_mem_count) {
 		ret = -EAGAIN;
 		goto exit;
 	}
-	mem = calloc(1, sizeof(*mem));
+	mem = mbuf_pool_new_mem(pool);
 	if (!mem) {
 		ret = -ENOMEM;
 		goto exit;
 	}
-	mem->size = pool->mem_size;
-	mem->pool = pool;
 	ret = call_alloc(pool->implem, mem);
 	if (ret != 0) {
-		free(mem);
+		list_add_before(&pool->spares, &mem->node);
 		goto exit;
 	}
 	list_add_before(&pool->memories, &mem->node);
-	pool->mem_count++;
+	atomic_fetch_add(&pool->mem_count, 1);
+
+exit:
+	pthread_mutex_unlock(&pool->lock);
+	if (ret == 0)
+		*ret_obj = mem;
+	return ret;
+}
+
+
+int mbuf_pool_get(struct mbuf_pool *pool, struct mbuf_mem **ret_obj)
+{
+	struct mbuf_mem *mem, *busy = NULL;
+	int ret;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!pool, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!ret_obj, EINVAL);
+
+retry:
+	/* Fast path: take a memory from the thread cache, or the top of the
+	 * free stack */
+	mem = mbuf_pool_cache_get(pool);
+	if (mem)
+		goto found;
+	mem = mbuf_pool_pop_free(pool);
+	if (mem) {
+		atomic_fetch_sub(&pool->mem_free, 1);
+	} else {
+		ret = mbuf_pool_grow(pool, &mem);
+		if (ret != 0)
+			goto out;
+	}
+
+found:
+
 	atomic_store(&mem->refcount, 1);
 	ret = call_pool_get(pool->implem, mem);
-	if (ret != 0) {
-		call_free(pool->implem, mem);
-		free(mem);
-		goto exit;
+	if (ret == -EBUSY) {
+		/* The memory is still in use outside of the pool, set it aside
+		 * (chained through free_next) and try another one */
+		atomic_store(&mem->refcount, 0);
+		atomic_store(&mem->free_next, busy ? busy->index + 1 : 0);
+		busy = mem;
+		goto retry;
+	} else if (ret != 0) {
+		/* Return the memory to the pool */
+		atomic_store(&mem->refcount, 0);
+		atomic_fetch_add(&pool->mem_free, 1);
+		mbuf_pool_push_free(pool, mem);
+		goto out;
 	}
+
 	*ret_obj = mem;
-exit:
-	pthread_mutex_unlock(&pool->lock);
+
+out:
+	/* Return the busy memories to the pool */
+	while (busy) {
+		uint32_t next = atomic_load(&busy->free_next);
+		atomic_fetch_add(&pool->mem_free, 1);
+		mbuf_pool_push_free(pool, busy);
+		busy = next != 0 ? mbuf_pool_get_mem(pool, next - 1) : NULL;
+	}
 	return ret;
 }
 
@@ -210,18 +486,54 @@ const char *mbuf_pool_get_name(struct mbuf_pool *pool)
 }
 
 
+int mbuf_pool_set_thread_cache_size(struct mbuf_pool *pool,
+				    size_t cache_size)
+{
+	int ret;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!pool, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(cache_size == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(cache_size > MBUF_POOL_THREAD_CACHE_MAX_SIZE,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(pool->cache_key_created, EBUSY);
+
+	ret = pthread_key_create(&pool->cache_key, mbuf_pool_cache_destroy);
+	if (ret != 0) {
+		ULOG_ERRNO("pthread_key_create", ret);
+		return -ret;
+	}
+	pool->cache_key_created = true;
+	pool->cache_size = cache_size;
+
+	return 0;
+}
+
+
 int mbuf_pool_get_count(struct mbuf_pool *pool, size_t *count, size_t *free)
 {
+	struct mbuf_pool_cache *cache;
+	size_t cached = 0;
+
 	ULOG_ERRNO_RETURN_ERR_IF(!pool, EINVAL);
 
-	pthread_mutex_lock(&pool->lock);
+	if (free && pool->cache_size > 0) {
+		/* Cached memories are not accounted in mem_free */
+		pthread_mutex_lock(&pool->lock);
+		list_walk_entry_forward(&pool->caches, cache, node)
+		{
+			for (size_t i = 0; i < pool->cache_size; i++) {
+				if (atomic_load(&cache->mems[i]))
+					cached++;
+			}
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
 
 	if (count)
-		*count = pool->mem_count;
+		*count = atomic_load(&pool->mem_count);
 	if (free)
-		*free = pool->mem_free;
+		*free = atomic_load(&pool->mem_free) + cached;
 
-	pthread_mutex_unlock(&pool->lock);
 	return 0;
 }
 
@@ -229,25 +541,36 @@ int mbuf_pool_get_count(struct mbuf_pool *pool, size_t *count, size_t *free)
 int mbuf_pool_destroy(struct mbuf_pool *pool)
 {
 	struct mbuf_mem *mem, *tmp;
-	unsigned int zero;
+	struct mbuf_pool_cache *cache, *ctmp;
 
 	if (!pool)
 		return 0;
 
+	/* Deleting the key first prevents the thread caches destructors from
+	 * being called once the pool is destroyed */
+	if (pool->cache_key_created)
+		pthread_key_delete(pool->cache_key);
+
 	if (pool->lock_created)
 		pthread_mutex_lock(&pool->lock);
 
+	list_walk_entry_forward_safe(&pool->caches, cache, ctmp, node)
+	{
+		list_del(&cache->node);
+		free(cache);
+	}
+
 	list_walk_entry_forward_safe(&pool->memories, mem, tmp, node)
 	{
-		zero = 0;
-		if (!atomic_compare_exchange_strong(&mem->refcount, &zero, 1))
+		if (atomic_load(&mem->refcount) != 0)
 			ULOGW("pool %s: memory %p not released",
 			      pool->name,
 			      mem);
 		list_del(&mem->node);
 		call_free(pool->implem, mem);
-		free(mem);
 	}
+	for (size_t i = 0; i < MBUF_POOL_SEGMENT_COUNT; i++)
+		free(pool->segments[i]);
 
 	if (pool->lock_created) {
 		pthread_mutex_unlock(&pool->lock);
@@ -267,95 +590,73 @@ int mbuf_mem_ref(struct mbuf_mem *mem)
 }
 
 
-static void mbuf_pool_put(struct mbuf_pool *pool, struct mbuf_mem *mem)
+/* Check whether a memory returned to the pool should be released instead of
+ * being kept in the free stack */
+static bool mbuf_pool_should_release(struct mbuf_pool *pool)
 {
-	pool->mem_free++;
-
-	call_pool_put(pool->implem, mem);
-
-	bool release;
 	switch (pool->policy) {
 	case MBUF_POOL_NO_GROW:
 	case MBUF_POOL_GROW:
-		release = false;
-		break;
+		return false;
 	case MBUF_POOL_SMART_GROW:
-		release = pool->mem_free > pool->initial_mem_count;
-		break;
+		return atomic_load(&pool->mem_free) >= pool->initial_mem_count;
 	case MBUF_POOL_LOW_MEM_GROW:
-		release = pool->mem_count > pool->initial_mem_count;
-		break;
+		return atomic_load(&pool->mem_count) > pool->initial_mem_count;
 	default:
 		ULOGW("pool %s: unknown policy %d", pool->name, pool->policy);
-		release = false;
-		break;
+		return false;
 	}
-
-	if (!release)
-		return;
-
-	list_del(&mem->node);
-	pool->mem_count--;
-	pool->mem_free--;
-	call_free(pool->implem, mem);
-	free(mem);
 }
 
 
-static bool mbuf_mem_unref_internal(struct mbuf_mem **mem_)
+static void mbuf_pool_put(struct mbuf_pool *pool, struct mbuf_mem *mem)
 {
-	bool ok;
-	struct mbuf_mem *mem = *mem_;
-	if (!mem) {
-		return true;
-	};
-	pthread_mutex_t *lock;
-	unsigned int curr = atomic_load(&mem->refcount);
-
-	/* Handle the easy case first: unref, but not release */
-	if (curr > 1) {
-		unsigned int next = curr - 1;
-		return atomic_compare_exchange_weak(
-			&mem->refcount, &curr, next);
-	}
+	call_pool_put(pool->implem, mem);
 
-	/* If the ref count should reach zero, check if the memory does not
-	 * belong to a pool. In this case, free it directly */
-	if (!mem->pool) {
-		ok = atomic_compare_exchange_weak(&mem->refcount, &curr, 0);
-		if (!ok)
-			return false;
-		call_free(mem->implem, mem);
-		free(mem);
-		*mem_ = NULL;
-		return true;
+	if (mbuf_pool_should_release(pool)) {
+		/* Shrink the pool, the decision must be confirmed while
+		 * holding the pool lock */
+		pthread_mutex_lock(&pool->lock);
+		if (mbuf_pool_should_release(pool)) {
+			list_del(&mem->node);
+			atomic_fetch_sub(&pool->mem_count, 1);
+			call_free(pool->implem, mem);
+			list_add_before(&pool->spares, &mem->node);
+			pthread_mutex_unlock(&pool->lock);
+			return;
+		}
+		pthread_mutex_unlock(&pool->lock);
 	}
 
-	/* Otherwise, the release must be done while holding the pool lock */
-	lock = &mem->pool->lock;
-	pthread_mutex_lock(lock);
-
-	ok = atomic_compare_exchange_weak(&mem->refcount, &curr, 0);
-	if (!ok)
-		goto exit;
-	mbuf_pool_put(mem->pool, mem);
-	*mem_ = NULL;
+	if (mbuf_pool_cache_put(pool, mem))
+		return;
 
-exit:
-	pthread_mutex_unlock(lock);
-	return ok;
+	atomic_fetch_add(&pool->mem_free, 1);
+	mbuf_pool_push_free(pool, mem);
 }
 
 
 int mbuf_mem_unref(struct mbuf_mem *mem)
 {
 	ULOG_ERRNO_RETURN_ERR_IF(!mem, EINVAL);
-	bool ok;
 
-	do {
-		ok = mbuf_mem_unref_internal(&mem);
-	} while (!ok);
+	unsigned int prev = atomic_fetch_sub(&mem->refcount, 1);
+	if (prev > 1)
+		return 0;
+	if (prev == 0) {
+		ULOGE("calling unref on a memory with refcount zero");
+		atomic_store(&mem->refcount, 0);
+		return -EINVAL;
+	}
 
+	/* If the memory does not belong to a pool, free it directly,
+	 * otherwise return it to its pool */
+	if (!mem->pool) {
+		call_free(mem->implem, mem);
+		free(mem);
+		return 0;
+	}
+	mbuf_pool_put(mem->pool, mem);
 	return 0;
 }
 
@@ -54,13 +54,28 @@ struct mbuf_raw_video_frame {
 };
 
 
+static struct mbuf_base_frame_cache s_frame_cache =
+	MBUF_BASE_FRAME_CACHE_INITIALIZER;
+
+
 struct mbuf_raw_video_frame_queue {
 	struct mbuf_base_frame_queue base;
 	mbuf_raw_video_frame_queue_filter_t filter;
 	void *filter_userdata;
+	mbuf_raw_video_frame_queue_cmp_t cmp;
+	void *cmp_userdata;
 };
 
 
+static void mbuf_raw_video_frame_destroy(void *cframe)
+{
+	struct mbuf_raw_video_frame *frame = cframe;
+
+	mbuf_base_frame_deinit(&frame->base);
+	free(frame);
+}
+
+
 static void mbuf_raw_video_frame_cleaner(void *rframe)
 {
 	struct mbuf_raw_video_frame *frame = rframe;
@@ -86,8 +101,11 @@ static void mbuf_raw_video_frame_cleaner(void *rframe)
 			frame->planes[i].mem = NULL;
 		}
 	}
-	mbuf_base_frame_deinit(&frame->base);
-	free(frame);
+
+	if (mbuf_base_frame_cache_put(&s_frame_cache, &frame->base))
+		return;
+
+	mbuf_raw_video_frame_destroy(frame);
 }
 
 
@@ -100,20 +118,49 @@ int mbuf_raw_video_frame_new(struct vdef_raw_frame *frame_info,
 	ULOG_ERRNO_RETURN_ERR_IF(!vdef_is_raw_format_valid(&frame_info->format),
 				 EINVAL);
 
-	struct mbuf_raw_video_frame *frame = calloc(1, sizeof(*frame));
-	if (!frame)
-		return -ENOMEM;
+	struct mbuf_raw_video_frame *frame =
+		mbuf_base_frame_cache_get(&s_frame_cache);
+	if (frame) {
+		memset(frame->planes, 0, sizeof(frame->planes));
+		memset(&frame->cbs, 0, sizeof(frame->cbs));
+	} else {
+		frame = calloc(1, sizeof(*frame));
+		if (!frame)
+			return -ENOMEM;
+		mbuf_base_frame_init(
+			&frame->base, frame, mbuf_raw_video_frame_cleaner);
+	}
 	frame->info = *frame_info;
 	frame->nplanes = vdef_get_raw_frame_plane_count(&frame_info->format);
 
-	mbuf_base_frame_init(&frame->base, frame, mbuf_raw_video_frame_cleaner);
-
 	*ret_obj = frame;
 
 	return 0;
 }
 
 
+int mbuf_raw_video_frame_cache_flush(void)
+{
+	return mbuf_base_frame_cache_flush(&s_frame_cache,
+					   mbuf_raw_video_frame_destroy);
+}
+
+
+int mbuf_raw_video_frame_cache_set_size(unsigned int cache_size)
+{
+	return mbuf_base_frame_cache_set_size(&s_frame_cache,
+					      cache_size,
+					      mbuf_raw_video_frame_destroy);
+}
+
+
+/* Free the cached frames when the library is unloaded */
+__attribute__((destructor)) static void mbuf_raw_video_frame_cache_fini(void)
+{
+	mbuf_raw_video_frame_cache_flush();
+}
+
+
 int mbuf_raw_video_frame_set_callbacks(struct mbuf_raw_video_frame *frame,
 				       struct mbuf_raw_video_frame_cbs *cbs)
 {
@@ -554,8 +601,7 @@ int mbuf_raw_video_frame_copy(struct mbuf_raw_video_frame *frame,
 	if (ret != 0)
 		goto out;
 
-	ret = mbuf_raw_video_frame_foreach_ancillary_data(
-		frame, mbuf_raw_video_frame_ancillary_data_copier, new_frame);
+	ret = mbuf_base_frame_copy_ancillary(&new_frame->base, &frame->base);
 	if (ret != 0)
 		goto out;
 
@@ -614,7 +660,7 @@ int mbuf_raw_video_frame_copy(struct mbuf_raw_video_frame *frame,
 		}
 	}
 
-	mbuf_base_frame_set_metadata(&new_frame->base, frame->base.meta);
+	mbuf_base_frame_copy_metadata(&new_frame->base, &frame->base);
 
 out:
 	/* Release read-lock before returning */
@@ -659,8 +705,7 @@ int mbuf_raw_video_frame_copy_with_align(
 	if (ret != 0)
 		goto out;
 
-	ret = mbuf_raw_video_frame_foreach_ancillary_data(
-		frame, mbuf_raw_video_frame_ancillary_data_copier, new_frame);
+	ret = mbuf_base_frame_copy_ancillary(&new_frame->base, &frame->base);
 	if (ret != 0)
 		goto out;
 
@@ -699,7 +744,7 @@ int mbuf_raw_video_frame_copy_with_align(
 		new_frame->info.plane_stride[i] = plane_stride[i];
 	}
 
-	mbuf_base_frame_set_metadata(&new_frame->base, frame->base.meta);
+	mbuf_base_frame_copy_metadata(&new_frame->base, &frame->base);
 
 out:
 	/* Release read-lock before returning */
@@ -773,6 +818,40 @@ int mbuf_raw_video_frame_add_ancillary_buffer_with_cbs(
 }
 
 
+int
+mbuf_raw_video_frame_add_ancillary_adopt(struct mbuf_raw_video_frame *frame,
+					 const char *name,
+					 void *buffer,
+					 size_t len,
+					 mbuf_ancillary_data_release_t release,
+					 void *userdata)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!name, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!buffer, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(len == 0, EINVAL);
+
+	return mbuf_base_frame_add_ancillary_adopt(
+		&frame->base, name, buffer, len, release, userdata);
+}
+
+
+int mbuf_raw_video_frame_add_ancillary_mem(struct mbuf_raw_video_frame *frame,
+					   const char *name,
+					   struct mbuf_mem *mem,
+					   size_t offset,
+					   size_t len)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!name, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!mem, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(len == 0, EINVAL);
+
+	return mbuf_base_frame_add_ancillary_mem(
+		&frame->base, name, mem, offset, len);
+}
+
+
 int mbuf_raw_video_frame_add_ancillary_data(struct mbuf_raw_video_frame *frame,
 					    struct mbuf_ancillary_data *data)
 {
@@ -807,6 +886,62 @@ int mbuf_raw_video_frame_remove_ancillary_data(
 }
 
 
+int mbuf_raw_video_frame_add_ancillary_string_by_key(
+	struct mbuf_raw_video_frame *frame,
+	uint32_t key,
+	const char *value)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(key == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!value, EINVAL);
+
+	return mbuf_base_frame_add_ancillary_string_by_key(
+		&frame->base, key, value);
+}
+
+
+int mbuf_raw_video_frame_add_ancillary_buffer_by_key(
+	struct mbuf_raw_video_frame *frame,
+	uint32_t key,
+	const void *buffer,
+	size_t len)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(key == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!buffer, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(len == 0, EINVAL);
+
+	return mbuf_base_frame_add_ancillary_buffer_by_key(
+		&frame->base, key, buffer, len);
+}
+
+
+int mbuf_raw_video_frame_get_ancillary_data_by_key(
+	struct mbuf_raw_video_frame *frame,
+	uint32_t key,
+	struct mbuf_ancillary_data **data)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!data, EINVAL);
+	*data = NULL;
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(key == 0, EINVAL);
+
+	return mbuf_base_frame_get_ancillary_data_by_key(
+		&frame->base, key, data);
+}
+
+
+int mbuf_raw_video_frame_remove_ancillary_data_by_key(
+	struct mbuf_raw_video_frame *frame,
+	uint32_t key)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(key == 0, EINVAL);
+
+	return mbuf_base_frame_remove_ancillary_data_by_key(&frame->base, key);
+}
+
+
 int mbuf_raw_video_frame_foreach_ancillary_data(
 	struct mbuf_raw_video_frame *frame,
 	mbuf_ancillary_data_cb_t cb,
@@ -838,6 +973,49 @@ bool mbuf_raw_video_frame_ancillary_data_copier(
 /* Queue API */
 
 
+static int mbuf_raw_video_frame_queue_cmp_timestamp(struct mbuf_base_frame *a,
+						    struct mbuf_base_frame *b,
+						    void *userdata)
+{
+	struct mbuf_raw_video_frame *frame_a = a->parent;
+	struct mbuf_raw_video_frame *frame_b = b->parent;
+	uint64_t ts_a = frame_a->info.info.timestamp;
+	uint64_t ts_b = frame_b->info.info.timestamp;
+
+	return (ts_a > ts_b) - (ts_a < ts_b);
+}
+
+
+static int mbuf_raw_video_frame_queue_cmp_custom(struct mbuf_base_frame *a,
+						 struct mbuf_base_frame *b,
+						 void *userdata)
+{
+	struct mbuf_raw_video_frame_queue *queue = userdata;
+
+	return queue->cmp(a->parent, b->parent, queue->cmp_userdata);
+}
+
+
+static size_t mbuf_raw_video_frame_queue_get_size(struct mbuf_base_frame *base)
+{
+	struct mbuf_raw_video_frame *frame = base->parent;
+	ssize_t size = mbuf_raw_video_frame_get_packed_size(frame, false);
+
+	return size > 0 ? (size_t)size : 0;
+}
+
+
+static uint64_t
+mbuf_raw_video_frame_queue_get_time(struct mbuf_base_frame *base)
+{
+	struct mbuf_raw_video_frame *frame = base->parent;
+	uint64_t ts = frame->info.info.timestamp;
+	unsigned int timescale = frame->info.info.timescale;
+
+	return mbuf_time_to_us(ts, timescale);
+}
+
+
 int mbuf_raw_video_frame_queue_new(struct mbuf_raw_video_frame_queue **ret_obj)
 {
 	return mbuf_raw_video_frame_queue_new_with_args(NULL, ret_obj);
@@ -857,8 +1035,41 @@ int mbuf_raw_video_frame_queue_new_with_args(
 	queue->filter = args ? args->filter : NULL;
 	queue->filter_userdata = args ? args->filter_userdata : NULL;
 	int max_frames = args ? args->max_frames : 0;
+	enum mbuf_frame_queue_mode mode =
+		args ? args->mode : MBUF_FRAME_QUEUE_MODE_LOCKED;
+	enum mbuf_frame_queue_order order =
+		args ? args->order : MBUF_FRAME_QUEUE_ORDER_FIFO;
+	mbuf_base_frame_cmp_t cmp = NULL;
+	queue->cmp = args ? args->cmp : NULL;
+	queue->cmp_userdata = args ? args->cmp_userdata : NULL;
+
+	switch (order) {
+	case MBUF_FRAME_QUEUE_ORDER_FIFO:
+		break;
+	case MBUF_FRAME_QUEUE_ORDER_TIMESTAMP:
+		cmp = mbuf_raw_video_frame_queue_cmp_timestamp;
+		break;
+	case MBUF_FRAME_QUEUE_ORDER_CUSTOM:
+		if (queue->cmp) {
+			cmp = mbuf_raw_video_frame_queue_cmp_custom;
+			break;
+		}
+		/* Fallthrough */
+	default:
+		free(queue);
+		ULOG_ERRNO("invalid queue order", EINVAL);
+		return -EINVAL;
+	}
 
-	int ret = mbuf_base_frame_queue_init(&queue->base, max_frames);
+	int ret = mbuf_base_frame_queue_init(
+		&queue->base, max_frames, mode, cmp, queue);
+	if (ret == 0 && args)
+		ret = mbuf_base_frame_queue_set_limits(
+			&queue->base,
+			args->max_bytes,
+			args->max_duration_us,
+			mbuf_raw_video_frame_queue_get_size,
+			mbuf_raw_video_frame_queue_get_time);
 	if (ret != 0) {
 		mbuf_raw_video_frame_queue_destroy(queue);
 		queue = NULL;
@@ -884,6 +1095,60 @@ int mbuf_raw_video_frame_queue_push(struct mbuf_raw_video_frame_queue *queue,
 }
 
 
+int mbuf_raw_video_frame_queue_push_batch(
+	struct mbuf_raw_video_frame_queue *queue,
+	struct mbuf_raw_video_frame *const *frames,
+	unsigned int count,
+	unsigned int *out_count)
+{
+	int ret;
+	struct mbuf_base_frame *bases[MBUF_BASE_FRAME_QUEUE_BATCH_SIZE];
+	unsigned int indexes[MBUF_BASE_FRAME_QUEUE_BATCH_SIZE];
+	unsigned int n = 0, pushed;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!out_count, EINVAL);
+	*out_count = 0;
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!frames && count > 0, EINVAL);
+
+	/* Check all frames first, so that an invalid batch is not partially
+	 * pushed */
+	for (unsigned int i = 0; i < count; i++) {
+		ULOG_ERRNO_RETURN_ERR_IF(!frames[i], EINVAL);
+		ULOG_ERRNO_RETURN_ERR_IF(
+			!mbuf_base_frame_is_finalized(&frames[i]->base), EBUSY);
+	}
+
+	/* The last iteration (i == count) flushes the remaining frames */
+	for (unsigned int i = 0; i <= count; i++) {
+		if (i < count) {
+			if (queue->filter &&
+			    !queue->filter(frames[i], queue->filter_userdata))
+				continue;
+			indexes[n] = i;
+			bases[n++] = &frames[i]->base;
+			if (n < MBUF_BASE_FRAME_QUEUE_BATCH_SIZE)
+				continue;
+		} else if (n == 0) {
+			break;
+		}
+		ret = mbuf_base_frame_queue_push_batch(
+			&queue->base, bases, n, &pushed);
+		if (ret != 0) {
+			/* Frames before the failed one were handled (pushed
+			 * or filtered out) */
+			*out_count = pushed < n ? indexes[pushed]
+						: indexes[n - 1] + 1;
+			return ret;
+		}
+		n = 0;
+	}
+	*out_count = count;
+
+	return 0;
+}
+
+
 int mbuf_raw_video_frame_queue_peek(struct mbuf_raw_video_frame_queue *queue,
 				    struct mbuf_raw_video_frame **out_frame)
 {
@@ -922,6 +1187,42 @@ int mbuf_raw_video_frame_queue_peek_at(struct mbuf_raw_video_frame_queue *queue,
 }
 
 
+int
+mbuf_raw_video_frame_queue_peek_range(struct mbuf_raw_video_frame_queue *queue,
+				      unsigned int start,
+				      struct mbuf_raw_video_frame **frames,
+				      unsigned int max_count,
+				      unsigned int *out_count)
+{
+	int ret = 0;
+	void *tmp_frames[MBUF_BASE_FRAME_QUEUE_BATCH_SIZE];
+	unsigned int total = 0, n;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!out_count, EINVAL);
+	*out_count = 0;
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!frames, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(max_count == 0, EINVAL);
+
+	while (total < max_count) {
+		unsigned int chunk = max_count - total;
+		if (chunk > MBUF_BASE_FRAME_QUEUE_BATCH_SIZE)
+			chunk = MBUF_BASE_FRAME_QUEUE_BATCH_SIZE;
+		ret = mbuf_base_frame_queue_peek_range(
+			&queue->base, start + total, tmp_frames, chunk, &n);
+		if (ret != 0)
+			break;
+		for (unsigned int i = 0; i < n; i++)
+			frames[total++] = tmp_frames[i];
+		if (n < chunk)
+			break;
+	}
+
+	*out_count = total;
+	return total > 0 ? 0 : ret;
+}
+
+
 int mbuf_raw_video_frame_queue_pop(struct mbuf_raw_video_frame_queue *queue,
 				   struct mbuf_raw_video_frame **out_frame)
 {
@@ -940,6 +1241,60 @@ int mbuf_raw_video_frame_queue_pop(struct mbuf_raw_video_frame_queue *queue,
 }
 
 
+int
+mbuf_raw_video_frame_queue_pop_wait(struct mbuf_raw_video_frame_queue *queue,
+				    struct mbuf_raw_video_frame **out_frame,
+				    int64_t timeout_ns)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!out_frame, EINVAL);
+	*out_frame = NULL;
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+
+	void *tmp_frame;
+	int ret = mbuf_base_frame_queue_pop_wait(
+		&queue->base, &tmp_frame, timeout_ns);
+
+	if (ret == 0)
+		*out_frame = tmp_frame;
+	return ret;
+}
+
+
+int mbuf_raw_video_frame_queue_pop_batch(
+	struct mbuf_raw_video_frame_queue *queue,
+	struct mbuf_raw_video_frame **frames,
+	unsigned int max_count,
+	unsigned int *out_count)
+{
+	int ret = 0;
+	void *tmp_frames[MBUF_BASE_FRAME_QUEUE_BATCH_SIZE];
+	unsigned int total = 0, n;
+
+	ULOG_ERRNO_RETURN_ERR_IF(!out_count, EINVAL);
+	*out_count = 0;
+	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!frames, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(max_count == 0, EINVAL);
+
+	while (total < max_count) {
+		unsigned int chunk = max_count - total;
+		if (chunk > MBUF_BASE_FRAME_QUEUE_BATCH_SIZE)
+			chunk = MBUF_BASE_FRAME_QUEUE_BATCH_SIZE;
+		ret = mbuf_base_frame_queue_pop_batch(
+			&queue->base, tmp_frames, chunk, &n);
+		if (ret != 0)
+			break;
+		for (unsigned int i = 0; i < n; i++)
+			frames[total++] = tmp_frames[i];
+		if (n < chunk)
+			break;
+	}
+
+	*out_count = total;
+	return total > 0 ? 0 : ret;
+}
+
+
 int mbuf_raw_video_frame_queue_flush(struct mbuf_raw_video_frame_queue *queue)
 {
 	ULOG_ERRNO_RETURN_ERR_IF(!queue, EINVAL);
@@ -978,3 +1333,112 @@ int mbuf_raw_video_frame_queue_destroy(struct mbuf_raw_video_frame_queue *queue)
 	free(queue);
 	return 0;
 }
+
+
+/* Broadcast queue API (typed pointers are casts of the base objects) */
+
+
+int mbuf_raw_video_frame_bcast_new(unsigned int max_frames,
+				   struct mbuf_raw_video_frame_bcast **ret_obj)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!ret_obj, EINVAL);
+	*ret_obj = NULL;
+	ULOG_ERRNO_RETURN_ERR_IF(max_frames == 0, EINVAL);
+
+	struct mbuf_base_frame_bcast *bcast;
+	int ret = mbuf_base_frame_bcast_new(max_frames, &bcast);
+
+	*ret_obj = (struct mbuf_raw_video_frame_bcast *)bcast;
+	return ret;
+}
+
+
+int mbuf_raw_video_frame_bcast_push(struct mbuf_raw_video_frame_bcast *bcast,
+				    struct mbuf_raw_video_frame *frame)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!bcast, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!frame, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!mbuf_base_frame_is_finalized(&frame->base),
+				 EBUSY);
+
+	return mbuf_base_frame_bcast_push((struct mbuf_base_frame_bcast *)bcast,
+					  &frame->base);
+}
+
+
+int mbuf_raw_video_frame_bcast_destroy(struct mbuf_raw_video_frame_bcast *bcast)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!bcast, EINVAL);
+
+	return mbuf_base_frame_bcast_destroy(
+		(struct mbuf_base_frame_bcast *)bcast);
+}
+
+
+int mbuf_raw_video_frame_bcast_reader_new(
+	struct mbuf_raw_video_frame_bcast *bcast,
+	unsigned int max_frames,
+	struct mbuf_raw_video_frame_bcast_reader **ret_obj)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!ret_obj, EINVAL);
+	*ret_obj = NULL;
+	ULOG_ERRNO_RETURN_ERR_IF(!bcast, EINVAL);
+
+	struct mbuf_base_frame_bcast_reader *reader;
+	int ret = mbuf_base_frame_bcast_reader_new(
+		(struct mbuf_base_frame_bcast *)bcast, max_frames, &reader);
+
+	*ret_obj = (struct mbuf_raw_video_frame_bcast_reader *)reader;
+	return ret;
+}
+
+
+int mbuf_raw_video_frame_bcast_reader_pop(
+	struct mbuf_raw_video_frame_bcast_reader *reader,
+	struct mbuf_raw_video_frame **out_frame)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!out_frame, EINVAL);
+	*out_frame = NULL;
+	ULOG_ERRNO_RETURN_ERR_IF(!reader, EINVAL);
+
+	void *tmp_frame;
+	int ret = mbuf_base_frame_bcast_reader_pop(
+		(struct mbuf_base_frame_bcast_reader *)reader, &tmp_frame);
+
+	if (ret == 0)
+		*out_frame = tmp_frame;
+	return ret;
+}
+
+
+int mbuf_raw_video_frame_bcast_reader_get_event(
+	struct mbuf_raw_video_frame_bcast_reader *reader,
+	struct pomp_evt **out_evt)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!out_evt, EINVAL);
+	*out_evt = NULL;
+	ULOG_ERRNO_RETURN_ERR_IF(!reader, EINVAL);
+
+	return mbuf_base_frame_bcast_reader_get_event(
+		(struct mbuf_base_frame_bcast_reader *)reader, out_evt);
+}
+
+
+int mbuf_raw_video_frame_bcast_reader_get_count(
+	struct mbuf_raw_video_frame_bcast_reader *reader)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!reader, EINVAL);
+
+	return mbuf_base_frame_bcast_reader_get_count(
+		(struct mbuf_base_frame_bcast_reader *)reader);
+}
+
+
+int mbuf_raw_video_frame_bcast_reader_destroy(
+	struct mbuf_raw_video_frame_bcast_reader *reader)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!reader, EINVAL);
+
+	return mbuf_base_frame_bcast_reader_destroy(
+		(struct mbuf_base_frame_bcast_reader *)reader);
+}
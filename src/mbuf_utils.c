@@ -105,3 +105,13 @@ int mbuf_rwlock_rdunlock(mbuf_rwlock_t *lock)
 	}
 	return 0;
 }
+
+
+uint64_t mbuf_time_to_us(uint64_t ts, unsigned int timescale)
+{
+	if (timescale == 0)
+		return ts;
+
+	return ts / timescale * 1000000 +
+	       ts % timescale * 1000000 / timescale;
+}
@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define RWLOCK_WRLOCKED -1
 #define RWLOCK_FREE 0
@@ -56,4 +57,10 @@ int mbuf_rwlock_rdlock(mbuf_rwlock_t *lock);
 int mbuf_rwlock_rdunlock(mbuf_rwlock_t *lock);
 
 
+/* Convert a timestamp in timescale units to microseconds, without
+ * overflowing for large timestamps; a timescale of 0 returns the timestamp
+ * unchanged */
+uint64_t mbuf_time_to_us(uint64_t ts, unsigned int timescale);
+
+
 #endif /* _MBUF_UTILS_H_ */
@@ -130,11 +130,231 @@ static void test_mbuf_ancillary_data_parse_key(void)
 	CU_ASSERT_STRING_EQUAL(str, EXPECTED_NAME1);
 	CU_ASSERT_EQUAL(ptr, 0);
 	free(str);
+
+	/* Same strictness as the non-allocating version */
+	ret = mbuf_ancillary_data_parse_key("com.parrot.key1:", &str, &ptr);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	CU_ASSERT_PTR_NULL(str);
+	ret = mbuf_ancillary_data_parse_key("com.parrot.key1:-12", &str, &ptr);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_ancillary_data_parse_key(":0x12", &str, &ptr);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	/* Round-trip with the build function, including a pointer with
+	 * decimal digits only, which is still written in hexadecimal */
+	const uintptr_t ptrs[] = {
+		(uintptr_t)&ptr,
+		(uintptr_t)0x1234,
+		UINTPTR_MAX,
+	};
+	for (size_t i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++) {
+		char *key = NULL;
+		ret = mbuf_ancillary_data_build_key(
+			EXPECTED_NAME1, ptrs[i], &key);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			continue;
+		ret = mbuf_ancillary_data_parse_key(key, &str, &ptr);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret == 0) {
+			CU_ASSERT_STRING_EQUAL(str, EXPECTED_NAME1);
+			CU_ASSERT_EQUAL(ptr, ptrs[i]);
+			free(str);
+		}
+		free(key);
+	}
+}
+
+
+static void test_mbuf_ancillary_data_key_buf(void)
+{
+	int ret;
+	char *expected;
+	const char *NAME1 = "com.parrot.key1";
+	const uintptr_t PTR1 = 0xABCDEF;
+	char key[64];
+	char name[64];
+	uintptr_t ptr = 1;
+
+	ret = mbuf_ancillary_data_build_key_buf(NULL, 0, key, sizeof(key));
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_ancillary_data_build_key_buf(NAME1, 0, NULL, sizeof(key));
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_ancillary_data_parse_key_buf(NULL, name, sizeof(name), &ptr);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_ancillary_data_parse_key_buf(NAME1, NULL, 0, &ptr);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_ancillary_data_parse_key_buf(
+		NAME1, name, sizeof(name), NULL);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	/* Same keys as the allocating version */
+	ret = mbuf_ancillary_data_build_key_buf(NAME1, 0, key, sizeof(key));
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_STRING_EQUAL(key, NAME1);
+	ret = asprintf(&expected, "%s:%" PRIxPTR, NAME1, PTR1);
+	CU_ASSERT_PTR_NOT_NULL(expected);
+	ret = mbuf_ancillary_data_build_key_buf(NAME1, PTR1, key, sizeof(key));
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_STRING_EQUAL(key, expected);
+	free(expected);
+
+	/* Too small buffers */
+	ret = mbuf_ancillary_data_build_key_buf(
+		NAME1, PTR1, key, strlen(NAME1) + 2);
+	CU_ASSERT_EQUAL(ret, -ENOSPC);
+	ret = mbuf_ancillary_data_parse_key_buf(
+		"com.parrot.key1:0x12", name, strlen(NAME1), &ptr);
+	CU_ASSERT_EQUAL(ret, -ENOSPC);
+
+	/* Parsing */
+	ret = mbuf_ancillary_data_parse_key_buf(
+		"com.parrot.key1:0xABCDEF", name, sizeof(name), &ptr);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_STRING_EQUAL(name, NAME1);
+	CU_ASSERT_EQUAL(ptr, PTR1);
+	ret = mbuf_ancillary_data_parse_key_buf(
+		NAME1, name, strlen(NAME1) + 1, &ptr);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_STRING_EQUAL(name, NAME1);
+	CU_ASSERT_EQUAL(ptr, 0);
+	ret = mbuf_ancillary_data_parse_key_buf(
+		"com.parrot.key1:", name, sizeof(name), &ptr);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_ancillary_data_parse_key_buf(
+		"com.parrot.key1:0x12zz", name, sizeof(name), &ptr);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_ancillary_data_parse_key_buf(
+		":0x12", name, sizeof(name), &ptr);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_ancillary_data_parse_key_buf(
+		"com.parrot.key1:-12", name, sizeof(name), &ptr);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	/* Round-trip with real instance pointers: a pointer with hexadecimal
+	 * letters, and one with decimal digits only */
+	const uintptr_t ptrs[] = {
+		(uintptr_t)&ptr,
+		(uintptr_t)0x1234,
+		UINTPTR_MAX,
+	};
+	for (size_t i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++) {
+		ret = mbuf_ancillary_data_build_key_buf(
+			NAME1, ptrs[i], key, sizeof(key));
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_ancillary_data_parse_key_buf(
+			key, name, sizeof(name), &ptr);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_STRING_EQUAL(name, NAME1);
+		CU_ASSERT_EQUAL(ptr, ptrs[i]);
+	}
+
+	/* Keys built by the allocating version are parsed back too */
+	ret = mbuf_ancillary_data_build_key(NAME1, (uintptr_t)&ptr, &expected);
+	CU_ASSERT_EQUAL(ret, 0);
+	if (ret == 0) {
+		ret = mbuf_ancillary_data_parse_key_buf(
+			expected, name, sizeof(name), &ptr);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(ptr, (uintptr_t)&ptr);
+		free(expected);
+	}
+}
+
+
+static void test_mbuf_ancillary_data_intern_key(void)
+{
+	int ret;
+	uint32_t key1, key2, sei_key;
+	const char *NAME1 = "com.parrot.test.interned";
+	const char *value;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+	};
+	struct mbuf_coded_video_frame *frame;
+	struct mbuf_ancillary_data *data;
+
+	ret = mbuf_ancillary_data_intern_key(NULL, &key1);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_ancillary_data_intern_key(NAME1, NULL);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	CU_ASSERT_PTR_NULL(mbuf_ancillary_data_get_key_name(0));
+
+	/* Well-known keys are pre-interned */
+	ret = mbuf_ancillary_data_intern_key(MBUF_ANCILLARY_KEY_USERDATA_SEI,
+					     &sei_key);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(sei_key, MBUF_ANCILLARY_KEY_ID_USERDATA_SEI);
+	CU_ASSERT_STRING_EQUAL(
+		mbuf_ancillary_data_get_key_name(sei_key),
+		MBUF_ANCILLARY_KEY_USERDATA_SEI);
+
+	/* Interning a name twice returns the same key */
+	ret = mbuf_ancillary_data_intern_key(NAME1, &key1);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_NOT_EQUAL(key1, 0);
+	CU_ASSERT_NOT_EQUAL(key1, sei_key);
+	ret = mbuf_ancillary_data_intern_key(NAME1, &key2);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(key1, key2);
+	CU_ASSERT_STRING_EQUAL(mbuf_ancillary_data_get_key_name(key1), NAME1);
+
+	/* Data added by key can be accessed by name, and vice versa */
+	ret = mbuf_coded_video_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_add_ancillary_string_by_key(
+		frame, key1, "value1");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_add_ancillary_string(
+		frame, NAME1, "value2");
+	CU_ASSERT_EQUAL(ret, -EEXIST);
+	ret = mbuf_coded_video_frame_get_ancillary_data(frame, NAME1, &data);
+	CU_ASSERT_EQUAL(ret, 0);
+	if (ret == 0) {
+		value = mbuf_ancillary_data_get_string(data);
+		CU_ASSERT_STRING_EQUAL(value, "value1");
+		CU_ASSERT_STRING_EQUAL(mbuf_ancillary_data_get_name(data),
+				       NAME1);
+		mbuf_ancillary_data_unref(data);
+	}
+	ret = mbuf_coded_video_frame_remove_ancillary_data(frame, NAME1);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	ret = mbuf_coded_video_frame_add_ancillary_string(
+		frame, MBUF_ANCILLARY_KEY_USERDATA_SEI, "sei");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_add_ancillary_buffer_by_key(
+		frame, sei_key, "sei", 4);
+	CU_ASSERT_EQUAL(ret, -EEXIST);
+	ret = mbuf_coded_video_frame_get_ancillary_data_by_key(
+		frame, sei_key, &data);
+	CU_ASSERT_EQUAL(ret, 0);
+	if (ret == 0) {
+		value = mbuf_ancillary_data_get_string(data);
+		CU_ASSERT_STRING_EQUAL(value, "sei");
+		mbuf_ancillary_data_unref(data);
+	}
+	ret = mbuf_coded_video_frame_remove_ancillary_data_by_key(frame,
+								  sei_key);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_remove_ancillary_data_by_key(frame,
+								  sei_key);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	/* Unknown keys */
+	ret = mbuf_coded_video_frame_get_ancillary_data_by_key(
+		frame, UINT32_MAX, &data);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	ret = mbuf_coded_video_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
 }
 
 
 CU_TestInfo g_mbuf_test_ancillary[] = {
 	{(char *)"build-key", &test_mbuf_ancillary_data_build_key},
 	{(char *)"parse-key", &test_mbuf_ancillary_data_parse_key},
+	{(char *)"key-buf", &test_mbuf_ancillary_data_key_buf},
+	{(char *)"intern-key", &test_mbuf_ancillary_data_intern_key},
 	CU_TEST_INFO_NULL,
 };
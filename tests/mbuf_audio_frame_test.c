@@ -26,6 +26,8 @@
 
 #include "mbuf_test.h"
 
+#include <pthread.h>
+#include <unistd.h>
 
 #define MBUF_TEST_CHANNEL_COUNT 1
 #define MBUF_TEST_BIT_DEPTH 8
@@ -1084,6 +1086,206 @@ static bool ancillary_iterator(struct mbuf_ancillary_data *data, void *userdata)
 }
 
 
+struct audio_queue_wait_ctx {
+	struct mbuf_audio_frame_queue *queue;
+	struct mbuf_audio_frame *frame;
+};
+
+
+static void *audio_queue_wait_thread(void *userdata)
+{
+	struct audio_queue_wait_ctx *ctx = userdata;
+
+	/* Let the main thread start waiting */
+	usleep(10000);
+
+	return (void *)(intptr_t)mbuf_audio_frame_queue_push(ctx->queue,
+							     ctx->frame);
+}
+
+
+static void test_mbuf_audio_frame_queue_wait(void)
+{
+	int ret;
+	struct adef_frame frame_info;
+	struct mbuf_audio_frame *frame, *out_frame;
+	struct audio_queue_wait_ctx ctx;
+	pthread_t thread;
+	void *thread_ret;
+	enum mbuf_frame_queue_mode modes[] = {
+		MBUF_FRAME_QUEUE_MODE_LOCKED,
+		MBUF_FRAME_QUEUE_MODE_LOCKFREE,
+	};
+
+	init_frame_info(&frame_info, ADEF_ENCODING_AAC_LC);
+
+	/* Create the frame used by the test */
+	ret = mbuf_audio_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	set_buffer(frame, NULL);
+	ret = mbuf_audio_frame_finalize(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		struct mbuf_audio_frame_queue_args args = {
+			.max_frames = 2,
+			.mode = modes[i],
+		};
+		ret = mbuf_audio_frame_queue_new_with_args(&args, &ctx.queue);
+		CU_ASSERT_EQUAL(ret, 0);
+		ctx.frame = frame;
+
+		/* Waiting on an empty queue should time out */
+		ret = mbuf_audio_frame_queue_pop_wait(ctx.queue, &out_frame, 0);
+		CU_ASSERT_EQUAL(ret, -EAGAIN);
+		ret = mbuf_audio_frame_queue_pop_wait(
+			ctx.queue, &out_frame, 1000000);
+		CU_ASSERT_EQUAL(ret, -ETIMEDOUT);
+
+		/* Wait forever, a thread pushes the frame */
+		ret = pthread_create(
+			&thread, NULL, audio_queue_wait_thread, &ctx);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_audio_frame_queue_pop_wait(
+			ctx.queue, &out_frame, -1);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_PTR_EQUAL(out_frame, frame);
+		pthread_join(thread, &thread_ret);
+		CU_ASSERT_EQUAL((intptr_t)thread_ret, 0);
+		ret = mbuf_audio_frame_unref(out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		/* A frame already in the queue is returned immediately */
+		ret = mbuf_audio_frame_queue_push(ctx.queue, frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_audio_frame_queue_pop_wait(
+			ctx.queue, &out_frame, 1000000);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_audio_frame_unref(out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		ret = mbuf_audio_frame_queue_destroy(ctx.queue);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Cleanup */
+	ret = mbuf_audio_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
+static void test_mbuf_audio_frame_queue_limits(void)
+{
+	int ret;
+	struct adef_frame frame_info;
+	struct mbuf_audio_frame *frames[5], *out_frame;
+	struct mbuf_audio_frame_queue *queue;
+	size_t frame_size;
+
+	init_frame_info(&frame_info, ADEF_ENCODING_AAC_LC);
+	frame_size = get_frame_size(&frame_info);
+
+	/* Create 5 frames, 10ms apart */
+	for (unsigned int i = 0; i < 5; i++) {
+		frame_info.info.timestamp = i * 10000;
+		ret = mbuf_audio_frame_new(&frame_info, &frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		set_buffer(frames[i], NULL);
+		ret = mbuf_audio_frame_finalize(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Limits are not supported by lock-free queues */
+	struct mbuf_audio_frame_queue_args bad_args = {
+		.max_frames = 8,
+		.mode = MBUF_FRAME_QUEUE_MODE_LOCKFREE,
+		.max_bytes = frame_size,
+	};
+	ret = mbuf_audio_frame_queue_new_with_args(&bad_args, &queue);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	/* Size limit: only the 3 newest frames fit in the queue */
+	struct mbuf_audio_frame_queue_args size_args = {
+		.max_bytes = 3 * frame_size,
+	};
+	ret = mbuf_audio_frame_queue_new_with_args(&size_args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < 5; i++) {
+		ret = mbuf_audio_frame_queue_push(queue, frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT_EQUAL(mbuf_audio_frame_queue_get_count(queue), 3);
+	for (unsigned int i = 2; i < 5; i++) {
+		ret = mbuf_audio_frame_queue_pop(queue, &out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_PTR_EQUAL(out_frame, frames[i]);
+		mbuf_audio_frame_unref(out_frame);
+	}
+	ret = mbuf_audio_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Duration limit: frames older than 15ms from the newest are
+	 * dropped */
+	struct mbuf_audio_frame_queue_args duration_args = {
+		.max_duration_us = 15000,
+	};
+	ret = mbuf_audio_frame_queue_new_with_args(&duration_args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < 5; i++) {
+		ret = mbuf_audio_frame_queue_push(queue, frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT_EQUAL(mbuf_audio_frame_queue_get_count(queue), 2);
+	for (unsigned int i = 3; i < 5; i++) {
+		ret = mbuf_audio_frame_queue_pop(queue, &out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_PTR_EQUAL(out_frame, frames[i]);
+		mbuf_audio_frame_unref(out_frame);
+	}
+	ret = mbuf_audio_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Cleanup */
+	for (unsigned int i = 0; i < 5; i++) {
+		ret = mbuf_audio_frame_unref(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Same duration limit with large nanosecond timestamps (about 5
+	 * hours), around the point where timestamp * 1000000 no longer fits in
+	 * 64 bits */
+	frame_info.info.timescale = 1000000000;
+	for (unsigned int i = 0; i < 5; i++) {
+		frame_info.info.timestamp = UINT64_MAX / 1000000 - 25000000 +
+					    i * UINT64_C(10000000);
+		ret = mbuf_audio_frame_new(&frame_info, &frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		set_buffer(frames[i], NULL);
+		ret = mbuf_audio_frame_finalize(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_audio_frame_queue_new_with_args(&duration_args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < 5; i++) {
+		ret = mbuf_audio_frame_queue_push(queue, frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT_EQUAL(mbuf_audio_frame_queue_get_count(queue), 2);
+	for (unsigned int i = 3; i < 5; i++) {
+		ret = mbuf_audio_frame_queue_pop(queue, &out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_PTR_EQUAL(out_frame, frames[i]);
+		mbuf_audio_frame_unref(out_frame);
+	}
+	ret = mbuf_audio_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < 5; i++) {
+		ret = mbuf_audio_frame_unref(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+}
+
+
 static void
 mbuf_audio_frame_ancillary_data_cleaner_cb(struct mbuf_ancillary_data *data,
 					   void *userdata)
@@ -1097,6 +1299,106 @@ mbuf_audio_frame_ancillary_data_cleaner_cb(struct mbuf_ancillary_data *data,
 }
 
 
+/* pomp_evt callback for a broadcast reader, pops all frames */
+static void audio_bcast_evt(struct pomp_evt *evt, void *userdata)
+{
+	struct mbuf_audio_frame_bcast_reader *reader = userdata;
+	struct mbuf_audio_frame *frame;
+
+	while (mbuf_audio_frame_bcast_reader_pop(reader, &frame) == 0)
+		mbuf_audio_frame_unref(frame);
+}
+
+
+static void test_mbuf_audio_frame_bcast(void)
+{
+	int ret;
+	struct adef_frame frame_info;
+	struct mbuf_audio_frame *frame1, *frame2, *out_frame;
+	struct mbuf_audio_frame_bcast *bcast;
+	struct mbuf_audio_frame_bcast_reader *reader1, *reader2;
+	struct pomp_evt *evt;
+	struct pomp_loop *loop;
+
+	init_frame_info(&frame_info, ADEF_ENCODING_AAC_LC);
+
+	/* Create the frames and the broadcast queue, with a ring of 2 */
+	ret = mbuf_audio_frame_new(&frame_info, &frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_new(&frame_info, &frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_new(2, &bcast);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_reader_new(NULL, 0, &reader1);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_audio_frame_bcast_reader_new(bcast, 0, &reader1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_reader_new(bcast, 0, &reader2);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Frames must be finalized */
+	set_buffer(frame1, NULL);
+	ret = mbuf_audio_frame_bcast_push(bcast, frame1);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	ret = mbuf_audio_frame_finalize(frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	set_buffer(frame2, NULL);
+	ret = mbuf_audio_frame_finalize(frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Reader 2 is drained by its event in a loop */
+	loop = pomp_loop_new();
+	CU_ASSERT_PTR_NOT_NULL(loop);
+	ret = mbuf_audio_frame_bcast_reader_get_event(reader2, &evt);
+	CU_ASSERT_EQUAL(ret, 0);
+	pomp_evt_attach_to_loop(evt, loop, audio_bcast_evt, reader2);
+
+	/* Push three frames, the ring only keeps the two latest ones */
+	ret = mbuf_audio_frame_bcast_push(bcast, frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_push(bcast, frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_push(bcast, frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = pomp_loop_wait_and_process(loop, 100);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_reader_get_count(reader2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_reader_get_count(reader1);
+	CU_ASSERT_EQUAL(ret, 2);
+	ret = mbuf_audio_frame_bcast_reader_pop(reader1, &out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(out_frame, frame1);
+	ret = mbuf_audio_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_reader_pop(reader1, &out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(out_frame, frame2);
+	ret = mbuf_audio_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_reader_pop(reader1, &out_frame);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+
+	/* The broadcast queue can not be destroyed while it has readers */
+	ret = mbuf_audio_frame_bcast_destroy(bcast);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+
+	/* Cleanup */
+	pomp_evt_detach_from_loop(evt, loop);
+	pomp_loop_destroy(loop);
+	ret = mbuf_audio_frame_bcast_reader_destroy(reader1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_reader_destroy(reader2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_bcast_destroy(bcast);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_unref(frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_unref(frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
 static void test_mbuf_audio_frame_ancillary_data(void)
 {
 	int ret;
@@ -1251,6 +1553,99 @@ static void test_mbuf_audio_frame_ancillary_data(void)
 }
 
 
+static void audio_ancillary_release(void *buffer, size_t len, void *userdata)
+{
+	int *count = userdata;
+
+	(*count)++;
+	free(buffer);
+}
+
+
+static void test_mbuf_audio_frame_ancillary_data_zero_copy(void)
+{
+	int ret;
+	int release_count = 0;
+	struct adef_frame frame_info;
+	struct mbuf_audio_frame *frame;
+	struct mbuf_ancillary_data *data;
+	struct mbuf_mem *mem;
+	uint8_t *buffer, *other;
+	void *mem_data;
+	size_t capacity, len, count, free_count;
+	const void *out;
+
+	init_frame_info(&frame_info, ADEF_ENCODING_AAC_LC);
+	struct mbuf_pool *pool = create_pool();
+	CU_ASSERT_PTR_NOT_NULL(pool);
+	ret = mbuf_audio_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Adopted buffers are not copied */
+	buffer = calloc(1, 16);
+	other = calloc(1, 16);
+	ret = mbuf_audio_frame_add_ancillary_adopt(frame,
+						   "adopt",
+						   buffer,
+						   16,
+						   audio_ancillary_release,
+						   &release_count);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_get_ancillary_data(frame, "adopt", &data);
+	CU_ASSERT_EQUAL(ret, 0);
+	out = mbuf_ancillary_data_get_buffer(data, &len);
+	CU_ASSERT_PTR_EQUAL(out, buffer);
+	CU_ASSERT_EQUAL(len, 16);
+	mbuf_ancillary_data_unref(data);
+
+	/* On error, the caller keeps the buffer */
+	ret = mbuf_audio_frame_add_ancillary_adopt(frame,
+						   "adopt",
+						   other,
+						   16,
+						   audio_ancillary_release,
+						   &release_count);
+	CU_ASSERT_EQUAL(ret, -EEXIST);
+	CU_ASSERT_EQUAL(release_count, 0);
+	free(other);
+
+	ret = mbuf_audio_frame_remove_ancillary_data(frame, "adopt");
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(release_count, 1);
+
+	/* Ancillary data stored in a pool memory */
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_get_data(mem, &mem_data, &capacity);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_add_ancillary_mem(
+		frame, "mem", mem, capacity, 1);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_audio_frame_add_ancillary_mem(frame, "mem", mem, 8, 32);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_unref(mem);
+	ret = mbuf_audio_frame_get_ancillary_data(frame, "mem", &data);
+	CU_ASSERT_EQUAL(ret, 0);
+	out = mbuf_ancillary_data_get_buffer(data, &len);
+	CU_ASSERT_PTR_EQUAL(out, (uint8_t *)mem_data + 8);
+	CU_ASSERT_EQUAL(len, 32);
+	mbuf_ancillary_data_unref(data);
+
+	/* The memory goes back to the pool with the frame */
+	ret = mbuf_pool_get_count(pool, &count, &free_count);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(free_count, count - 1);
+	ret = mbuf_audio_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_get_count(pool, &count, &free_count);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(free_count, count);
+
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
 CU_TestInfo g_mbuf_test_audio_frame[] = {
 	{(char *)"single", &test_mbuf_audio_frame_single},
 	{(char *)"get_infos", &test_mbuf_audio_frame_infos},
@@ -1262,6 +1657,11 @@ CU_TestInfo g_mbuf_test_audio_frame[] = {
 	{(char *)"queue_event", &test_mbuf_audio_frame_queue_evt},
 	{(char *)"queue_filter", &test_mbuf_audio_frame_queue_filter},
 	{(char *)"queue_drop", &test_mbuf_audio_frame_queue_drop},
+	{(char *)"queue_wait", &test_mbuf_audio_frame_queue_wait},
+	{(char *)"queue_limits", &test_mbuf_audio_frame_queue_limits},
+	{(char *)"bcast", &test_mbuf_audio_frame_bcast},
 	{(char *)"ancillary_data", &test_mbuf_audio_frame_ancillary_data},
+	{(char *)"ancillary_data_zero_copy",
+	 &test_mbuf_audio_frame_ancillary_data_zero_copy},
 	CU_TEST_INFO_NULL,
 };
@@ -1393,6 +1393,430 @@ static bool ancillary_iterator(struct mbuf_ancillary_data *data, void *userdata)
 }
 
 
+#define MBUF_TEST_BATCH_SIZE 3
+
+
+static void test_mbuf_coded_video_frame_queue_batch(void)
+{
+	int ret;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+		.info.resolution.width = MBUF_TEST_WIDTH,
+		.info.resolution.height = MBUF_TEST_HEIGHT,
+	};
+	struct mbuf_coded_video_frame *frames[MBUF_TEST_BATCH_SIZE];
+	struct mbuf_coded_video_frame *bad_frames[2];
+	struct mbuf_coded_video_frame *out_frames[MBUF_TEST_BATCH_SIZE + 2];
+	struct mbuf_coded_video_frame_queue *queue;
+	unsigned int count;
+
+	/* Create and finalize the frames used by the test */
+	for (int i = 0; i < MBUF_TEST_BATCH_SIZE; i++) {
+		ret = mbuf_coded_video_frame_new(&frame_info, &frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		add_default_nalu(frames[i]);
+		ret = mbuf_coded_video_frame_finalize(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	ret = mbuf_coded_video_frame_queue_new(&queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* A batch with an invalid frame should not be pushed at all */
+	bad_frames[0] = frames[0];
+	bad_frames[1] = NULL;
+	ret = mbuf_coded_video_frame_queue_push_batch(
+		queue, bad_frames, 2, &count);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	CU_ASSERT_EQUAL(count, 0);
+	ret = mbuf_coded_video_frame_queue_get_count(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Pop from an empty queue should fail */
+	ret = mbuf_coded_video_frame_queue_pop_batch(
+		queue, out_frames, MBUF_TEST_BATCH_SIZE, &count);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+	CU_ASSERT_EQUAL(count, 0);
+
+	/* Push all frames at once */
+	ret = mbuf_coded_video_frame_queue_push_batch(
+		queue, frames, MBUF_TEST_BATCH_SIZE, &count);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(count, MBUF_TEST_BATCH_SIZE);
+	ret = mbuf_coded_video_frame_queue_get_count(queue);
+	CU_ASSERT_EQUAL(ret, MBUF_TEST_BATCH_SIZE);
+
+	/* Pop two frames, then the remaining one, in order */
+	ret = mbuf_coded_video_frame_queue_pop_batch(
+		queue, out_frames, 2, &count);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(count, 2);
+	ret = mbuf_coded_video_frame_queue_pop_batch(
+		queue, &out_frames[2], MBUF_TEST_BATCH_SIZE, &count);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(count, 1);
+	for (int i = 0; i < MBUF_TEST_BATCH_SIZE; i++) {
+		CU_ASSERT_PTR_EQUAL(out_frames[i], frames[i]);
+		ret = mbuf_coded_video_frame_unref(out_frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_coded_video_frame_queue_get_count(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Cleanup */
+	for (int i = 0; i < MBUF_TEST_BATCH_SIZE; i++) {
+		ret = mbuf_coded_video_frame_unref(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_coded_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
+/* More frames than MBUF_BASE_FRAME_QUEUE_BATCH_SIZE, so that the batch is
+ * pushed in several chunks */
+#define MBUF_TEST_BATCH_PARTIAL_SIZE 150
+#define MBUF_TEST_BATCH_PARTIAL_MAX 70
+
+
+static bool coded_queue_filter_even(struct mbuf_coded_video_frame *frame,
+				    void *userdata)
+{
+	struct vdef_coded_frame info;
+
+	mbuf_coded_video_frame_get_frame_info(frame, &info);
+	return info.info.timestamp % 2 == 0;
+}
+
+
+static void test_mbuf_coded_video_frame_queue_batch_partial(void)
+{
+	int ret;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+		.info.resolution.width = MBUF_TEST_WIDTH,
+		.info.resolution.height = MBUF_TEST_HEIGHT,
+	};
+	struct mbuf_coded_video_frame *frames[MBUF_TEST_BATCH_PARTIAL_SIZE];
+	struct mbuf_coded_video_frame *out_frame;
+	struct mbuf_coded_video_frame_queue *queue;
+	struct vdef_coded_frame out_info;
+	unsigned int pushed;
+	struct mbuf_coded_video_frame_queue_args args = {
+		.filter = coded_queue_filter_even,
+		.max_frames = MBUF_TEST_BATCH_PARTIAL_MAX,
+		.drop_policy = MBUF_CODED_VIDEO_FRAME_QUEUE_DROP_NEWEST,
+	};
+
+	for (unsigned int i = 0; i < MBUF_TEST_BATCH_PARTIAL_SIZE; i++) {
+		frame_info.info.timestamp = i;
+		ret = mbuf_coded_video_frame_new(&frame_info, &frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		add_default_nalu(frames[i]);
+		ret = mbuf_coded_video_frame_finalize(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_coded_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Only even frames pass the filter: the queue is full after frame
+	 * 2 * (MAX - 1), the next even frame is refused in the second chunk,
+	 * and the following frames are not pushed */
+	ret = mbuf_coded_video_frame_queue_push_batch(
+		queue, frames, MBUF_TEST_BATCH_PARTIAL_SIZE, &pushed);
+	CU_ASSERT_EQUAL(ret, -ENOBUFS);
+	CU_ASSERT_EQUAL(pushed, 2 * MBUF_TEST_BATCH_PARTIAL_MAX);
+	ret = mbuf_coded_video_frame_queue_get_count(queue);
+	CU_ASSERT_EQUAL(ret, MBUF_TEST_BATCH_PARTIAL_MAX);
+	for (unsigned int i = 0; i < MBUF_TEST_BATCH_PARTIAL_MAX; i++) {
+		ret = mbuf_coded_video_frame_queue_pop(queue, &out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			break;
+		mbuf_coded_video_frame_get_frame_info(out_frame, &out_info);
+		CU_ASSERT_EQUAL(out_info.info.timestamp, 2 * i);
+		ret = mbuf_coded_video_frame_unref(out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* The caller can resume from the refused frame */
+	ret = mbuf_coded_video_frame_queue_push_batch(
+		queue,
+		&frames[pushed],
+		MBUF_TEST_BATCH_PARTIAL_SIZE - pushed,
+		&pushed);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(pushed,
+			MBUF_TEST_BATCH_PARTIAL_SIZE -
+				2 * MBUF_TEST_BATCH_PARTIAL_MAX);
+	ret = mbuf_coded_video_frame_queue_get_count(queue);
+	CU_ASSERT_EQUAL(ret, (int)(pushed + 1) / 2);
+	ret = mbuf_coded_video_frame_queue_peek(queue, &out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	if (ret == 0) {
+		mbuf_coded_video_frame_get_frame_info(out_frame, &out_info);
+		CU_ASSERT_EQUAL(out_info.info.timestamp,
+				2 * MBUF_TEST_BATCH_PARTIAL_MAX);
+		mbuf_coded_video_frame_unref(out_frame);
+	}
+
+	/* Cleanup */
+	ret = mbuf_coded_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < MBUF_TEST_BATCH_PARTIAL_SIZE; i++) {
+		ret = mbuf_coded_video_frame_unref(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+}
+
+
+static int coded_queue_cmp_reverse(struct mbuf_coded_video_frame *a,
+				   struct mbuf_coded_video_frame *b,
+				   void *userdata)
+{
+	struct vdef_coded_frame info_a, info_b;
+
+	mbuf_coded_video_frame_get_frame_info(a, &info_a);
+	mbuf_coded_video_frame_get_frame_info(b, &info_b);
+	return (info_a.info.timestamp < info_b.info.timestamp) -
+	       (info_a.info.timestamp > info_b.info.timestamp);
+}
+
+
+static void test_mbuf_coded_video_frame_queue_ordered(void)
+{
+	int ret;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+		.info.resolution.width = MBUF_TEST_WIDTH,
+		.info.resolution.height = MBUF_TEST_HEIGHT,
+	};
+	/* Decoding order timestamps */
+	uint64_t timestamps[] = {0, 3, 1, 2, 6, 4, 5};
+	struct mbuf_coded_video_frame *
+		frames[sizeof(timestamps) / sizeof(timestamps[0])];
+	const unsigned int count = sizeof(frames) / sizeof(frames[0]);
+	struct mbuf_coded_video_frame *out_frame;
+	struct mbuf_coded_video_frame_queue *queue;
+	struct vdef_coded_frame out_info;
+	unsigned int pushed;
+
+	/* Create and finalize the frames used by the test */
+	for (unsigned int i = 0; i < count; i++) {
+		frame_info.info.timestamp = timestamps[i];
+		ret = mbuf_coded_video_frame_new(&frame_info, &frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		add_default_nalu(frames[i]);
+		ret = mbuf_coded_video_frame_finalize(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Custom ordering requires a comparison function, ordered queues
+	 * can not be lock-free */
+	struct mbuf_coded_video_frame_queue_args args = {
+		.order = MBUF_FRAME_QUEUE_ORDER_CUSTOM,
+	};
+	ret = mbuf_coded_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	args.order = MBUF_FRAME_QUEUE_ORDER_TIMESTAMP;
+	args.mode = MBUF_FRAME_QUEUE_MODE_LOCKFREE;
+	args.max_frames = count;
+	ret = mbuf_coded_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	/* Timestamp ordering: frames come out in presentation order */
+	args.mode = MBUF_FRAME_QUEUE_MODE_LOCKED;
+	args.max_frames = 0;
+	ret = mbuf_coded_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_queue_push_batch(
+		queue, frames, count, &pushed);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(pushed, count);
+	ret = mbuf_coded_video_frame_queue_peek_at(queue, 1, &out_frame);
+	CU_ASSERT_EQUAL(ret, -EOPNOTSUPP);
+	ret = mbuf_coded_video_frame_queue_peek(queue, &out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_coded_video_frame_get_frame_info(out_frame, &out_info);
+	CU_ASSERT_EQUAL(out_info.info.timestamp, 0);
+	ret = mbuf_coded_video_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < count; i++) {
+		ret = mbuf_coded_video_frame_queue_pop(queue, &out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			break;
+		mbuf_coded_video_frame_get_frame_info(out_frame, &out_info);
+		CU_ASSERT_EQUAL(out_info.info.timestamp, i);
+		ret = mbuf_coded_video_frame_unref(out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_coded_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Custom ordering with max_frames = 2: the first frames in queue
+	 * order are dropped */
+	args.order = MBUF_FRAME_QUEUE_ORDER_CUSTOM;
+	args.cmp = coded_queue_cmp_reverse;
+	args.max_frames = 2;
+	ret = mbuf_coded_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_queue_push_batch(
+		queue, frames, 3, &pushed);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(pushed, 3);
+	ret = mbuf_coded_video_frame_queue_get_count(queue);
+	CU_ASSERT_EQUAL(ret, 2);
+	ret = mbuf_coded_video_frame_queue_pop(queue, &out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(out_frame, frames[2]);
+	ret = mbuf_coded_video_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Cleanup */
+	for (unsigned int i = 0; i < count; i++) {
+		ret = mbuf_coded_video_frame_unref(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+}
+
+
+static void check_queue_frames(struct mbuf_coded_video_frame_queue *queue,
+			       struct mbuf_coded_video_frame **expected,
+			       unsigned int count)
+{
+	int ret;
+	struct mbuf_coded_video_frame *out_frame;
+
+	ret = mbuf_coded_video_frame_queue_get_count(queue);
+	CU_ASSERT_EQUAL(ret, (int)count);
+	for (unsigned int i = 0; i < count; i++) {
+		ret = mbuf_coded_video_frame_queue_pop(queue, &out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			return;
+		CU_ASSERT_PTR_EQUAL(out_frame, expected[i]);
+		ret = mbuf_coded_video_frame_unref(out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+}
+
+
+static void test_mbuf_coded_video_frame_queue_drop_policy(void)
+{
+	int ret;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+		.info.resolution.width = MBUF_TEST_WIDTH,
+		.info.resolution.height = MBUF_TEST_HEIGHT,
+	};
+	enum vdef_coded_frame_type types[] = {
+		VDEF_CODED_FRAME_TYPE_IDR,
+		VDEF_CODED_FRAME_TYPE_P,
+		VDEF_CODED_FRAME_TYPE_P_NON_REF,
+		VDEF_CODED_FRAME_TYPE_P,
+		VDEF_CODED_FRAME_TYPE_IDR,
+	};
+	struct mbuf_coded_video_frame *f[sizeof(types) / sizeof(types[0])];
+	struct mbuf_coded_video_frame *expected[3];
+	struct mbuf_coded_video_frame_queue *queue;
+	uint64_t dropped;
+	unsigned int pushed;
+
+	/* Create and finalize the frames used by the test */
+	for (unsigned int i = 0; i < sizeof(f) / sizeof(f[0]); i++) {
+		frame_info.type = types[i];
+		ret = mbuf_coded_video_frame_new(&frame_info, &f[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		add_default_nalu(f[i]);
+		ret = mbuf_coded_video_frame_finalize(f[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Drop policies require a locked FIFO queue */
+	struct mbuf_coded_video_frame_queue_args args = {
+		.max_frames = 2,
+		.mode = MBUF_FRAME_QUEUE_MODE_LOCKFREE,
+		.drop_policy = MBUF_CODED_VIDEO_FRAME_QUEUE_DROP_NEWEST,
+	};
+	ret = mbuf_coded_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	args.mode = MBUF_FRAME_QUEUE_MODE_LOCKED;
+
+	/* Drop newest: the pushed frame is refused */
+	ret = mbuf_coded_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_queue_push_batch(queue, f, 3, &pushed);
+	CU_ASSERT_EQUAL(ret, -ENOBUFS);
+	CU_ASSERT_EQUAL(pushed, 2);
+	expected[0] = f[0];
+	expected[1] = f[1];
+	check_queue_frames(queue, expected, 2);
+	ret = mbuf_coded_video_frame_queue_get_drop_count(queue, &dropped);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(dropped, 1);
+	ret = mbuf_coded_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Drop non-reference: the P_NON_REF frame is dropped first */
+	args.max_frames = 3;
+	args.drop_policy = MBUF_CODED_VIDEO_FRAME_QUEUE_DROP_NON_REF;
+	ret = mbuf_coded_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_queue_push_batch(queue, f, 4, &pushed);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(pushed, 4);
+	expected[0] = f[0];
+	expected[1] = f[1];
+	expected[2] = f[3];
+	check_queue_frames(queue, expected, 3);
+	ret = mbuf_coded_video_frame_queue_get_drop_count(queue, &dropped);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(dropped, 1);
+	ret = mbuf_coded_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Drop to IDR: without an IDR frame in the queue (apart from the
+	 * first frame), the pushed P frame is dropped; the IDR frame pushed
+	 * next flushes the whole GOP */
+	args.drop_policy = MBUF_CODED_VIDEO_FRAME_QUEUE_DROP_TO_IDR;
+	ret = mbuf_coded_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_queue_push_batch(queue, f, 4, &pushed);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(pushed, 4);
+	ret = mbuf_coded_video_frame_queue_get_drop_count(queue, &dropped);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(dropped, 1);
+	/* Still waiting for an IDR frame */
+	ret = mbuf_coded_video_frame_queue_push(queue, f[1]);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_queue_push(queue, f[4]);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_queue_push(queue, f[1]);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_queue_push(queue, f[3]);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_queue_get_drop_count(queue, &dropped);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(dropped, 5);
+	expected[0] = f[4];
+	expected[1] = f[1];
+	expected[2] = f[3];
+	check_queue_frames(queue, expected, 3);
+	ret = mbuf_coded_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Cleanup */
+	for (unsigned int i = 0; i < sizeof(f) / sizeof(f[0]); i++) {
+		ret = mbuf_coded_video_frame_unref(f[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+}
+
+
 static void mbuf_coded_video_frame_ancillary_data_cleaner_cb(
 	struct mbuf_ancillary_data *data,
 	void *userdata)
@@ -1567,6 +1991,431 @@ static void test_mbuf_coded_video_frame_ancillary_data(void)
 }
 
 
+#define MBUF_TEST_ANCILLARY_COUNT 40
+
+
+struct coded_ancillary_order_ctx {
+	unsigned int next;
+	unsigned int errors;
+};
+
+
+static bool coded_ancillary_order_iterator(struct mbuf_ancillary_data *data,
+					   void *userdata)
+{
+	struct coded_ancillary_order_ctx *ctx = userdata;
+	const unsigned int *value = mbuf_ancillary_data_get_buffer(data, NULL);
+
+	/* Odd entries have been removed */
+	if (*value != ctx->next)
+		ctx->errors++;
+	ctx->next += 2;
+	return true;
+}
+
+
+static void test_mbuf_coded_video_frame_ancillary_data_many(void)
+{
+	int ret;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+		.info.resolution.width = MBUF_TEST_WIDTH,
+		.info.resolution.height = MBUF_TEST_HEIGHT,
+	};
+	struct mbuf_coded_video_frame *frame;
+	struct mbuf_ancillary_data *data;
+	struct coded_ancillary_order_ctx ctx = {0};
+	const unsigned int *value;
+	char name[32];
+
+	ret = mbuf_coded_video_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Add enough entries to grow the ancillary data index */
+	for (unsigned int i = 0; i < MBUF_TEST_ANCILLARY_COUNT; i++) {
+		snprintf(name, sizeof(name), "com.parrot.test.%u", i);
+		ret = mbuf_coded_video_frame_add_ancillary_buffer(
+			frame, name, &i, sizeof(i));
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_coded_video_frame_add_ancillary_buffer(
+		frame, "com.parrot.test.7", name, sizeof(name));
+	CU_ASSERT_EQUAL(ret, -EEXIST);
+
+	/* Remove the odd entries */
+	for (unsigned int i = 1; i < MBUF_TEST_ANCILLARY_COUNT; i += 2) {
+		snprintf(name, sizeof(name), "com.parrot.test.%u", i);
+		ret = mbuf_coded_video_frame_remove_ancillary_data(frame, name);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Check the lookups */
+	for (unsigned int i = 0; i < MBUF_TEST_ANCILLARY_COUNT; i++) {
+		snprintf(name, sizeof(name), "com.parrot.test.%u", i);
+		ret = mbuf_coded_video_frame_get_ancillary_data(
+			frame, name, &data);
+		if (i % 2 == 1) {
+			CU_ASSERT_EQUAL(ret, -ENOENT);
+			continue;
+		}
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			continue;
+		value = mbuf_ancillary_data_get_buffer(data, NULL);
+		CU_ASSERT_EQUAL(*value, i);
+		mbuf_ancillary_data_unref(data);
+	}
+
+	/* The insertion order is kept */
+	ret = mbuf_coded_video_frame_foreach_ancillary_data(
+		frame, coded_ancillary_order_iterator, &ctx);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(ctx.errors, 0);
+	CU_ASSERT_EQUAL(ctx.next, MBUF_TEST_ANCILLARY_COUNT);
+
+	/* Cleanup */
+	ret = mbuf_coded_video_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
+static void test_mbuf_coded_video_frame_ancillary_data_cow(void)
+{
+	int ret;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+		.info.resolution.width = MBUF_TEST_WIDTH,
+		.info.resolution.height = MBUF_TEST_HEIGHT,
+	};
+	struct mbuf_mem *mem;
+	struct mbuf_coded_video_frame *frame, *copy;
+	struct mbuf_ancillary_data *data, *data_cp;
+	char name[32];
+
+	/* Create the pool, frame and memory used by the test */
+	struct mbuf_pool *pool = create_pool();
+	CU_ASSERT_PTR_NOT_NULL(pool);
+	ret = mbuf_coded_video_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < MBUF_TEST_ANCILLARY_COUNT; i++) {
+		snprintf(name, sizeof(name), "com.parrot.test.%u", i);
+		ret = mbuf_coded_video_frame_add_ancillary_buffer(
+			frame, name, &i, sizeof(i));
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	add_default_nalu(frame);
+	ret = mbuf_coded_video_frame_finalize(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* The copy shares the ancillary data objects */
+	ret = mbuf_coded_video_frame_copy(frame, mem, &copy);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_finalize(copy);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_get_ancillary_data(
+		frame, "com.parrot.test.3", &data);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_get_ancillary_data(
+		copy, "com.parrot.test.3", &data_cp);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(data, data_cp);
+	mbuf_ancillary_data_unref(data);
+	mbuf_ancillary_data_unref(data_cp);
+
+	/* Modifying the copy does not modify the source frame */
+	ret = mbuf_coded_video_frame_remove_ancillary_data(
+		copy, "com.parrot.test.3");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_add_ancillary_string(copy, "str", "test");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_get_ancillary_data(
+		frame, "com.parrot.test.3", &data);
+	CU_ASSERT_EQUAL(ret, 0);
+	if (ret == 0)
+		mbuf_ancillary_data_unref(data);
+	ret = mbuf_coded_video_frame_get_ancillary_data(frame, "str", &data);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	/* And the other way around */
+	ret = mbuf_coded_video_frame_remove_ancillary_data(
+		frame, "com.parrot.test.5");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_get_ancillary_data(
+		copy, "com.parrot.test.5", &data);
+	CU_ASSERT_EQUAL(ret, 0);
+	if (ret == 0)
+		mbuf_ancillary_data_unref(data);
+	ret = mbuf_coded_video_frame_get_ancillary_data(
+		copy, "com.parrot.test.3", &data);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	/* Cleanup */
+	ret = mbuf_coded_video_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_unref(copy);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
+static void test_mbuf_coded_video_frame_bcast(void)
+{
+	int ret;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+		.info.resolution.width = MBUF_TEST_WIDTH,
+		.info.resolution.height = MBUF_TEST_HEIGHT,
+	};
+	struct mbuf_coded_video_frame *frame, *out_frame;
+	struct mbuf_coded_video_frame_bcast *bcast;
+	struct mbuf_coded_video_frame_bcast_reader *readers[3];
+	struct vdef_nalu nalu;
+	const void *data;
+
+	ret = mbuf_coded_video_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	add_default_nalu(frame);
+	add_default_nalu(frame);
+	ret = mbuf_coded_video_frame_bcast_new(0, &bcast);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	CU_ASSERT_PTR_NULL(bcast);
+	ret = mbuf_coded_video_frame_bcast_new(4, &bcast);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_bcast_push(bcast, frame);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	ret = mbuf_coded_video_frame_finalize(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Each reader gets the same frame, with its NALUs */
+	for (unsigned int i = 0; i < 3; i++) {
+		ret = mbuf_coded_video_frame_bcast_reader_new(
+			bcast, 0, &readers[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_coded_video_frame_bcast_push(bcast, frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < 3; i++) {
+		ret = mbuf_coded_video_frame_bcast_reader_get_count(readers[i]);
+		CU_ASSERT_EQUAL(ret, 1);
+		ret = mbuf_coded_video_frame_bcast_reader_pop(readers[i],
+							      &out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			continue;
+		CU_ASSERT_PTR_EQUAL(out_frame, frame);
+		ret = mbuf_coded_video_frame_get_nalu_count(out_frame);
+		CU_ASSERT_EQUAL(ret, 2);
+		ret = mbuf_coded_video_frame_get_nalu(
+			out_frame, 1, &data, &nalu);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(nalu.size, MBUF_TEST_SIZE);
+		ret = mbuf_coded_video_frame_release_nalu(out_frame, 1, data);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_coded_video_frame_unref(out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* A destroyed reader releases its pending frames */
+	ret = mbuf_coded_video_frame_bcast_push(bcast, frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_bcast_reader_destroy(readers[0]);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_bcast_reader_get_count(readers[1]);
+	CU_ASSERT_EQUAL(ret, 1);
+
+	/* Cleanup */
+	ret = mbuf_coded_video_frame_bcast_reader_destroy(readers[1]);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_bcast_destroy(bcast);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	ret = mbuf_coded_video_frame_bcast_reader_destroy(readers[2]);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_bcast_destroy(bcast);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
+#define MBUF_TEST_RECYCLE_COUNT 4
+
+
+static void coded_recycle_pre_release(struct mbuf_coded_video_frame *frame,
+				      void *userdata)
+{
+	unsigned int *count = userdata;
+	(*count)++;
+}
+
+
+static void test_mbuf_coded_video_frame_recycle(void)
+{
+	int ret;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+		.info.resolution.width = MBUF_TEST_WIDTH,
+		.info.resolution.height = MBUF_TEST_HEIGHT,
+	};
+	struct mbuf_coded_video_frame *frames[MBUF_TEST_RECYCLE_COUNT];
+	struct mbuf_ancillary_data *data;
+	struct vmeta_frame *meta, *out_meta;
+	unsigned int released = 0;
+	struct mbuf_coded_video_frame_cbs cbs = {
+		.pre_release = coded_recycle_pre_release,
+		.pre_release_userdata = &released,
+	};
+
+	/* The cache cannot be enabled in sanitizer builds */
+	ret = mbuf_coded_video_frame_cache_set_size(MBUF_TEST_RECYCLE_COUNT);
+	CU_ASSERT(ret == 0 || ret == -EOPNOTSUPP);
+
+	ret = vmeta_frame_new(VMETA_FRAME_TYPE_PROTO, &meta);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Create fully populated frames, and release them */
+	for (unsigned int i = 0; i < MBUF_TEST_RECYCLE_COUNT; i++) {
+		ret = mbuf_coded_video_frame_new(&frame_info, &frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_coded_video_frame_set_callbacks(frames[i], &cbs);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_coded_video_frame_set_metadata(frames[i], meta);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_coded_video_frame_add_ancillary_string(
+			frames[i], "str", "test");
+		CU_ASSERT_EQUAL(ret, 0);
+		for (unsigned int j = 0; j < 6; j++)
+			add_default_nalu(frames[i]);
+		ret = mbuf_coded_video_frame_finalize(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	for (unsigned int i = 0; i < MBUF_TEST_RECYCLE_COUNT; i++) {
+		ret = mbuf_coded_video_frame_unref(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT_EQUAL(released, MBUF_TEST_RECYCLE_COUNT);
+
+	/* New frames (possibly recycled) must be in their initial state */
+	for (unsigned int i = 0; i < MBUF_TEST_RECYCLE_COUNT; i++) {
+		ret = mbuf_coded_video_frame_new(&frame_info, &frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_coded_video_frame_get_metadata(frames[i], &out_meta);
+		CU_ASSERT_EQUAL(ret, -ENOENT);
+		ret = mbuf_coded_video_frame_get_ancillary_data(
+			frames[i], "str", &data);
+		CU_ASSERT_EQUAL(ret, -ENOENT);
+		/* Not finalized, and without NALUs */
+		CU_ASSERT_EQUAL(
+			mbuf_coded_video_frame_get_nalu_count(frames[i]),
+			-EBUSY);
+		ret = mbuf_coded_video_frame_set_frame_info(frames[i],
+							    &frame_info);
+		CU_ASSERT_EQUAL(ret, 0);
+		add_default_nalu(frames[i]);
+		ret = mbuf_coded_video_frame_finalize(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(
+			mbuf_coded_video_frame_get_nalu_count(frames[i]), 1);
+	}
+
+	/* Cleanup, the callbacks must not be called again */
+	for (unsigned int i = 0; i < MBUF_TEST_RECYCLE_COUNT; i++) {
+		ret = mbuf_coded_video_frame_unref(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT_EQUAL(released, MBUF_TEST_RECYCLE_COUNT);
+	ret = vmeta_frame_unref(meta);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	ret = mbuf_coded_video_frame_cache_set_size(0);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
+/* More NALUs than the array size kept by a cached frame */
+#define MBUF_TEST_CACHE_LARGE_NALUS 100
+
+
+static void test_mbuf_coded_video_frame_cache_flush(void)
+{
+	int ret;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+		.info.resolution.width = MBUF_TEST_WIDTH,
+		.info.resolution.height = MBUF_TEST_HEIGHT,
+	};
+	struct mbuf_coded_video_frame *frame;
+	bool enabled;
+
+	ret = mbuf_coded_video_frame_cache_set_size(
+		MBUF_FRAME_CACHE_MAX_SIZE + 1);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	/* The cache cannot be enabled in sanitizer builds */
+	ret = mbuf_coded_video_frame_cache_set_size(MBUF_FRAME_CACHE_MAX_SIZE);
+	enabled = (ret == 0);
+	if (!enabled)
+		CU_ASSERT_EQUAL(ret, -EOPNOTSUPP);
+
+	/* Release a frame with a large NALU array */
+	ret = mbuf_coded_video_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < MBUF_TEST_CACHE_LARGE_NALUS; i++)
+		add_default_nalu(frame);
+	ret = mbuf_coded_video_frame_finalize(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(mbuf_coded_video_frame_get_nalu_count(frame),
+			MBUF_TEST_CACHE_LARGE_NALUS);
+	ret = mbuf_coded_video_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* The recycled frame grows a new NALU array */
+	ret = mbuf_coded_video_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	add_default_nalu(frame);
+	add_default_nalu(frame);
+	ret = mbuf_coded_video_frame_finalize(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(mbuf_coded_video_frame_get_nalu_count(frame), 2);
+	ret = mbuf_coded_video_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* At least the released frame is freed, and the cache is empty */
+	ret = mbuf_coded_video_frame_cache_flush();
+	if (enabled)
+		CU_ASSERT(ret >= 1);
+	else
+		CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_cache_flush();
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_cache_flush();
+	CU_ASSERT(ret >= 0);
+	ret = mbuf_audio_frame_cache_flush();
+	CU_ASSERT(ret >= 0);
+
+	/* Frames can still be created after a flush */
+	ret = mbuf_coded_video_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Disabling the cache frees the cached frames, and released frames
+	 * are no longer cached */
+	ret = mbuf_coded_video_frame_cache_set_size(0);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_cache_flush();
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
 CU_TestInfo g_mbuf_test_coded_video_frame[] = {
 	{(char *)"scattered", &test_mbuf_coded_video_frame_scattered},
 	{(char *)"single", &test_mbuf_coded_video_frame_single},
@@ -1579,6 +2428,20 @@ CU_TestInfo g_mbuf_test_coded_video_frame[] = {
 	{(char *)"queue_event", &test_mbuf_coded_video_frame_queue_evt},
 	{(char *)"queue_filter", &test_mbuf_coded_video_frame_queue_filter},
 	{(char *)"queue_drop", &test_mbuf_coded_video_frame_queue_drop},
+	{(char *)"queue_batch", &test_mbuf_coded_video_frame_queue_batch},
+	{(char *)"queue_batch_partial",
+	 &test_mbuf_coded_video_frame_queue_batch_partial},
+	{(char *)"queue_ordered",
+	 &test_mbuf_coded_video_frame_queue_ordered},
+	{(char *)"queue_drop_policy",
+	 &test_mbuf_coded_video_frame_queue_drop_policy},
 	{(char *)"ancillary_data", &test_mbuf_coded_video_frame_ancillary_data},
+	{(char *)"ancillary_data_many",
+	 &test_mbuf_coded_video_frame_ancillary_data_many},
+	{(char *)"ancillary_data_cow",
+	 &test_mbuf_coded_video_frame_ancillary_data_cow},
+	{(char *)"bcast", &test_mbuf_coded_video_frame_bcast},
+	{(char *)"recycle", &test_mbuf_coded_video_frame_recycle},
+	{(char *)"cache_flush", &test_mbuf_coded_video_frame_cache_flush},
 	CU_TEST_INFO_NULL,
 };
\ No newline at end of file
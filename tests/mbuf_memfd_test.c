@@ -0,0 +1,346 @@
+/**
+ * Copyright (c) 2026 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mbuf_test.h"
+
+#include <media-buffers/mbuf_mem_memfd.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/* Not a multiple of the page size, so that the memories are padded */
+#define MBUF_TEST_MEMFD_MEM_SIZE 5000
+#define MBUF_TEST_MEMFD_MEM_COUNT 3
+
+
+static struct mbuf_mem_implem *test_memfd_implem(void)
+{
+	struct mbuf_memfd_attr attr = {
+		.name = "mbuf_test_memfd",
+		.mem_size = MBUF_TEST_MEMFD_MEM_SIZE,
+		.mem_count = MBUF_TEST_MEMFD_MEM_COUNT,
+	};
+
+	return mbuf_mem_memfd_get_implem(&attr);
+}
+
+
+static void test_mbuf_memfd_alloc(void)
+{
+	int ret;
+	struct mbuf_mem_implem *implem;
+	struct mbuf_pool *pool;
+	struct mbuf_mem *mems[MBUF_TEST_MEMFD_MEM_COUNT];
+	struct mbuf_mem *mem;
+	void *data;
+	size_t size;
+	int fd, first_fd = -1;
+	size_t offset;
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	implem = test_memfd_implem();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(implem);
+	ret = mbuf_pool_new(implem,
+			    MBUF_TEST_MEMFD_MEM_SIZE,
+			    MBUF_TEST_MEMFD_MEM_COUNT,
+			    MBUF_POOL_NO_GROW,
+			    0,
+			    "memfd",
+			    &pool);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* All memories share the same fd, each one on its own pages */
+	for (unsigned int i = 0; i < MBUF_TEST_MEMFD_MEM_COUNT; i++) {
+		ret = mbuf_pool_get(pool, &mems[i]);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		ret = mbuf_mem_get_data(mems[i], &data, &size);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_PTR_NOT_NULL(data);
+		CU_ASSERT_EQUAL(size, MBUF_TEST_MEMFD_MEM_SIZE);
+		memset(data, i + 1, size);
+
+		ret = mbuf_mem_memfd_get_fd(mems[i], &fd, &offset);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT(fd >= 0);
+		CU_ASSERT_EQUAL(offset % page_size, 0);
+		if (i == 0)
+			first_fd = fd;
+		CU_ASSERT_EQUAL(fd, first_fd);
+		ret = mbuf_mem_memfd_get_fd(mems[i], &fd, NULL);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* The heap is exhausted */
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+
+	/* Memories of other implementations are rejected */
+	ret = mbuf_mem_generic_wrap(&fd, sizeof(fd), NULL, NULL, &mem);
+	if (ret == 0) {
+		ret = mbuf_mem_memfd_get_fd(mem, &fd, &offset);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		mbuf_mem_unref(mem);
+	}
+
+	/* Cleanup */
+	for (unsigned int i = 0; i < MBUF_TEST_MEMFD_MEM_COUNT; i++) {
+		ret = mbuf_mem_unref(mems[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_memfd_release_implem(implem);
+}
+
+
+static void test_mbuf_memfd_exhaustion(void)
+{
+	int ret;
+	struct mbuf_mem_implem *implem;
+	struct mbuf_pool *pool;
+	struct mbuf_mem *mems[MBUF_TEST_MEMFD_MEM_COUNT];
+	struct mbuf_mem *mem;
+	size_t offset, first_offset;
+	int fd;
+
+	implem = test_memfd_implem();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(implem);
+
+	/* A growing pool can not get more memories than the heap holds */
+	ret = mbuf_pool_new(implem,
+			    MBUF_TEST_MEMFD_MEM_SIZE,
+			    0,
+			    MBUF_POOL_GROW,
+			    0,
+			    "memfd",
+			    &pool);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	for (unsigned int i = 0; i < MBUF_TEST_MEMFD_MEM_COUNT; i++) {
+		ret = mbuf_pool_get(pool, &mems[i]);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+	}
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL(ret, -ENOMEM);
+	for (unsigned int i = 0; i < MBUF_TEST_MEMFD_MEM_COUNT; i++) {
+		ret = mbuf_mem_unref(mems[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Larger memories than the heap memory size are rejected */
+	ret = mbuf_pool_new(implem,
+			    MBUF_TEST_MEMFD_MEM_SIZE + 1,
+			    1,
+			    MBUF_POOL_NO_GROW,
+			    0,
+			    "memfd",
+			    &pool);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	/* The slots freed with the pool can be allocated again */
+	ret = mbuf_pool_new(implem,
+			    MBUF_TEST_MEMFD_MEM_SIZE,
+			    MBUF_TEST_MEMFD_MEM_COUNT,
+			    MBUF_POOL_NO_GROW,
+			    0,
+			    "memfd",
+			    &pool);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_memfd_get_fd(mem, &fd, &first_offset);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_memfd_get_fd(mem, &fd, &offset);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(offset, first_offset);
+
+	/* Cleanup */
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_memfd_release_implem(implem);
+}
+
+
+static void test_mbuf_memfd_map(void)
+{
+	int ret;
+	struct mbuf_mem_implem *implem;
+	struct mbuf_pool *pool;
+	struct mbuf_mem *mem, *ro_mem, *rw_mem, *tmp;
+	uint8_t *data, *ro_data, *rw_data;
+	size_t size, offset;
+	int fd, dup_fd;
+
+	implem = test_memfd_implem();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(implem);
+	ret = mbuf_pool_new(implem,
+			    MBUF_TEST_MEMFD_MEM_SIZE,
+			    MBUF_TEST_MEMFD_MEM_COUNT,
+			    MBUF_POOL_NO_GROW,
+			    0,
+			    "memfd",
+			    &pool);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* Use the second memory, so that the offset is not 0 */
+	ret = mbuf_pool_get(pool, &tmp);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_get_data(mem, (void **)&data, &size);
+	CU_ASSERT_EQUAL(ret, 0);
+	memset(data, 0x5a, size);
+	ret = mbuf_mem_memfd_get_fd(mem, &fd, &offset);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	CU_ASSERT_NOT_EQUAL(offset, 0);
+
+	/* Map the same range, as a receiver process would do with a received
+	 * fd; the fd can be closed once mapped */
+	dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	CU_ASSERT_FATAL(dup_fd >= 0);
+	ret = mbuf_mem_memfd_map(dup_fd, offset, size, false, &ro_mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_memfd_map(dup_fd, offset, size, true, &rw_mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	close(dup_fd);
+	ret = mbuf_mem_get_data(ro_mem, (void **)&ro_data, &size);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(size, MBUF_TEST_MEMFD_MEM_SIZE);
+	ret = mbuf_mem_get_data(rw_mem, (void **)&rw_data, &size);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(size, MBUF_TEST_MEMFD_MEM_SIZE);
+	CU_ASSERT_PTR_NOT_EQUAL(ro_data, data);
+	CU_ASSERT_PTR_NOT_EQUAL(rw_data, data);
+
+	/* The data is visible through all the mappings */
+	CU_ASSERT_EQUAL(ro_data[0], 0x5a);
+	CU_ASSERT_EQUAL(ro_data[size - 1], 0x5a);
+	rw_data[0] = 0xa5;
+	rw_data[size - 1] = 0xa5;
+	CU_ASSERT_EQUAL(data[0], 0xa5);
+	CU_ASSERT_EQUAL(data[size - 1], 0xa5);
+	CU_ASSERT_EQUAL(ro_data[0], 0xa5);
+	data[1] = 0x3c;
+	CU_ASSERT_EQUAL(ro_data[1], 0x3c);
+	CU_ASSERT_EQUAL(rw_data[1], 0x3c);
+
+	/* Mapped memories are not memories of the implementation */
+	ret = mbuf_mem_memfd_get_fd(ro_mem, &fd, &offset);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	/* Invalid mappings */
+	ret = mbuf_mem_memfd_map(fd, offset + 1, size, false, &tmp);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_mem_memfd_map(fd, offset, 0, false, &tmp);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_mem_memfd_map(-1, offset, size, false, &tmp);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	/* Cleanup */
+	ret = mbuf_mem_unref(ro_mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_unref(rw_mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_unref(tmp);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_memfd_release_implem(implem);
+}
+
+
+static void test_mbuf_memfd_seals(void)
+{
+	int ret;
+	struct mbuf_mem_implem *implem;
+	struct mbuf_pool *pool;
+	struct mbuf_mem *mem;
+	size_t offset;
+	int fd, seals;
+	off_t size;
+
+	implem = test_memfd_implem();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(implem);
+	ret = mbuf_pool_new(implem,
+			    MBUF_TEST_MEMFD_MEM_SIZE,
+			    1,
+			    MBUF_POOL_NO_GROW,
+			    0,
+			    "memfd",
+			    &pool);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_memfd_get_fd(mem, &fd, &offset);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	seals = fcntl(fd, F_GET_SEALS);
+	CU_ASSERT(seals >= 0);
+	CU_ASSERT_EQUAL(seals & (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL),
+			F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+	/* The file can neither shrink nor grow */
+	size = lseek(fd, 0, SEEK_END);
+	CU_ASSERT(size > 0);
+	ret = ftruncate(fd, 0);
+	CU_ASSERT_EQUAL(ret, -1);
+	CU_ASSERT_EQUAL(errno, EPERM);
+	ret = ftruncate(fd, size * 2);
+	CU_ASSERT_EQUAL(ret, -1);
+	CU_ASSERT_EQUAL(errno, EPERM);
+	CU_ASSERT_EQUAL(lseek(fd, 0, SEEK_END), size);
+
+	/* The seals can not be removed nor extended */
+	ret = fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE);
+	CU_ASSERT_EQUAL(ret, -1);
+	CU_ASSERT_EQUAL(errno, EPERM);
+
+	/* Cleanup */
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_memfd_release_implem(implem);
+}
+
+
+CU_TestInfo g_mbuf_test_memfd[] = {
+	{(char *)"alloc", &test_mbuf_memfd_alloc},
+	{(char *)"exhaustion", &test_mbuf_memfd_exhaustion},
+	{(char *)"map", &test_mbuf_memfd_map},
+	{(char *)"seals", &test_mbuf_memfd_seals},
+	CU_TEST_INFO_NULL,
+};
@@ -26,6 +26,8 @@
 
 #include "mbuf_test.h"
 
+#include <pthread.h>
+
 
 #define MBUF_POOL_TEST_NAME "test-name"
 
@@ -376,6 +378,308 @@ static void test_mbuf_pool_lowmem_grow(void)
 	CU_ASSERT_EQUAL(ret, 0);
 }
 
+#define MBUF_POOL_TEST_THREADS 4
+#define MBUF_POOL_TEST_ITERATIONS 10000
+
+static void *pool_concurrent_thread(void *userdata)
+{
+	struct mbuf_pool *pool = userdata;
+	struct mbuf_mem *mem[2];
+	uintptr_t errors = 0;
+
+	for (int i = 0; i < MBUF_POOL_TEST_ITERATIONS; i++) {
+		/* Each thread holds at most 2 memories, so with a pool of
+		 * 2 * MBUF_POOL_TEST_THREADS memories, all gets must succeed */
+		for (int j = 0; j < 2; j++) {
+			if (mbuf_pool_get(pool, &mem[j]) != 0) {
+				errors++;
+				mem[j] = NULL;
+			}
+		}
+		for (int j = 0; j < 2; j++) {
+			if (mem[j] && mbuf_mem_unref(mem[j]) != 0)
+				errors++;
+		}
+	}
+
+	return (void *)errors;
+}
+
+static void test_mbuf_pool_concurrent(void)
+{
+	struct mbuf_pool *pool;
+	pthread_t threads[MBUF_POOL_TEST_THREADS];
+	size_t cur = 0, max = 0;
+	void *errors;
+
+	int ret = mbuf_pool_new(mbuf_mem_generic_impl,
+				1024,
+				2 * MBUF_POOL_TEST_THREADS,
+				MBUF_POOL_NO_GROW,
+				0,
+				"test_concurrent",
+				&pool);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	for (int i = 0; i < MBUF_POOL_TEST_THREADS; i++) {
+		ret = pthread_create(
+			&threads[i], NULL, pool_concurrent_thread, pool);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	for (int i = 0; i < MBUF_POOL_TEST_THREADS; i++) {
+		ret = pthread_join(threads[i], &errors);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_PTR_NULL(errors);
+	}
+
+	/* The pool should be full, with no change in its size */
+	ret = mbuf_pool_get_count(pool, &max, &cur);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(cur, 2 * MBUF_POOL_TEST_THREADS);
+	CU_ASSERT_EQUAL(max, 2 * MBUF_POOL_TEST_THREADS);
+
+	/* Cleanup */
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+static void *pool_thread_cache_thread(void *userdata)
+{
+	struct mbuf_pool *pool = userdata;
+	struct mbuf_mem *save[MBUF_TEST_POOL_SIZE];
+	uintptr_t errors = 0;
+
+	/* Memories cached by the main thread must be reclaimed */
+	for (int i = 0; i < MBUF_TEST_POOL_SIZE; i++) {
+		if (mbuf_pool_get(pool, &save[i]) != 0)
+			return (void *)(uintptr_t)(MBUF_TEST_POOL_SIZE - i);
+	}
+
+	for (int i = 0; i < MBUF_TEST_POOL_SIZE; i++) {
+		if (mbuf_mem_unref(save[i]) != 0)
+			errors++;
+	}
+
+	return (void *)errors;
+}
+
+static void test_mbuf_pool_thread_cache(void)
+{
+	struct mbuf_pool *pool;
+	struct mbuf_mem *mem, *mem2;
+	struct mbuf_mem *save[MBUF_TEST_POOL_SIZE];
+	pthread_t thread;
+	size_t cur = 0, max = 0;
+	void *errors;
+
+	int ret = mbuf_pool_new(mbuf_mem_generic_impl,
+				1024,
+				MBUF_TEST_POOL_SIZE,
+				MBUF_POOL_NO_GROW,
+				0,
+				"test_thread_cache",
+				&pool);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Bad args */
+	ret = mbuf_pool_set_thread_cache_size(NULL, 4);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_pool_set_thread_cache_size(pool, 0);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_pool_set_thread_cache_size(
+		pool, MBUF_POOL_THREAD_CACHE_MAX_SIZE + 1);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	ret = mbuf_pool_set_thread_cache_size(pool, MBUF_TEST_POOL_SIZE / 2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_set_thread_cache_size(pool, MBUF_TEST_POOL_SIZE / 2);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+
+	/* A released memory is given back to the same thread */
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_get(pool, &mem2);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(mem, mem2);
+	ret = mbuf_mem_unref(mem2);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Fill the thread cache */
+	for (int i = 0; i < MBUF_TEST_POOL_SIZE; i++) {
+		ret = mbuf_pool_get(pool, &save[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+	for (int i = 0; i < MBUF_TEST_POOL_SIZE; i++) {
+		ret = mbuf_mem_unref(save[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Cached memories are accounted as free memories */
+	ret = mbuf_pool_get_count(pool, &max, &cur);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(cur, MBUF_TEST_POOL_SIZE);
+	CU_ASSERT_EQUAL(max, MBUF_TEST_POOL_SIZE);
+
+	/* Another thread can get all the memories */
+	ret = pthread_create(&thread, NULL, pool_thread_cache_thread, pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = pthread_join(thread, &errors);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_NULL(errors);
+
+	/* The memories cached by the other thread are back in the pool */
+	ret = mbuf_pool_get_count(pool, &max, &cur);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(cur, MBUF_TEST_POOL_SIZE);
+	CU_ASSERT_EQUAL(max, MBUF_TEST_POOL_SIZE);
+
+	/* Cleanup */
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+static void test_mbuf_pool_slab(void)
+{
+	struct mbuf_pool *pool;
+	struct mbuf_mem *mem;
+	struct mbuf_mem *save[MBUF_TEST_POOL_SIZE];
+	struct mbuf_mem_implem *implem;
+	struct mbuf_generic_slab_attr attrs = {
+		.mem_size = 1000,
+		.mem_count = MBUF_TEST_POOL_SIZE,
+		.align = 256,
+		.huge_pages = true,
+	};
+	void *data;
+	size_t capacity;
+
+	/* Bad args */
+	implem = mbuf_mem_generic_get_slab_implem(NULL);
+	CU_ASSERT_PTR_NULL(implem);
+	attrs.align = 3;
+	implem = mbuf_mem_generic_get_slab_implem(&attrs);
+	CU_ASSERT_PTR_NULL(implem);
+	attrs.align = 256;
+
+	implem = mbuf_mem_generic_get_slab_implem(&attrs);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(implem);
+
+	/* The slab cannot provide more memories than its size */
+	int ret = mbuf_pool_new(implem,
+				1000,
+				MBUF_TEST_POOL_SIZE + 1,
+				MBUF_POOL_NO_GROW,
+				0,
+				"test_slab",
+				&pool);
+	CU_ASSERT_EQUAL(ret, -ENOMEM);
+
+	ret = mbuf_pool_new(implem,
+			    1000,
+			    MBUF_TEST_POOL_SIZE / 2,
+			    MBUF_POOL_GROW,
+			    0,
+			    "test_slab",
+			    &pool);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Get all available buffers, they must be aligned and distinct */
+	for (int i = 0; i < MBUF_TEST_POOL_SIZE; i++) {
+		ret = mbuf_pool_get(pool, &save[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_mem_get_data(save[i], &data, &capacity);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(capacity, 1000);
+		CU_ASSERT_EQUAL((uintptr_t)data % 256, 0);
+		memset(data, i, capacity);
+		for (int j = 0; j < i; j++)
+			CU_ASSERT_PTR_NOT_EQUAL(save[i], save[j]);
+	}
+
+	/* The slab is exhausted */
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL(ret, -ENOMEM);
+
+	for (int i = 0; i < MBUF_TEST_POOL_SIZE; i++) {
+		ret = mbuf_mem_get_data(save[i], &data, &capacity);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(((uint8_t *)data)[0], i);
+		CU_ASSERT_EQUAL(((uint8_t *)data)[capacity - 1], i);
+		ret = mbuf_mem_unref(save[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Cleanup */
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_generic_release_implem(implem);
+}
+
+static void test_mbuf_pool_aligned(void)
+{
+	struct mbuf_pool *pool;
+	struct mbuf_mem *mem;
+	struct mbuf_mem *save[MBUF_TEST_POOL_SIZE];
+	struct mbuf_mem_implem *implem;
+	void *data;
+	size_t capacity;
+
+	/* Bad args */
+	implem = mbuf_mem_generic_get_aligned_implem(0, 0);
+	CU_ASSERT_PTR_NULL(implem);
+	implem = mbuf_mem_generic_get_aligned_implem(48, 0);
+	CU_ASSERT_PTR_NULL(implem);
+
+	implem = mbuf_mem_generic_get_aligned_implem(4096, 64);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(implem);
+
+	int ret = mbuf_pool_new(implem,
+				1000,
+				MBUF_TEST_POOL_SIZE,
+				MBUF_POOL_NO_GROW,
+				0,
+				"test_aligned",
+				&pool);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	for (int i = 0; i < MBUF_TEST_POOL_SIZE; i++) {
+		ret = mbuf_pool_get(pool, &save[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = mbuf_mem_get_data(save[i], &data, &capacity);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(capacity, 1000);
+		CU_ASSERT_EQUAL((uintptr_t)data % 4096, 0);
+		/* The padding is readable and cleared */
+		CU_ASSERT_EQUAL(((uint8_t *)data)[capacity + 63], 0);
+	}
+
+	for (int i = 0; i < MBUF_TEST_POOL_SIZE; i++) {
+		ret = mbuf_mem_unref(save[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_generic_release_implem(implem);
+
+	/* Standalone aligned memory */
+	ret = mbuf_mem_generic_new_aligned(1000, 3, 0, &mem);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_mem_generic_new_aligned(1000, 64, 32, &mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_get_data(mem, &data, &capacity);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(capacity, 1000);
+	CU_ASSERT_EQUAL((uintptr_t)data % 64, 0);
+	CU_ASSERT_EQUAL(((uint8_t *)data)[capacity + 31], 0);
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
 CU_TestInfo g_mbuf_test_pool[] = {
 	{(char *)"name", &test_mbuf_pool_name},
 	{(char *)"nogrow", &test_mbuf_pool},
@@ -383,5 +687,9 @@ CU_TestInfo g_mbuf_test_pool[] = {
 	{(char *)"grow-with-max", &test_mbuf_pool_grow_max},
 	{(char *)"smart-grow", &test_mbuf_pool_smart_grow},
 	{(char *)"lowmem-grow", &test_mbuf_pool_lowmem_grow},
+	{(char *)"concurrent", &test_mbuf_pool_concurrent},
+	{(char *)"thread-cache", &test_mbuf_pool_thread_cache},
+	{(char *)"slab", &test_mbuf_pool_slab},
+	{(char *)"aligned", &test_mbuf_pool_aligned},
 	CU_TEST_INFO_NULL,
 };
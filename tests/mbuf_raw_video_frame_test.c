@@ -26,6 +26,18 @@
 
 #include "mbuf_test.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+/* From the sanitizers allocator interface */
+int __sanitizer_install_malloc_and_free_hooks(
+	void (*malloc_hook)(const volatile void *ptr, size_t size),
+	void (*free_hook)(const volatile void *ptr));
+#elif defined(__GLIBC__)
+#	include <malloc.h>
+#endif
+
 #define MBUF_TEST_WIDTH 4
 #define MBUF_TEST_HEIGHT 4
 #define MBUF_TEST_STRIDE_ALIGN 16
@@ -1372,6 +1384,257 @@ static void test_mbuf_raw_video_frame_queue_drop(void)
 }
 
 
+#define MBUF_TEST_LOCK_FREE_PUSH_COUNT 10000
+
+
+struct raw_queue_lock_free_ctx {
+	struct mbuf_raw_video_frame_queue *queue;
+	struct mbuf_raw_video_frame *frame;
+	atomic_int done;
+};
+
+
+static void *raw_queue_lock_free_thread(void *userdata)
+{
+	struct raw_queue_lock_free_ctx *ctx = userdata;
+	uintptr_t errors = 0;
+
+	for (int i = 0; i < MBUF_TEST_LOCK_FREE_PUSH_COUNT; i++) {
+		if (mbuf_raw_video_frame_queue_push(ctx->queue, ctx->frame) !=
+		    0)
+			errors++;
+	}
+
+	atomic_fetch_add(&ctx->done, 1);
+	return (void *)errors;
+}
+
+
+static void test_mbuf_raw_video_frame_queue_lock_free(void)
+{
+	int ret;
+	struct vdef_raw_frame frame_info;
+	struct mbuf_raw_video_frame *frame1, *frame2, *frame3, *out_frame;
+	struct mbuf_raw_video_frame_queue *queue;
+	pthread_t threads[2];
+	struct raw_queue_lock_free_ctx ctx;
+	int popped = 0;
+
+	init_frame_info(&frame_info, false);
+
+	/* Lock-free queues must be bounded */
+	struct mbuf_raw_video_frame_queue_args args = {
+		.mode = MBUF_FRAME_QUEUE_MODE_LOCKFREE,
+	};
+	ret = mbuf_raw_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	/* Create the frames and the lock-free queue, with max_frames = 2 */
+	ret = mbuf_raw_video_frame_new(&frame_info, &frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_new(&frame_info, &frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_new(&frame_info, &frame3);
+	CU_ASSERT_EQUAL(ret, 0);
+	set_planes(frame1, NULL, NULL, NULL);
+	ret = mbuf_raw_video_frame_finalize(frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	set_planes(frame2, NULL, NULL, NULL);
+	ret = mbuf_raw_video_frame_finalize(frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+	set_planes(frame3, NULL, NULL, NULL);
+	ret = mbuf_raw_video_frame_finalize(frame3);
+	CU_ASSERT_EQUAL(ret, 0);
+	args.max_frames = 2;
+	ret = mbuf_raw_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Push the three frames, the oldest one should be dropped */
+	ret = mbuf_raw_video_frame_queue_push(queue, frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_queue_push(queue, frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_queue_push(queue, frame3);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_queue_get_count(queue);
+	CU_ASSERT_EQUAL(ret, 2);
+
+	/* Peek is not supported */
+	ret = mbuf_raw_video_frame_queue_peek(queue, &out_frame);
+	CU_ASSERT_EQUAL(ret, -EOPNOTSUPP);
+	ret = mbuf_raw_video_frame_queue_peek_at(queue, 0, &out_frame);
+	CU_ASSERT_EQUAL(ret, -EOPNOTSUPP);
+
+	/* Pop the frames, in order */
+	ret = mbuf_raw_video_frame_queue_pop(queue, &out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(frame2, out_frame);
+	ret = mbuf_raw_video_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_queue_pop(queue, &out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(frame3, out_frame);
+	ret = mbuf_raw_video_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_queue_pop(queue, &out_frame);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+
+	/* Flush a non-empty queue */
+	ret = mbuf_raw_video_frame_queue_push(queue, frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_queue_flush(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_queue_get_count(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Two producer threads push frame 1, the main thread consumes */
+	args.mode = MBUF_FRAME_QUEUE_MODE_LOCKFREE;
+	args.max_frames = 4;
+	ret = mbuf_raw_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ctx.queue = queue;
+	ctx.frame = frame1;
+	atomic_init(&ctx.done, 0);
+	for (int i = 0; i < 2; i++) {
+		ret = pthread_create(
+			&threads[i], NULL, raw_queue_lock_free_thread, &ctx);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	while (atomic_load(&ctx.done) < 2 ||
+	       mbuf_raw_video_frame_queue_get_count(queue) > 0) {
+		ret = mbuf_raw_video_frame_queue_pop(queue, &out_frame);
+		if (ret == -EAGAIN)
+			continue;
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			break;
+		ret = mbuf_raw_video_frame_unref(out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		popped++;
+	}
+	for (int i = 0; i < 2; i++) {
+		void *errors;
+		pthread_join(threads[i], &errors);
+		CU_ASSERT_EQUAL((uintptr_t)errors, 0);
+	}
+	CU_ASSERT(popped > 0);
+	CU_ASSERT(popped <= 2 * MBUF_TEST_LOCK_FREE_PUSH_COUNT);
+	ret = mbuf_raw_video_frame_queue_get_count(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Cleanup */
+	ret = mbuf_raw_video_frame_unref(frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_unref(frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_unref(frame3);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
+static void test_mbuf_raw_video_frame_bcast(void)
+{
+	int ret;
+	struct vdef_raw_frame frame_info;
+	struct mbuf_raw_video_frame *frame1, *frame2, *out_frame;
+	struct mbuf_raw_video_frame_bcast *bcast;
+	struct mbuf_raw_video_frame_bcast_reader *reader1, *reader2;
+
+	init_frame_info(&frame_info, false);
+
+	/* Create the frames and the broadcast queue, with a ring of 4 */
+	ret = mbuf_raw_video_frame_new(&frame_info, &frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_new(&frame_info, &frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+	set_planes(frame1, NULL, NULL, NULL);
+	ret = mbuf_raw_video_frame_finalize(frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	set_planes(frame2, NULL, NULL, NULL);
+	ret = mbuf_raw_video_frame_finalize(frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_bcast_new(0, &bcast);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = mbuf_raw_video_frame_bcast_new(4, &bcast);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Pushing without readers should release the frame immediately */
+	ret = mbuf_raw_video_frame_bcast_push(bcast, frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Reader 1 is unlimited, reader 2 keeps only one frame */
+	ret = mbuf_raw_video_frame_bcast_reader_new(bcast, 0, &reader1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_bcast_reader_new(bcast, 1, &reader2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_bcast_reader_get_count(reader1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_bcast_reader_pop(reader1, &out_frame);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+
+	ret = mbuf_raw_video_frame_bcast_push(bcast, frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_bcast_push(bcast, frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_bcast_reader_get_count(reader1);
+	CU_ASSERT_EQUAL(ret, 2);
+	ret = mbuf_raw_video_frame_bcast_reader_get_count(reader2);
+	CU_ASSERT_EQUAL(ret, 1);
+
+	/* Reader 2 should only get frame 2 */
+	ret = mbuf_raw_video_frame_bcast_reader_pop(reader2, &out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(out_frame, frame2);
+	ret = mbuf_raw_video_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_bcast_reader_pop(reader2, &out_frame);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+
+	/* Reader 1 should get both frames, in order */
+	ret = mbuf_raw_video_frame_bcast_reader_pop(reader1, &out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(out_frame, frame1);
+	ret = mbuf_raw_video_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_bcast_reader_pop(reader1, &out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(out_frame, frame2);
+	ret = mbuf_raw_video_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Overflow the ring: reader 1 should keep the 4 latest frames */
+	for (int i = 0; i < 5; i++) {
+		ret = mbuf_raw_video_frame_bcast_push(bcast,
+						      i == 4 ? frame2 : frame1);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_raw_video_frame_bcast_reader_get_count(reader1);
+	CU_ASSERT_EQUAL(ret, 4);
+	ret = mbuf_raw_video_frame_bcast_reader_get_count(reader2);
+	CU_ASSERT_EQUAL(ret, 1);
+
+	/* The broadcast queue can not be destroyed while it has readers */
+	ret = mbuf_raw_video_frame_bcast_destroy(bcast);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+
+	/* Cleanup, the pending frames are released with the readers */
+	ret = mbuf_raw_video_frame_bcast_reader_destroy(reader1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_bcast_reader_destroy(reader2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_bcast_destroy(bcast);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_unref(frame1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_unref(frame2);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
 struct mbuf_ancillary_data_dyn_test {
 	char *dyn_str;
 };
@@ -1389,6 +1652,336 @@ struct mbuf_ancillary_data_test {
 };
 
 
+static void test_mbuf_raw_video_frame_queue_peek_range(void)
+{
+	int ret;
+	struct vdef_raw_frame frame_info;
+	struct mbuf_raw_video_frame *frames[3], *out_frames[32], *out_frame;
+	struct mbuf_raw_video_frame_queue *queue;
+	unsigned int count;
+
+	init_frame_info(&frame_info, false);
+
+	for (unsigned int i = 0; i < 3; i++) {
+		ret = mbuf_raw_video_frame_new(&frame_info, &frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		set_planes(frames[i], NULL, NULL, NULL);
+		ret = mbuf_raw_video_frame_finalize(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Unbounded queue: push enough frames to grow the ring, then pop and
+	 * push some frames to make it wrap around */
+	ret = mbuf_raw_video_frame_queue_new(&queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_queue_peek_range(
+		queue, 0, out_frames, 4, &count);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+	CU_ASSERT_EQUAL(count, 0);
+	for (unsigned int i = 0; i < 20; i++) {
+		ret = mbuf_raw_video_frame_queue_push(queue, frames[i % 3]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	for (unsigned int i = 0; i < 5; i++) {
+		ret = mbuf_raw_video_frame_queue_pop(queue, &out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_PTR_EQUAL(out_frame, frames[i % 3]);
+		mbuf_raw_video_frame_unref(out_frame);
+	}
+	for (unsigned int i = 20; i < 25; i++) {
+		ret = mbuf_raw_video_frame_queue_push(queue, frames[i % 3]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT_EQUAL(mbuf_raw_video_frame_queue_get_count(queue), 20);
+
+	for (unsigned int i = 0; i < 20; i++) {
+		ret = mbuf_raw_video_frame_queue_peek_at(queue, i, &out_frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_PTR_EQUAL(out_frame, frames[(i + 5) % 3]);
+		mbuf_raw_video_frame_unref(out_frame);
+	}
+	ret = mbuf_raw_video_frame_queue_peek_at(queue, 20, &out_frame);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	/* The range is truncated at the end of the queue */
+	ret = mbuf_raw_video_frame_queue_peek_range(
+		queue, 10, out_frames, 32, &count);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(count, 10);
+	for (unsigned int i = 0; i < count; i++) {
+		CU_ASSERT_PTR_EQUAL(out_frames[i], frames[(i + 15) % 3]);
+		mbuf_raw_video_frame_unref(out_frames[i]);
+	}
+	ret = mbuf_raw_video_frame_queue_peek_range(
+		queue, 20, out_frames, 4, &count);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	CU_ASSERT_EQUAL(count, 0);
+
+	/* Peeking does not remove the frames */
+	CU_ASSERT_EQUAL(mbuf_raw_video_frame_queue_get_count(queue), 20);
+	ret = mbuf_raw_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Bounded queue: only the 5 newest frames are kept */
+	struct mbuf_raw_video_frame_queue_args args = {
+		.max_frames = 5,
+	};
+	ret = mbuf_raw_video_frame_queue_new_with_args(&args, &queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < 12; i++) {
+		ret = mbuf_raw_video_frame_queue_push(queue, frames[i % 3]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_raw_video_frame_queue_peek_range(
+		queue, 0, out_frames, 32, &count);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(count, 5);
+	for (unsigned int i = 0; i < count; i++) {
+		CU_ASSERT_PTR_EQUAL(out_frames[i], frames[(i + 7) % 3]);
+		mbuf_raw_video_frame_unref(out_frames[i]);
+	}
+	ret = mbuf_raw_video_frame_queue_destroy(queue);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Cleanup */
+	for (unsigned int i = 0; i < 3; i++) {
+		ret = mbuf_raw_video_frame_unref(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+}
+
+
+#if defined(__SANITIZE_ADDRESS__)
+static atomic_size_t s_alloc_count;
+
+
+static void count_malloc(const volatile void *ptr, size_t size)
+{
+	atomic_fetch_add(&s_alloc_count, 1);
+}
+
+
+static void count_free(const volatile void *ptr)
+{
+}
+#endif
+
+
+/* Returns a value which changes when memory is allocated: the number of
+ * allocations when they can be counted, otherwise the number of bytes
+ * currently allocated, or 0 if neither can be known on this platform */
+static size_t get_alloc_counter(void)
+{
+#if defined(__SANITIZE_ADDRESS__)
+	static atomic_bool installed;
+	if (!atomic_exchange(&installed, true))
+		__sanitizer_install_malloc_and_free_hooks(count_malloc,
+							  count_free);
+	return atomic_load(&s_alloc_count);
+#elif defined(__GLIBC__)
+#	if __GLIBC_PREREQ(2, 33)
+	return mallinfo2().uordblks;
+#	else
+	return 0;
+#	endif
+#else
+	return 0;
+#endif
+}
+
+
+#define MBUF_TEST_NO_ALLOC_FRAMES 8
+#define MBUF_TEST_NO_ALLOC_ROUNDS 100
+
+
+static void test_mbuf_raw_video_frame_queue_no_alloc(void)
+{
+	int ret;
+	struct vdef_raw_frame frame_info;
+	struct mbuf_raw_video_frame *frames[MBUF_TEST_NO_ALLOC_FRAMES];
+	struct mbuf_raw_video_frame *out_frame;
+	struct mbuf_raw_video_frame_queue *queue;
+	size_t counter;
+	unsigned int changed;
+	struct mbuf_raw_video_frame_queue_args args[] = {
+		{.max_frames = MBUF_TEST_NO_ALLOC_FRAMES},
+		{.max_frames = 0},
+		{
+			.max_frames = MBUF_TEST_NO_ALLOC_FRAMES,
+			.mode = MBUF_FRAME_QUEUE_MODE_LOCKFREE,
+		},
+	};
+
+	init_frame_info(&frame_info, false);
+
+	for (unsigned int i = 0; i < MBUF_TEST_NO_ALLOC_FRAMES; i++) {
+		ret = mbuf_raw_video_frame_new(&frame_info, &frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		set_planes(frames[i], NULL, NULL, NULL);
+		ret = mbuf_raw_video_frame_finalize(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Bounded, unbounded and lock-free queues: once the queue storage
+	 * has grown (unbounded queues), pushing and popping frames must not
+	 * allocate memory */
+	for (unsigned int q = 0; q < sizeof(args) / sizeof(args[0]); q++) {
+		ret = mbuf_raw_video_frame_queue_new_with_args(&args[q],
+							       &queue);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			continue;
+
+		for (unsigned int i = 0; i < MBUF_TEST_NO_ALLOC_FRAMES; i++) {
+			ret = mbuf_raw_video_frame_queue_push(queue,
+							      frames[i]);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+		ret = mbuf_raw_video_frame_queue_flush(queue);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		counter = get_alloc_counter();
+		changed = 0;
+		for (unsigned int r = 0; r < MBUF_TEST_NO_ALLOC_ROUNDS; r++) {
+			for (unsigned int i = 0; i < MBUF_TEST_NO_ALLOC_FRAMES;
+			     i++) {
+				ret = mbuf_raw_video_frame_queue_push(
+					queue, frames[i]);
+				CU_ASSERT_EQUAL(ret, 0);
+			}
+			if (get_alloc_counter() != counter)
+				changed++;
+			for (unsigned int i = 0; i < MBUF_TEST_NO_ALLOC_FRAMES;
+			     i++) {
+				ret = mbuf_raw_video_frame_queue_pop(
+					queue, &out_frame);
+				CU_ASSERT_EQUAL(ret, 0);
+				if (ret != 0)
+					continue;
+				CU_ASSERT_PTR_EQUAL(out_frame, frames[i]);
+				mbuf_raw_video_frame_unref(out_frame);
+			}
+			if (get_alloc_counter() != counter)
+				changed++;
+		}
+		CU_ASSERT_EQUAL(changed, 0);
+
+		ret = mbuf_raw_video_frame_queue_destroy(queue);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	for (unsigned int i = 0; i < MBUF_TEST_NO_ALLOC_FRAMES; i++) {
+		ret = mbuf_raw_video_frame_unref(frames[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+}
+
+
+#define MBUF_TEST_METADATA_WRITE_COUNT 5000
+#define MBUF_TEST_METADATA_READERS 3
+
+
+struct raw_metadata_ctx {
+	struct mbuf_raw_video_frame *frame;
+	struct vmeta_frame *metas[2];
+	atomic_bool stop;
+};
+
+
+static void *raw_metadata_reader_thread(void *userdata)
+{
+	struct raw_metadata_ctx *ctx = userdata;
+	struct vmeta_frame *meta;
+	uintptr_t errors = 0;
+
+	/* Overlapping readers, until the writers are done */
+	while (!atomic_load(&ctx->stop)) {
+		if (mbuf_raw_video_frame_get_metadata(ctx->frame, &meta) != 0) {
+			errors++;
+			continue;
+		}
+		if (meta != ctx->metas[0] && meta != ctx->metas[1])
+			errors++;
+		vmeta_frame_unref(meta);
+	}
+
+	return (void *)errors;
+}
+
+
+static void *raw_metadata_writer_thread(void *userdata)
+{
+	struct raw_metadata_ctx *ctx = userdata;
+	uintptr_t errors = 0;
+
+	for (int i = 0; i < MBUF_TEST_METADATA_WRITE_COUNT; i++) {
+		if (mbuf_raw_video_frame_set_metadata(ctx->frame,
+						      ctx->metas[i % 2]) != 0)
+			errors++;
+	}
+
+	return (void *)errors;
+}
+
+
+static void test_mbuf_raw_video_frame_metadata_concurrent(void)
+{
+	int ret;
+	struct vdef_raw_frame frame_info;
+	struct raw_metadata_ctx ctx;
+	pthread_t readers[MBUF_TEST_METADATA_READERS];
+	pthread_t writers[2];
+	void *thread_ret;
+
+	init_frame_info(&frame_info, false);
+	ret = mbuf_raw_video_frame_new(&frame_info, &ctx.frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = vmeta_frame_new(VMETA_FRAME_TYPE_PROTO, &ctx.metas[0]);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = vmeta_frame_new(VMETA_FRAME_TYPE_PROTO, &ctx.metas[1]);
+	CU_ASSERT_EQUAL(ret, 0);
+	atomic_init(&ctx.stop, false);
+
+	ret = mbuf_raw_video_frame_set_metadata(ctx.frame, ctx.metas[0]);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Replace the metadata from two writers while the readers
+	 * continuously get it: the writers must not be starved */
+	for (int t = 0; t < MBUF_TEST_METADATA_READERS; t++) {
+		ret = pthread_create(
+			&readers[t], NULL, raw_metadata_reader_thread, &ctx);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	for (int t = 0; t < 2; t++) {
+		ret = pthread_create(
+			&writers[t], NULL, raw_metadata_writer_thread, &ctx);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	for (int t = 0; t < 2; t++) {
+		pthread_join(writers[t], &thread_ret);
+		CU_ASSERT_EQUAL((uintptr_t)thread_ret, 0);
+	}
+	atomic_store(&ctx.stop, true);
+	for (int t = 0; t < MBUF_TEST_METADATA_READERS; t++) {
+		pthread_join(readers[t], &thread_ret);
+		CU_ASSERT_EQUAL((uintptr_t)thread_ret, 0);
+	}
+
+	/* Only the frame and the test should hold references */
+	CU_ASSERT_EQUAL(vmeta_frame_get_ref_count(ctx.metas[0]) +
+				vmeta_frame_get_ref_count(ctx.metas[1]),
+			3);
+
+	/* Cleanup */
+	ret = mbuf_raw_video_frame_unref(ctx.frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(vmeta_frame_get_ref_count(ctx.metas[0]), 1);
+	CU_ASSERT_EQUAL(vmeta_frame_get_ref_count(ctx.metas[1]), 1);
+	vmeta_frame_unref(ctx.metas[0]);
+	vmeta_frame_unref(ctx.metas[1]);
+}
+
+
 static bool ancillary_iterator(struct mbuf_ancillary_data *data, void *userdata)
 {
 	struct mbuf_ancillary_data_test *adt = userdata;
@@ -1602,6 +2195,14 @@ CU_TestInfo g_mbuf_test_raw_video_frame[] = {
 	{(char *)"queue_event", &test_mbuf_raw_video_frame_queue_evt},
 	{(char *)"queue_filter", &test_mbuf_raw_video_frame_queue_filter},
 	{(char *)"queue_drop", &test_mbuf_raw_video_frame_queue_drop},
+	{(char *)"queue_lock_free",
+	 &test_mbuf_raw_video_frame_queue_lock_free},
+	{(char *)"bcast", &test_mbuf_raw_video_frame_bcast},
+	{(char *)"queue_peek_range",
+	 &test_mbuf_raw_video_frame_queue_peek_range},
+	{(char *)"queue_no_alloc", &test_mbuf_raw_video_frame_queue_no_alloc},
+	{(char *)"metadata_concurrent",
+	 &test_mbuf_raw_video_frame_metadata_concurrent},
 	{(char *)"ancillary_data", &test_mbuf_raw_video_frame_ancillary_data},
 	CU_TEST_INFO_NULL,
 };
@@ -0,0 +1,518 @@
+/**
+ * Copyright (c) 2026 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mbuf_test.h"
+
+#include <media-buffers/mbuf_shm_frame_queue.h>
+
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+
+#define MBUF_TEST_SHMQ_MEM_SIZE 4096
+#define MBUF_TEST_SHMQ_MEM_COUNT 8
+#define MBUF_TEST_SHMQ_SLOT_COUNT 2
+#define MBUF_TEST_SHMQ_WIDTH 32
+#define MBUF_TEST_SHMQ_HEIGHT 16
+
+
+/* Producer and consumer ends of a SHM frame queue, in the same process */
+struct shmq_ctx {
+	char heap_addr[64];
+	char queue_addr[64];
+	struct mbuf_shm_attr heap_attr;
+	struct mbuf_shm_frame_queue_attr queue_attr;
+	struct mbuf_mem_implem *implem;
+	struct mbuf_pool *pool;
+	struct mbuf_shm_consumer *consumer;
+	struct mbuf_shm_frame_queue *producer_queue;
+	struct mbuf_shm_frame_queue *consumer_queue;
+};
+
+
+static void shmq_setup(struct shmq_ctx *ctx)
+{
+	int ret;
+
+	memset(ctx, 0, sizeof(*ctx));
+	snprintf(ctx->heap_addr,
+		 sizeof(ctx->heap_addr),
+		 "/mbuf_test_shmq_heap_%d",
+		 (int)getpid());
+	snprintf(ctx->queue_addr,
+		 sizeof(ctx->queue_addr),
+		 "/mbuf_test_shmq_%d",
+		 (int)getpid());
+	ctx->heap_attr.addr = ctx->heap_addr;
+	ctx->heap_attr.mem_size = MBUF_TEST_SHMQ_MEM_SIZE;
+	ctx->heap_attr.mem_count = MBUF_TEST_SHMQ_MEM_COUNT;
+	ctx->queue_attr.addr = ctx->queue_addr;
+	ctx->queue_attr.slot_count = MBUF_TEST_SHMQ_SLOT_COUNT;
+
+	ctx->implem = mbuf_mem_shm_get_implem(&ctx->heap_attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx->implem);
+	ret = mbuf_pool_new(ctx->implem,
+			    MBUF_TEST_SHMQ_MEM_SIZE,
+			    MBUF_TEST_SHMQ_MEM_COUNT,
+			    MBUF_POOL_NO_GROW,
+			    0,
+			    "shmq",
+			    &ctx->pool);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_shm_frame_queue_new(&ctx->queue_attr, &ctx->producer_queue);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	ret = mbuf_mem_shm_consumer_attach(
+		&ctx->heap_attr, false, &ctx->consumer);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_shm_frame_queue_attach(
+		&ctx->queue_attr,
+		ctx->consumer,
+		mbuf_shm_frame_queue_get_fd(ctx->producer_queue),
+		&ctx->consumer_queue);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+}
+
+
+static void shmq_teardown(struct shmq_ctx *ctx)
+{
+	int ret;
+
+	ret = mbuf_shm_frame_queue_destroy(ctx->consumer_queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_shm_consumer_detach(ctx->consumer);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_shm_frame_queue_destroy(ctx->producer_queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_destroy(ctx->pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_shm_release_implem(ctx->implem);
+}
+
+
+/* Number of memories of the pool which are free for the producer */
+static unsigned int shmq_get_free_count(struct shmq_ctx *ctx)
+{
+	struct mbuf_mem *mems[MBUF_TEST_SHMQ_MEM_COUNT];
+	unsigned int count = 0;
+
+	while (count < MBUF_TEST_SHMQ_MEM_COUNT &&
+	       mbuf_pool_get(ctx->pool, &mems[count]) == 0)
+		count++;
+	for (unsigned int i = 0; i < count; i++)
+		mbuf_mem_unref(mems[i]);
+
+	return count;
+}
+
+
+static bool check_bytes(const void *data, size_t len, uint8_t value)
+{
+	const uint8_t *bytes = data;
+
+	for (size_t i = 0; i < len; i++) {
+		if (bytes[i] != value)
+			return false;
+	}
+	return true;
+}
+
+
+static void test_mbuf_shm_frame_queue_raw_video(void)
+{
+	int ret;
+	struct shmq_ctx ctx;
+	struct vdef_raw_frame frame_info = {
+		.format = vdef_i420,
+		.info.resolution.width = MBUF_TEST_SHMQ_WIDTH,
+		.info.resolution.height = MBUF_TEST_SHMQ_HEIGHT,
+		.info.index = 42,
+		.info.timestamp = 123456,
+		.info.timescale = 1000000,
+		.plane_stride = {MBUF_TEST_SHMQ_WIDTH,
+				 MBUF_TEST_SHMQ_WIDTH / 2,
+				 MBUF_TEST_SHMQ_WIDTH / 2},
+	};
+	const size_t offsets[3] = {0, 512, 640};
+	const size_t lens[3] = {512, 128, 128};
+	struct vdef_raw_frame out_info;
+	struct mbuf_raw_video_frame *frame, *out_frame;
+	struct mbuf_coded_video_frame *coded_frame;
+	struct mbuf_ancillary_data *ancillary;
+	struct vmeta_frame *meta, *out_meta;
+	struct mbuf_mem *mem;
+	struct pollfd pfd;
+	enum mbuf_shm_frame_type type;
+	const void *planes[3];
+	size_t len;
+	uint8_t *data;
+	size_t capacity;
+
+	shmq_setup(&ctx);
+
+	/* All the planes in a single memory */
+	ret = mbuf_raw_video_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_pool_get(ctx.pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_get_data(mem, (void **)&data, &capacity);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int i = 0; i < 3; i++) {
+		memset(data + offsets[i], 0x11 * (i + 1), lens[i]);
+		ret = mbuf_raw_video_frame_set_plane(
+			frame, i, mem, offsets[i], lens[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	mbuf_mem_unref(mem);
+	ret = vmeta_frame_new(VMETA_FRAME_TYPE_PROTO, &meta);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_raw_video_frame_set_metadata(frame, meta);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_add_ancillary_string(frame, "name", "value");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_raw_video_frame_finalize(frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* Fill the queue */
+	pfd.fd = mbuf_shm_frame_queue_get_fd(ctx.consumer_queue);
+	pfd.events = POLLIN;
+	CU_ASSERT_EQUAL(poll(&pfd, 1, 0), 0);
+	for (unsigned int i = 0; i < MBUF_TEST_SHMQ_SLOT_COUNT; i++) {
+		ret = mbuf_shm_frame_queue_push_raw_video(ctx.producer_queue,
+							  frame);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_shm_frame_queue_push_raw_video(ctx.producer_queue, frame);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+	CU_ASSERT_EQUAL(poll(&pfd, 1, 0), 1);
+	CU_ASSERT_EQUAL(mbuf_shm_frame_queue_get_count(ctx.consumer_queue),
+			MBUF_TEST_SHMQ_SLOT_COUNT);
+
+	/* The memory stays shared after the producer released the frame */
+	ret = mbuf_raw_video_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(shmq_get_free_count(&ctx),
+			MBUF_TEST_SHMQ_MEM_COUNT - 1);
+
+	ret = mbuf_shm_frame_queue_peek_type(ctx.consumer_queue, &type);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(type, MBUF_SHM_FRAME_TYPE_RAW_VIDEO);
+	ret = mbuf_shm_frame_queue_pop_coded_video(ctx.consumer_queue,
+						   &coded_frame);
+	CU_ASSERT_EQUAL(ret, -EPROTO);
+	ret = mbuf_shm_frame_queue_pop_raw_video(ctx.consumer_queue,
+						 &out_frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* Frame info */
+	ret = mbuf_raw_video_frame_get_frame_info(out_frame, &out_info);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(vdef_raw_format_cmp(&out_info.format, &frame_info.format));
+	CU_ASSERT_EQUAL(out_info.info.resolution.width, MBUF_TEST_SHMQ_WIDTH);
+	CU_ASSERT_EQUAL(out_info.info.resolution.height,
+			MBUF_TEST_SHMQ_HEIGHT);
+	CU_ASSERT_EQUAL(out_info.info.index, 42);
+	CU_ASSERT_EQUAL(out_info.info.timestamp, 123456);
+	CU_ASSERT_EQUAL(out_info.info.timescale, 1000000);
+	for (unsigned int i = 0; i < 3; i++) {
+		CU_ASSERT_EQUAL(out_info.plane_stride[i],
+				frame_info.plane_stride[i]);
+	}
+
+	/* Planes: content, and layout in the single memory */
+	for (unsigned int i = 0; i < 3; i++) {
+		ret = mbuf_raw_video_frame_get_plane(
+			out_frame, i, &planes[i], &len);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		CU_ASSERT_EQUAL(len, lens[i]);
+		CU_ASSERT(check_bytes(planes[i], len, 0x11 * (i + 1)));
+		CU_ASSERT_EQUAL((const uint8_t *)planes[i] -
+					(const uint8_t *)planes[0],
+				offsets[i]);
+	}
+	for (unsigned int i = 0; i < 3; i++) {
+		ret = mbuf_raw_video_frame_release_plane(
+			out_frame, i, planes[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Metadata are sent, ancillary data are not */
+	ret = mbuf_raw_video_frame_get_metadata(out_frame, &out_meta);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	CU_ASSERT_PTR_NOT_EQUAL(out_meta, meta);
+	CU_ASSERT_STRING_EQUAL(vmeta_frame_get_mime_type(out_meta),
+			       vmeta_frame_get_mime_type(meta));
+	vmeta_frame_unref(out_meta);
+	vmeta_frame_unref(meta);
+	ret = mbuf_raw_video_frame_get_ancillary_data(
+		out_frame, "name", &ancillary);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	/* The memory is given back once both frames are released */
+	ret = mbuf_raw_video_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(shmq_get_free_count(&ctx),
+			MBUF_TEST_SHMQ_MEM_COUNT - 1);
+	CU_ASSERT_EQUAL(poll(&pfd, 1, 0), 1);
+	ret = mbuf_shm_frame_queue_pop_raw_video(ctx.consumer_queue,
+						 &out_frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_raw_video_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(shmq_get_free_count(&ctx), MBUF_TEST_SHMQ_MEM_COUNT);
+	CU_ASSERT_EQUAL(poll(&pfd, 1, 0), 0);
+	ret = mbuf_shm_frame_queue_pop_raw_video(ctx.consumer_queue,
+						 &out_frame);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+
+	shmq_teardown(&ctx);
+}
+
+
+static void test_mbuf_shm_frame_queue_coded_video(void)
+{
+	int ret;
+	struct shmq_ctx ctx;
+	struct vdef_coded_frame frame_info = {
+		.format = vdef_h264_byte_stream,
+		.type = VDEF_CODED_FRAME_TYPE_IDR,
+		.info.resolution.width = MBUF_TEST_SHMQ_WIDTH,
+		.info.resolution.height = MBUF_TEST_SHMQ_HEIGHT,
+		.info.index = 7,
+	};
+	/* SPS and PPS in a first memory, the slice in a second one */
+	struct vdef_nalu nalus[3] = {
+		{
+			.size = 16,
+			.importance = 1,
+			.h264.type = H264_NALU_TYPE_SPS,
+		},
+		{
+			.size = 8,
+			.importance = 1,
+			.h264.type = H264_NALU_TYPE_PPS,
+		},
+		{
+			.size = 1000,
+			.importance = 0,
+			.h264.type = H264_NALU_TYPE_SLICE_IDR,
+			.h264.slice_type = H264_SLICE_TYPE_I,
+		},
+	};
+	const unsigned int mem_index[3] = {0, 0, 1};
+	const size_t offsets[3] = {0, 16, 100};
+	struct vdef_coded_frame out_info;
+	struct mbuf_coded_video_frame *frame, *out_frame;
+	struct vmeta_frame *meta, *out_meta;
+	struct mbuf_mem *mems[2];
+	struct vdef_nalu nalu;
+	const void *nalu_data[3];
+	uint8_t *data;
+	size_t capacity;
+
+	shmq_setup(&ctx);
+
+	ret = mbuf_coded_video_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	for (unsigned int i = 0; i < 2; i++) {
+		ret = mbuf_pool_get(ctx.pool, &mems[i]);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+	}
+	for (unsigned int i = 0; i < 3; i++) {
+		ret = mbuf_mem_get_data(
+			mems[mem_index[i]], (void **)&data, &capacity);
+		CU_ASSERT_EQUAL(ret, 0);
+		memset(data + offsets[i], 0x40 + i, nalus[i].size);
+		ret = mbuf_coded_video_frame_add_nalu(
+			frame, mems[mem_index[i]], offsets[i], &nalus[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	for (unsigned int i = 0; i < 2; i++)
+		mbuf_mem_unref(mems[i]);
+	ret = vmeta_frame_new(VMETA_FRAME_TYPE_PROTO, &meta);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_coded_video_frame_set_metadata(frame, meta);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_finalize(frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	ret = mbuf_shm_frame_queue_push_coded_video(ctx.producer_queue, frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_coded_video_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(shmq_get_free_count(&ctx),
+			MBUF_TEST_SHMQ_MEM_COUNT - 2);
+
+	ret = mbuf_shm_frame_queue_pop_coded_video(ctx.consumer_queue,
+						   &out_frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* Frame info */
+	ret = mbuf_coded_video_frame_get_frame_info(out_frame, &out_info);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(vdef_coded_format_cmp(&out_info.format, &frame_info.format));
+	CU_ASSERT_EQUAL(out_info.type, VDEF_CODED_FRAME_TYPE_IDR);
+	CU_ASSERT_EQUAL(out_info.info.resolution.width, MBUF_TEST_SHMQ_WIDTH);
+	CU_ASSERT_EQUAL(out_info.info.resolution.height,
+			MBUF_TEST_SHMQ_HEIGHT);
+	CU_ASSERT_EQUAL(out_info.info.index, 7);
+
+	/* NALUs: descriptors, content, and layout in the memories */
+	CU_ASSERT_EQUAL_FATAL(mbuf_coded_video_frame_get_nalu_count(out_frame),
+			      3);
+	for (unsigned int i = 0; i < 3; i++) {
+		ret = mbuf_coded_video_frame_get_nalu(
+			out_frame, i, &nalu_data[i], &nalu);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		CU_ASSERT_EQUAL(nalu.size, nalus[i].size);
+		CU_ASSERT_EQUAL(nalu.importance, nalus[i].importance);
+		CU_ASSERT_EQUAL(nalu.h264.type, nalus[i].h264.type);
+		CU_ASSERT_EQUAL(nalu.h264.slice_type, nalus[i].h264.slice_type);
+		CU_ASSERT(check_bytes(nalu_data[i], nalu.size, 0x40 + i));
+	}
+	CU_ASSERT_EQUAL((const uint8_t *)nalu_data[1] -
+				(const uint8_t *)nalu_data[0],
+			offsets[1] - offsets[0]);
+	for (unsigned int i = 0; i < 3; i++) {
+		ret = mbuf_coded_video_frame_release_nalu(
+			out_frame, i, nalu_data[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Metadata */
+	ret = mbuf_coded_video_frame_get_metadata(out_frame, &out_meta);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	CU_ASSERT_PTR_NOT_EQUAL(out_meta, meta);
+	CU_ASSERT_STRING_EQUAL(vmeta_frame_get_mime_type(out_meta),
+			       vmeta_frame_get_mime_type(meta));
+	vmeta_frame_unref(out_meta);
+	vmeta_frame_unref(meta);
+
+	ret = mbuf_coded_video_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(shmq_get_free_count(&ctx), MBUF_TEST_SHMQ_MEM_COUNT);
+
+	shmq_teardown(&ctx);
+}
+
+
+static void test_mbuf_shm_frame_queue_audio(void)
+{
+	int ret;
+	struct shmq_ctx ctx;
+	struct adef_frame frame_info = {
+		.format = adef_aac_lc_16b_44100hz_stereo_raw,
+		.info.timestamp = 654321,
+		.info.timescale = 1000000,
+		.info.index = 33,
+	};
+	struct adef_frame out_info;
+	struct mbuf_audio_frame *frame, *out_frame;
+	struct mbuf_raw_video_frame *raw_frame;
+	struct mbuf_mem *mem;
+	enum mbuf_shm_frame_type type;
+	const void *buffer;
+	size_t len;
+	uint8_t *data;
+	size_t capacity;
+
+	shmq_setup(&ctx);
+
+	ret = mbuf_audio_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_pool_get(ctx.pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_get_data(mem, (void **)&data, &capacity);
+	CU_ASSERT_EQUAL(ret, 0);
+	memset(data + 256, 0x77, 300);
+	ret = mbuf_audio_frame_set_buffer(frame, mem, 256, 300);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_unref(mem);
+	ret = mbuf_audio_frame_finalize(frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	ret = mbuf_shm_frame_queue_push_audio(ctx.producer_queue, frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	ret = mbuf_shm_frame_queue_peek_type(ctx.consumer_queue, &type);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(type, MBUF_SHM_FRAME_TYPE_AUDIO);
+	ret = mbuf_shm_frame_queue_pop_raw_video(ctx.consumer_queue,
+						 &raw_frame);
+	CU_ASSERT_EQUAL(ret, -EPROTO);
+	ret = mbuf_shm_frame_queue_pop_audio(ctx.consumer_queue, &out_frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	ret = mbuf_audio_frame_get_frame_info(out_frame, &out_info);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(adef_format_cmp(&out_info.format, &frame_info.format));
+	CU_ASSERT_EQUAL(out_info.info.timestamp, 654321);
+	CU_ASSERT_EQUAL(out_info.info.timescale, 1000000);
+	CU_ASSERT_EQUAL(out_info.info.index, 33);
+	ret = mbuf_audio_frame_get_buffer(out_frame, &buffer, &len);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	CU_ASSERT_EQUAL(len, 300);
+	CU_ASSERT(check_bytes(buffer, len, 0x77));
+	ret = mbuf_audio_frame_release_buffer(out_frame, buffer);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Frames still in the queue are given back on consumer destruction */
+	ret = mbuf_audio_frame_unref(out_frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_get(ctx.pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	frame_info.info.index++;
+	ret = mbuf_audio_frame_new(&frame_info, &frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_audio_frame_set_buffer(frame, mem, 0, 300);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_unref(mem);
+	ret = mbuf_audio_frame_finalize(frame);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_shm_frame_queue_push_audio(ctx.producer_queue, frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_audio_frame_unref(frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(shmq_get_free_count(&ctx),
+			MBUF_TEST_SHMQ_MEM_COUNT - 1);
+	ret = mbuf_shm_frame_queue_destroy(ctx.consumer_queue);
+	CU_ASSERT_EQUAL(ret, 0);
+	ctx.consumer_queue = NULL;
+	CU_ASSERT_EQUAL(shmq_get_free_count(&ctx), MBUF_TEST_SHMQ_MEM_COUNT);
+
+	shmq_teardown(&ctx);
+}
+
+
+CU_TestInfo g_mbuf_test_shm_frame_queue[] = {
+	{(char *)"raw_video", &test_mbuf_shm_frame_queue_raw_video},
+	{(char *)"coded_video", &test_mbuf_shm_frame_queue_coded_video},
+	{(char *)"audio", &test_mbuf_shm_frame_queue_audio},
+	CU_TEST_INFO_NULL,
+};
@@ -0,0 +1,378 @@
+/**
+ * Copyright (c) 2026 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mbuf_test.h"
+
+#include <media-buffers/mbuf_mem_shm.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+#define MBUF_TEST_SHM_MEM_SIZE 4096
+/* Not a multiple of 64, so that the last bitmap word is partially used */
+#define MBUF_TEST_SHM_MEM_COUNT 200
+#define MBUF_TEST_SHM_THREADS 4
+
+
+static void test_shm_attr(struct mbuf_shm_attr *attr, char *addr, size_t len)
+{
+	snprintf(addr, len, "/mbuf_test_shm_%d", (int)getpid());
+	attr->addr = addr;
+	attr->mem_size = MBUF_TEST_SHM_MEM_SIZE;
+	attr->mem_count = MBUF_TEST_SHM_MEM_COUNT;
+}
+
+
+struct shm_alloc_ctx {
+	struct mbuf_pool *pool;
+	atomic_uint *ready;
+	struct mbuf_mem *mems[MBUF_TEST_SHM_MEM_COUNT];
+	unsigned int count;
+	int ret;
+};
+
+
+static void *shm_alloc_thread(void *userdata)
+{
+	struct shm_alloc_ctx *ctx = userdata;
+	struct mbuf_mem *mem;
+
+	/* Start all threads at the same time */
+	atomic_fetch_add(ctx->ready, 1);
+	while (atomic_load(ctx->ready) < MBUF_TEST_SHM_THREADS)
+		sched_yield();
+
+	/* Allocate until the SHM is exhausted */
+	while ((ctx->ret = mbuf_pool_get(ctx->pool, &mem)) == 0)
+		ctx->mems[ctx->count++] = mem;
+
+	return NULL;
+}
+
+
+static void test_mbuf_shm_alloc_concurrent(void)
+{
+	int ret;
+	char addr[64];
+	struct mbuf_shm_attr attr;
+	struct mbuf_mem_implem *implem;
+	struct mbuf_shm_stats stats;
+	struct shm_alloc_ctx ctx[MBUF_TEST_SHM_THREADS];
+	pthread_t threads[MBUF_TEST_SHM_THREADS];
+	atomic_uint ready;
+	bool used[MBUF_TEST_SHM_MEM_COUNT] = {false};
+	unsigned int total = 0;
+	struct mbuf_mem *mem;
+
+	test_shm_attr(&attr, addr, sizeof(addr));
+	implem = mbuf_mem_shm_get_implem(&attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(implem);
+	ret = mbuf_mem_shm_get_stats(implem, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.mem_count, MBUF_TEST_SHM_MEM_COUNT);
+	CU_ASSERT_EQUAL(stats.used_count, 0);
+	CU_ASSERT_EQUAL(stats.peak_used_count, 0);
+
+	/* One growing pool per thread, so that the pools locks do not
+	 * serialize the slot allocations */
+	atomic_init(&ready, 0);
+	for (unsigned int i = 0; i < MBUF_TEST_SHM_THREADS; i++) {
+		memset(&ctx[i], 0, sizeof(ctx[i]));
+		ctx[i].ready = &ready;
+		ret = mbuf_pool_new(implem,
+				    MBUF_TEST_SHM_MEM_SIZE,
+				    0,
+				    MBUF_POOL_GROW,
+				    0,
+				    "shm",
+				    &ctx[i].pool);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+	}
+	for (unsigned int i = 0; i < MBUF_TEST_SHM_THREADS; i++) {
+		ret = pthread_create(
+			&threads[i], NULL, shm_alloc_thread, &ctx[i]);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+	}
+	for (unsigned int i = 0; i < MBUF_TEST_SHM_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	/* Every slot must have been handed out exactly once */
+	for (unsigned int i = 0; i < MBUF_TEST_SHM_THREADS; i++) {
+		CU_ASSERT_EQUAL(ctx[i].ret, -ENOMEM);
+		for (unsigned int j = 0; j < ctx[i].count; j++) {
+			ret = mbuf_mem_shm_get_index(ctx[i].mems[j]);
+			CU_ASSERT(ret >= 0 && ret < MBUF_TEST_SHM_MEM_COUNT);
+			if (ret < 0 || ret >= MBUF_TEST_SHM_MEM_COUNT)
+				continue;
+			CU_ASSERT_FALSE(used[ret]);
+			used[ret] = true;
+		}
+		total += ctx[i].count;
+	}
+	CU_ASSERT_EQUAL(total, MBUF_TEST_SHM_MEM_COUNT);
+	ret = mbuf_mem_shm_get_stats(implem, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.used_count, MBUF_TEST_SHM_MEM_COUNT);
+	CU_ASSERT_EQUAL(stats.peak_used_count, MBUF_TEST_SHM_MEM_COUNT);
+
+	/* Released memories go back to their pool, and the slots are only
+	 * freed with the pools */
+	for (unsigned int i = 0; i < MBUF_TEST_SHM_THREADS; i++) {
+		for (unsigned int j = 0; j < ctx[i].count; j++) {
+			ret = mbuf_mem_unref(ctx[i].mems[j]);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+	}
+	ret = mbuf_mem_shm_get_stats(implem, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.used_count, MBUF_TEST_SHM_MEM_COUNT);
+	for (unsigned int i = 1; i < MBUF_TEST_SHM_THREADS; i++) {
+		ret = mbuf_pool_destroy(ctx[i].pool);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = mbuf_mem_shm_get_stats(implem, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.used_count, ctx[0].count);
+	CU_ASSERT_EQUAL(stats.peak_used_count, MBUF_TEST_SHM_MEM_COUNT);
+
+	/* The freed slots can be allocated again */
+	ret = mbuf_pool_destroy(ctx[0].pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_new(implem,
+			    MBUF_TEST_SHM_MEM_SIZE,
+			    1,
+			    MBUF_POOL_NO_GROW,
+			    0,
+			    "shm",
+			    &ctx[0].pool);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_pool_get(ctx[0].pool, &mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_shm_get_stats(implem, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.used_count, 1);
+	CU_ASSERT_EQUAL(stats.peak_used_count, MBUF_TEST_SHM_MEM_COUNT);
+
+	/* Cleanup */
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_destroy(ctx[0].pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_shm_release_implem(implem);
+}
+
+
+static void test_mbuf_shm_share(void)
+{
+	int ret;
+	char addr[64];
+	struct mbuf_shm_attr attr;
+	struct mbuf_mem_implem *implem;
+	struct mbuf_pool *pool;
+	struct mbuf_mem *mem, *mem1, *mem2, *tmp;
+	struct mbuf_shm_consumer *consumer1, *consumer2;
+	void *data, *data1;
+	size_t size;
+	int index;
+
+	test_shm_attr(&attr, addr, sizeof(addr));
+	implem = mbuf_mem_shm_get_implem(&attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(implem);
+	ret = mbuf_pool_new(implem,
+			    MBUF_TEST_SHM_MEM_SIZE,
+			    1,
+			    MBUF_POOL_NO_GROW,
+			    0,
+			    "shm",
+			    &pool);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_shm_consumer_attach(&attr, false, &consumer1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_shm_consumer_attach(&attr, false, &consumer2);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* Write a pattern and share the memory with both consumers */
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	index = mbuf_mem_shm_get_index(mem);
+	CU_ASSERT(index >= 0);
+	ret = mbuf_mem_get_data(mem, &data, &size);
+	CU_ASSERT_EQUAL(ret, 0);
+	memset(data, 0xa5, size);
+	ret = mbuf_mem_shm_share(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_shm_share(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Not adopted yet, but still shared: the SHM implementation reports the
+	 * memory as busy, and the pool has no other memory to return */
+	ret = mbuf_pool_get(pool, &tmp);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+
+	/* Each share can only be adopted once */
+	ret = mbuf_mem_shm_consumer_get_mem(consumer1, index, &mem1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_shm_consumer_get_mem(consumer2, index, &mem2);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_shm_consumer_get_mem(consumer1, index, &tmp);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	ret = mbuf_mem_shm_consumer_get_mem(consumer2, index, &tmp);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	/* The consumers see the producer data */
+	ret = mbuf_mem_get_data(mem1, &data1, &size);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(size, MBUF_TEST_SHM_MEM_SIZE);
+	CU_ASSERT_EQUAL(memcmp(data, data1, size), 0);
+
+	/* The memory stays busy until every consumer has released it */
+	ret = mbuf_pool_get(pool, &tmp);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+	ret = mbuf_mem_shm_consumer_detach(consumer1);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	ret = mbuf_mem_unref(mem1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_shm_consumer_detach(consumer1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_get(pool, &tmp);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+	ret = mbuf_mem_unref(mem2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	CU_ASSERT_EQUAL(mbuf_mem_shm_get_index(mem), index);
+
+	/* Released shares cannot be adopted again */
+	ret = mbuf_mem_shm_consumer_get_mem(consumer2, index, &tmp);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	/* Cleanup */
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_shm_consumer_detach(consumer2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_shm_release_implem(implem);
+}
+
+
+static void test_mbuf_shm_reclaim(void)
+{
+	int ret, status;
+	char addr[64];
+	struct mbuf_shm_attr attr;
+	struct mbuf_mem_implem *implem;
+	struct mbuf_pool *pool;
+	struct mbuf_mem *mem, *tmp;
+	struct mbuf_shm_consumer *consumer;
+	int index;
+	pid_t pid;
+
+	test_shm_attr(&attr, addr, sizeof(addr));
+	implem = mbuf_mem_shm_get_implem(&attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(implem);
+	ret = mbuf_pool_new(implem,
+			    MBUF_TEST_SHM_MEM_SIZE,
+			    1,
+			    MBUF_POOL_NO_GROW,
+			    0,
+			    "shm",
+			    &pool);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	index = mbuf_mem_shm_get_index(mem);
+	CU_ASSERT(index >= 0);
+	ret = mbuf_mem_shm_share(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* A consumer adopts the memory then exits without releasing it */
+	pid = fork();
+	CU_ASSERT_FATAL(pid >= 0);
+	if (pid == 0) {
+		ret = mbuf_mem_shm_consumer_attach(&attr, false, &consumer);
+		if (ret == 0)
+			ret = mbuf_mem_shm_consumer_get_mem(
+				consumer, index, &tmp);
+		_exit(ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	ret = waitpid(pid, &status, 0);
+	CU_ASSERT_EQUAL(ret, pid);
+	CU_ASSERT(WIFEXITED(status));
+	CU_ASSERT_EQUAL(WEXITSTATUS(status), EXIT_SUCCESS);
+	ret = mbuf_pool_get(pool, &tmp);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+
+	/* The references of the dead consumer are released */
+	ret = mbuf_mem_shm_reclaim(implem);
+	CU_ASSERT_EQUAL(ret, 1);
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* Pending shares are kept while a consumer is attached, and released
+	 * once no consumer is left */
+	ret = mbuf_mem_shm_share(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_shm_consumer_attach(&attr, false, &consumer);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = mbuf_mem_shm_reclaim(implem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_get(pool, &tmp);
+	CU_ASSERT_EQUAL(ret, -EAGAIN);
+	ret = mbuf_mem_shm_consumer_detach(consumer);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_mem_shm_reclaim(implem);
+	CU_ASSERT_EQUAL(ret, 1);
+	ret = mbuf_pool_get(pool, &mem);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* Cleanup */
+	ret = mbuf_mem_unref(mem);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = mbuf_pool_destroy(pool);
+	CU_ASSERT_EQUAL(ret, 0);
+	mbuf_mem_shm_release_implem(implem);
+}
+
+
+CU_TestInfo g_mbuf_test_shm[] = {
+	{(char *)"alloc_concurrent", &test_mbuf_shm_alloc_concurrent},
+	{(char *)"share", &test_mbuf_shm_share},
+	{(char *)"reclaim", &test_mbuf_shm_reclaim},
+	CU_TEST_INFO_NULL,
+};
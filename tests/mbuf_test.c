@@ -36,6 +36,15 @@ static CU_SuiteInfo s_suites[] = {
 	 g_mbuf_test_coded_video_frame},
 	{(char *)"audio_frame", NULL, NULL, g_mbuf_test_audio_frame},
 	{(char *)"ancillary", NULL, NULL, g_mbuf_test_ancillary},
+#ifdef MBUF_TEST_SHM
+	{(char *)"memory_shm", NULL, NULL, g_mbuf_test_shm},
+#endif
+#ifdef MBUF_TEST_MEMFD
+	{(char *)"memory_memfd", NULL, NULL, g_mbuf_test_memfd},
+#endif
+#ifdef MBUF_TEST_SHM_FRAME_QUEUE
+	{(char *)"shm_frame_queue", NULL, NULL, g_mbuf_test_shm_frame_queue},
+#endif
 	CU_SUITE_INFO_NULL,
 };
 
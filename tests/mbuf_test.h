@@ -53,6 +53,15 @@ extern CU_TestInfo g_mbuf_test_coded_video_frame[];
 extern CU_TestInfo g_mbuf_test_pool[];
 extern CU_TestInfo g_mbuf_test_raw_video_frame[];
 extern CU_TestInfo g_mbuf_test_wrap[];
+#ifdef MBUF_TEST_SHM
+extern CU_TestInfo g_mbuf_test_shm[];
+#endif
+#ifdef MBUF_TEST_MEMFD
+extern CU_TestInfo g_mbuf_test_memfd[];
+#endif
+#ifdef MBUF_TEST_SHM_FRAME_QUEUE
+extern CU_TestInfo g_mbuf_test_shm_frame_queue[];
+#endif
 
 
 #endif /* _MBUF_TEST_H_ */